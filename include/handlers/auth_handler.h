@@ -11,6 +11,16 @@
 
 void handle_register(Client *cli, const RegisterPayload *payload);
 void handle_login(Client *cli, const LoginPayload *payload);
+
+/**
+ * @brief Logs in from a session token (see session.h) instead of a password.
+ */
+void handle_resume(Client *cli, const SessionToken *token);
 void handle_update_user(Client *cli, const UpdateUserPayload *payload);
 
+/**
+ * @brief Sends the home screen snapshot (see bootstrap.h).
+ */
+void handle_req_bootstrap(Client *cli, const BootstrapRequestPayload *payload);
+
 #endif
\ No newline at end of file
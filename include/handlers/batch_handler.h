@@ -0,0 +1,22 @@
+/**
+ * @file batch_handler.h
+ * @brief Server-side handler for multi-operation frames (MSG_BATCH_REQUEST).
+ */
+
+#ifndef BATCH_HANDLER_H
+#define BATCH_HANDLER_H
+
+#include "infrastructure/server_types.h"
+#include "system/protocol.h"
+
+/**
+ * @brief Executes every sub-frame of a MSG_BATCH_REQUEST envelope.
+ * All sub-operations run inside a single storage transaction; the client
+ * receives one MSG_BATCH_RESULT and a single refresh per affected list.
+ * Pushes to other clients are held until the commit and dropped if it fails.
+ * Malformed envelopes, or ones over MAX_BATCH_OPS, are rejected before
+ * anything runs, with an empty result.
+ */
+void handle_batch(Client *cli, const void *payload, uint32_t len);
+
+#endif
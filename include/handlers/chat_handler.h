@@ -20,4 +20,15 @@ void handle_send_text(Client *cli, const SendMessagePayload *payload);
  */
 void handle_req_history(Client *cli, const RequestHistoryPayload *payload);
 
+/**
+ * @brief Streams the first page of messages queued while the user was offline
+ * (called at login). Each acknowledged page is followed by the next one.
+ */
+void push_offline_messages(Client *cli);
+
+/**
+ * @brief Drops queued offline messages the client has acknowledged.
+ */
+void handle_offline_ack(Client *cli, const OfflineAckPayload *payload);
+
 #endif
\ No newline at end of file
@@ -14,4 +14,9 @@ void handle_add_by_code(Client *cli, const AddContactPayload *payload);
 void handle_get_requests(Client *cli);
 void handle_decide_request(Client *cli, const DecideRequestPayload *payload);
 
+/**
+ * @brief Opts the client in to MSG_PRESENCE_UPDATE pushes for its contacts.
+ */
+void handle_presence_subscribe(Client *cli);
+
 #endif
\ No newline at end of file
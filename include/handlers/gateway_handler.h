@@ -0,0 +1,39 @@
+/**
+ * @file gateway_handler.h
+ * @brief Server-side handlers for gateway multiplexing (MSG_GW_FRAME / MSG_GW_CLOSE).
+ *
+ * A gateway logs in like any user, then carries the traffic of many devices
+ * over its single connection. Each device is a logical session with its own
+ * Client (and its own MSG_LOGIN / MSG_RESUME), so routing, presence and
+ * offline delivery work unchanged.
+ */
+
+#ifndef GATEWAY_HANDLER_H
+#define GATEWAY_HANDLER_H
+
+#include "infrastructure/server_types.h"
+#include "system/protocol.h"
+
+/**
+ * @brief Enables gateway mode.
+ * @param max_sessions Logical sessions allowed per gateway connection (0 = disabled).
+ */
+void gateway_init(int max_sessions);
+
+/**
+ * @brief Dispatches the inner frame of a MSG_GW_FRAME to its session,
+ * opening the session on first use.
+ */
+void handle_gw_frame(Client *link, const void *payload, uint32_t len);
+
+/**
+ * @brief Ends one logical session at the gateway's request.
+ */
+void handle_gw_close(Client *link, const void *payload, uint32_t len);
+
+/**
+ * @brief Ends every session carried by `link`. Call before removing the connection.
+ */
+void gateway_release(Client *link);
+
+#endif
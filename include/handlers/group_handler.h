@@ -9,12 +9,41 @@
 #include "infrastructure/server_types.h"
 #include "system/protocol.h"
 
-void handle_create_conv(Client *cli, const CreateConvPayload *payload);
+/**
+ * @brief Creates a conversation. `payload` is a CreateConvPayload whose
+ * participant_uids may extend past MAX_PARTICIPANTS (see protocol.h).
+ */
+void handle_create_conv(Client *cli, const void *payload, uint32_t len);
 void handle_req_conversations(Client *cli);
 void handle_update_group(Client *cli, const UpdateGroupPayload *payload);
 void handle_add_member(Client *cli, const AddMemberPayload *payload);
-void handle_req_members(Client *cli, const ReqMembersPayload *payload);
+
+/**
+ * @brief Streams one page of members (ReqMembersPayload; short payloads get every member).
+ */
+void handle_req_members(Client *cli, const void *payload, uint32_t len);
 void handle_kick_member(Client *cli, const KickMemberPayload *payload);
 void handle_delete_group(Client *cli, const DeleteGroupPayload *payload);
 
+/**
+ * @brief Pushes one conversation (MSG_CONV_UPDATED) to its online members,
+ * e.g. once it has been created. Members of a group share one fan-out frame.
+ */
+void group_push_conversation(uint32_t conv_id);
+
+/**
+ * @brief Defers group update fan-out until group_flush_notifications().
+ * Used by batches so N changes to one group trigger a single update per member.
+ */
+void group_defer_notifications(void);
+
+/**
+ * @brief Sends the deferred group updates, once per conversation. If the
+ * batch was rolled back (`applied` is 0), nothing is sent and the cached
+ * member lists of those conversations are reloaded from storage instead.
+ * Telemetry rings of the conversations the batch deleted are dropped only
+ * once it is applied.
+ */
+void group_flush_notifications(int applied);
+
 #endif
\ No newline at end of file
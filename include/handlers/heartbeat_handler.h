@@ -0,0 +1,22 @@
+/**
+ * @file heartbeat_handler.h
+ * @brief Server-side handlers for MSG_PING / MSG_PONG.
+ */
+
+#ifndef HEARTBEAT_HANDLER_H
+#define HEARTBEAT_HANDLER_H
+
+#include "infrastructure/server_types.h"
+#include "system/protocol.h"
+
+/**
+ * @brief Echoes the payload back as MSG_PONG.
+ */
+void handle_ping(Client *cli, const PingPayload *p);
+
+/**
+ * @brief Answer to a server ping. Receiving it already counted as activity.
+ */
+void handle_pong(Client *cli, const PingPayload *p);
+
+#endif
@@ -0,0 +1,31 @@
+/**
+ * @file telemetry_handler.h
+ * @brief Server-side handlers for telemetry channels (CONV_TYPE_TELEMETRY).
+ */
+
+#ifndef TELEMETRY_HANDLER_H
+#define TELEMETRY_HANDLER_H
+
+#include "infrastructure/server_types.h"
+#include "system/protocol.h"
+
+/**
+ * @brief Appends one sample to the channel ring. Samples over the channel's
+ * rate are dropped; nothing is sent back either way. The per-connection
+ * budget (ADMIT_TELEMETRY) is checked before this runs.
+ */
+void handle_telemetry_push(Client *cli, const void *payload, uint32_t len);
+
+/**
+ * @brief Sets the rate and retention limits of a channel (admin only).
+ */
+void handle_telemetry_config(Client *cli, const TelemetryConfigPayload *p);
+
+/**
+ * @brief Streams the samples of a time range (MSG_RESP_TELEMETRY), at most
+ * 65536 rows. The ring is read a page at a time, each page resuming after
+ * the last timestamp sent, so a query never buffers more than one page.
+ */
+void handle_req_telemetry(Client *cli, const TelemetryQueryPayload *p);
+
+#endif
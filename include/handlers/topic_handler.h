@@ -0,0 +1,20 @@
+/**
+ * @file topic_handler.h
+ * @brief Server-side handlers for topic publish/subscribe.
+ */
+
+#ifndef TOPIC_HANDLER_H
+#define TOPIC_HANDLER_H
+
+#include "infrastructure/server_types.h"
+#include "system/protocol.h"
+
+void handle_subscribe(Client *cli, const TopicFilterPayload *p);
+void handle_unsubscribe(Client *cli, const TopicFilterPayload *p);
+
+/**
+ * @brief Fans a message out to the matching subscribers (see topics.h).
+ */
+void handle_publish(Client *cli, const void *payload, uint32_t len);
+
+#endif
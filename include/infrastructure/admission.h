@@ -0,0 +1,46 @@
+/**
+ * @file admission.h
+ * @brief Admission control: per-connection request rates and overload shedding.
+ *
+ * Every connection (or gateway session) has a token bucket per request class
+ * (see AdmissionClass): requests over the class rate are refused with
+ * MSG_RETRY_AFTER instead of reaching their handler.
+ *
+ * A global controller watches how long each event loop iteration runs and
+ * how many tasks wait for an executor. Past the configured limits it sheds
+ * the expensive classes first: queries (history, list rebuilds), then, at
+ * twice the limits, logins. Messages are never shed. It steps back down
+ * once the pressure is well below the level it entered at.
+ */
+
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdint.h>
+#include "infrastructure/server_types.h"
+#include "system/config_loader.h"
+
+/**
+ * @brief Applies the rates and overload limits of `config`. May be called
+ * again to change them; buckets keep their tokens.
+ */
+void admission_init(const AppConfig *config);
+
+/**
+ * @brief Marks the event loop as busy (call when epoll_wait returns).
+ */
+void admission_loop_wake(void);
+
+/**
+ * @brief Marks the event loop as idle (call before epoll_wait) and updates
+ * the overload level from the iteration that just ended.
+ */
+void admission_loop_sleep(void);
+
+/**
+ * @brief Takes one request of class `cls` from the client's budget.
+ * @return 0 if admitted, otherwise the milliseconds to wait before retrying.
+ */
+uint32_t admission_check(Client *cli, AdmissionClass cls);
+
+#endif
@@ -0,0 +1,43 @@
+/**
+ * @file bootstrap.h
+ * @brief Cached login snapshot: identity, contacts, requests and conversations.
+ *
+ * Each user has a version that changes whenever one of those lists may have
+ * changed. A client that already holds the current version gets an empty
+ * "unchanged" reply instead of the lists.
+ */
+
+#ifndef BOOTSTRAP_H
+#define BOOTSTRAP_H
+
+#include "infrastructure/server_types.h"
+#include "system/protocol.h"
+
+/**
+ * @brief Sends MSG_BOOTSTRAP to an authenticated client, streamed.
+ * Only an "unchanged" header is sent if `known_version` is current.
+ */
+void bootstrap_send(Client *cli, uint64_t known_version);
+
+/**
+ * @brief Marks the user's snapshot stale. Call after any change to their lists.
+ */
+void bootstrap_invalidate(uint32_t uid);
+
+/**
+ * @brief Invalidates every participant of a conversation.
+ */
+void bootstrap_invalidate_conv(uint32_t conv_id);
+
+/**
+ * @brief Invalidates every snapshot (e.g. after a rename shown in other users' lists).
+ */
+void bootstrap_invalidate_all(void);
+
+/**
+ * @brief Frees the cached snapshot once the user has no connection left.
+ * The version is kept so a reconnect can still be answered with "unchanged".
+ */
+void bootstrap_release(uint32_t uid);
+
+#endif
@@ -11,6 +11,15 @@
 #include <pthread.h>
 #include <openssl/ssl.h>
 
+/**
+ * @brief Unread messages received before the conversation list was loaded.
+ */
+typedef struct PendingUnread
+{
+    uint32_t conv_id;
+    int count;
+} PendingUnread;
+
 /**
  * @brief Global Application State.
  * Holds the connection handle, UI state flags, and dynamic data cache.
@@ -26,6 +35,12 @@ typedef struct AppState
 
     // Identity
     MyInfoPayload my_info;
+    uint64_t bootstrap_version; /**< Version of the last MSG_BOOTSTRAP applied */
+    SessionToken session_token; /**< Latest token, presented with MSG_RESUME */
+
+    // Link state (see reconnect_if_due)
+    int link_down;               /**< Set by the network thread when the connection closes */
+    uint32_t reconnect_delay_ms; /**< Asked by the server with MSG_RECONNECT, 0 if not */
 
     // --- Dynamic Data Stores ---
     ContactSummary *contacts;
@@ -37,6 +52,9 @@ typedef struct AppState
     ConversationSummary *conversations;
     int conv_count;
 
+    PendingUnread *pending_unread; /**< Applied on next conversation list */
+    int pending_unread_count;
+
     GroupMemberSummary *current_group_members;
     int current_group_members_count;
     int member_selection_idx;
@@ -52,6 +70,7 @@ typedef struct AppState
 
     // Thread Safety
     pthread_mutex_t state_lock; /**< Protects access to all fields above */
+    pthread_mutex_t send_lock;  /**< Serializes writes to ssl (see app_send) */
 } AppState;
 
 extern AppState app;
@@ -66,13 +85,52 @@ void app_init(void);
  */
 void app_cleanup(void);
 
+/**
+ * @brief send_packet() on app.ssl, from any thread. The UI, the network thread
+ * (pongs, acks) and the health probe all write to the connection; unlocked,
+ * their SSL_write calls would interleave records.
+ */
+int app_send(MessageType type, const void *payload, uint32_t payload_len);
+
 // Logic Helpers
 void app_remove_request(int index);
 void app_append_history(const char *text);
 
+/**
+ * @brief Bumps a conversation's unread counter, or remembers it until the
+ * conversation list arrives. Caller holds state_lock.
+ */
+void app_add_unread(uint32_t conv_id, int count);
+
+/**
+ * @brief Applies remembered unread counters to the current conversation list.
+ * Caller holds state_lock.
+ */
+void app_apply_pending_unread(void);
+
+/**
+ * @brief Applies a MSG_CONV_UPDATED to the conversation list.
+ * Caller holds state_lock.
+ */
+void app_apply_conv_update(const ConvUpdatePayload *update);
+
 // Session Persistence
-void save_session(const char *e, const char *p);
-int load_session(LoginPayload *p);
+/**
+ * @brief Saves the session token to ~/.mot/session.dat (mode 0600).
+ */
+void save_session(const SessionToken *token);
+int load_session(SessionToken *token);
 void clear_session();
 
+/**
+ * @brief Persists every TLS session the server issues to ~/.mot/tls_session.pem.
+ */
+void tls_session_enable_cache(SSL_CTX *ctx);
+
+/**
+ * @brief Offers the saved TLS session for resumption. Call before SSL_connect().
+ * @return 1 if a session was offered, 0 otherwise.
+ */
+int tls_session_offer(SSL *ssl);
+
 #endif
\ No newline at end of file
@@ -7,6 +7,7 @@
 #define CLIENT_MANAGER_H
 
 #include "infrastructure/server_types.h"
+#include "infrastructure/outqueue.h"
 
 /**
  * @brief Initializes the internal client list (e.g., sets head to NULL).
@@ -21,16 +22,112 @@ void free_clients(void);
 /**
  * @brief Adds a new client connection to the list.
  * @param fd The socket file descriptor.
- * @param ssl The SSL handle (transferred ownership to manager).
+ * @param ssl The SSL handle (transferred ownership to manager), NULL for a
+ * plaintext listener.
+ * @return The new client, or NULL (the connection is then closed).
  */
-void add_client(int fd, SSL *ssl);
+Client *add_client(int fd, SSL *ssl);
 
 /**
- * @brief Removes a client by FD, cleaning up SSL and memory.
+ * @brief Removes a client by FD, freeing its memory. The socket and SSL
+ * handle are closed with its outbound queue, once no fan-out still uses it.
  */
 void remove_client(int fd);
 
+/**
+ * @brief Adds a logical session carried by the `gateway` connection.
+ * The session behaves like any other client (it gets a synthetic negative
+ * FD); its outbound packets are wrapped in MSG_GW_FRAME on the gateway link.
+ * Remove it with remove_client() before removing the gateway itself.
+ */
+Client *add_gateway_session(Client *gateway, uint32_t session_id);
+
+/**
+ * @brief Finds a logical session of a gateway connection (O(1), hashed).
+ */
+Client *get_gateway_session(const Client *gateway, uint32_t session_id);
+
+/**
+ * @brief Returns any session still open on `gateway`, NULL if none (O(1), used for teardown).
+ */
+Client *client_next_gateway_session(const Client *gateway);
+
+/**
+ * @brief Marks the client as authenticated as `uid` and indexes it for lookups.
+ * Passing 0 returns the client to the guest state.
+ */
+void client_bind_uid(Client *cli, uint32_t uid);
+
+/**
+ * @brief Finds an online client by user id (O(1) through the uid index).
+ */
 Client *get_client_by_uid(uint32_t uid);
+
+/**
+ * @brief Finds a client by socket FD, or by synthetic FD for gateway sessions (O(1), hashed).
+ */
 Client *get_client_by_fd(int fd);
 
+/**
+ * @brief Reference to a client that outlives it (see ClientRef).
+ */
+ClientRef client_ref(const Client *cli);
+
+/**
+ * @brief The client a reference was taken from, NULL if it has disconnected.
+ */
+Client *client_resolve(ClientRef ref);
+
+/**
+ * @brief Calls `fn` for every client, gateway sessions included.
+ * `fn` must not add or remove clients.
+ */
+void client_foreach(void (*fn)(Client *cli, void *arg), void *arg);
+
+/**
+ * @brief Number of live connections authenticated as `uid`.
+ */
+int client_count_by_uid(uint32_t uid);
+
+/**
+ * @brief Sends a packet to a connected client.
+ * Handlers must use this instead of send_packet() so that outbound traffic
+ * can be coalesced (see client_coalesce_begin()).
+ * @return 1 on success (or if the frame was captured), -1 on failure.
+ */
+int client_send(Client *cli, MessageType type, const void *payload, uint32_t payload_len);
+
+/**
+ * @brief Appends an already serialized frame to the client's outbound queue
+ * without writing it (see fanout.h). Gateway sessions get a wrapped copy on
+ * their gateway's queue.
+ * @return The queue to flush, or NULL if the client cannot take the frame.
+ */
+OutQueue *client_enqueue(Client *cli, OutFrame *frame);
+
+/**
+ * @brief Starts coalescing outbound traffic (used by MSG_BATCH_REQUEST).
+ * While active, nothing is written: list refreshes (contacts, requests,
+ * conversations, members) are collapsed to the last one per client, other
+ * frames to other clients (and conversation updates to `origin`) are held
+ * in order, and replies to `origin` are captured instead of being sent.
+ */
+void client_coalesce_begin(Client *origin);
+
+/**
+ * @brief Returns the first reply captured for the origin since the last call, 0 if none.
+ */
+MessageType client_coalesce_take_reply(void);
+
+/**
+ * @brief Whether client_coalesce_begin() is in effect.
+ */
+int client_coalescing(void);
+
+/**
+ * @brief Stops coalescing. The held frames are sent if `deliver` is set
+ * (the batch was committed), dropped otherwise.
+ */
+void client_coalesce_end(int deliver);
+
 #endif
\ No newline at end of file
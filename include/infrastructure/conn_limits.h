@@ -0,0 +1,40 @@
+/**
+ * @file conn_limits.h
+ * @brief Caps on open connections, globally and per remote address.
+ *
+ * A connection is counted from accept() until its socket is closed, TLS
+ * handshake included, so a flood of half-open handshakes is capped too.
+ * Loopback and unix-socket peers (local proxies, which carry many users)
+ * only count towards the global cap.
+ */
+
+#ifndef CONN_LIMITS_H
+#define CONN_LIMITS_H
+
+#include <sys/socket.h>
+#include "system/config_loader.h"
+
+/**
+ * @brief Applies the caps of `config`. May be called again to change them;
+ * open connections stay counted.
+ */
+void conn_limits_init(const AppConfig *config);
+
+/**
+ * @brief Counts a newly accepted socket.
+ * @return 1 if admitted, 0 if over a cap (the caller closes `fd`).
+ */
+int conn_admit(int fd, const struct sockaddr *peer);
+
+/**
+ * @brief Uncounts `fd` before it is closed. Does nothing for sockets that
+ * were not admitted (or gateway sessions).
+ */
+void conn_release(int fd);
+
+/**
+ * @brief Open connections (handshakes included).
+ */
+int conn_count(void);
+
+#endif
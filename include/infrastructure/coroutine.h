@@ -0,0 +1,83 @@
+/**
+ * @file coroutine.h
+ * @brief Stackless coroutines (protothread style) for handlers that await
+ * executor jobs.
+ *
+ * A coroutine handler is called again at every resume and jumps back to
+ * where it left off (a switch on the line of the last await). Nothing on the
+ * C stack survives an await, so the handler keeps its state in a heap frame.
+ *
+ *     static CoStatus login_co(Coroutine *co, Client *cli)
+ *     {
+ *         LoginFrame *f = co->frame;
+ *         CO_BEGIN(co);
+ *         CO_AWAIT(co, f->uid, verify_password); // runs on an executor
+ *         client_send(cli, ...);                 // back on the event loop
+ *         CO_END(co);
+ *     }
+ *
+ * The job runs on the executor of `key` (see executor.h) with the frame as
+ * argument; the handler resumes on the event loop once it is done. If the
+ * client disconnected in the meantime, the coroutine is dropped instead.
+ * While a client has a coroutine in flight, its next requests are held back
+ * by the dispatcher and run afterwards, so replies keep request order.
+ */
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include "infrastructure/executor.h"
+#include "infrastructure/server_types.h"
+
+typedef enum
+{
+    CO_DONE = 0,
+    CO_WAITING
+} CoStatus;
+
+typedef struct Coroutine Coroutine;
+typedef CoStatus (*CoroutineFn)(Coroutine *co, Client *cli);
+
+struct Coroutine
+{
+    int line;          /**< Resume point (0 = start) */
+    ClientRef owner;
+    CoroutineFn fn;
+    ExecutorFn job;    /**< Job being awaited */
+    void *frame;       /**< Handler state, freed with the coroutine */
+    void (*free_frame)(void *frame);
+    int inline_only;   /**< Set when the coroutine itself could not be allocated */
+};
+
+#define CO_BEGIN(co) switch ((co)->line) { case 0:
+
+#define CO_END(co) } return CO_DONE
+
+/**
+ * @brief Runs `job(co->frame)` on the executor of `key` and suspends until it is done.
+ */
+#define CO_AWAIT(co, key, job_fn)                      \
+    do                                                 \
+    {                                                  \
+        (co)->line = __LINE__;                         \
+        if (coroutine_await((co), (key), (job_fn)))    \
+            return CO_WAITING;                         \
+        __attribute__((fallthrough));                  \
+    case __LINE__:;                                    \
+    } while (0)
+
+/**
+ * @brief Starts a coroutine handler for `cli` and runs it up to its first await.
+ * @param frame Heap state; the coroutine owns it.
+ * @param free_frame Releases the frame, NULL for plain free(). Also called
+ * when the client disconnects before the handler is done.
+ */
+void coroutine_start(Client *cli, CoroutineFn fn, void *frame, void (*free_frame)(void *frame));
+
+/**
+ * @brief Used by CO_AWAIT.
+ * @return 1 if suspended, 0 if the job already ran here (no executors, or out of memory).
+ */
+int coroutine_await(Coroutine *co, uint32_t key, ExecutorFn job);
+
+#endif
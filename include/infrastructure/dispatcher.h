@@ -0,0 +1,50 @@
+/**
+ * @file dispatcher.h
+ * @brief Routes decoded packets to the matching server-side handler.
+ *
+ * Routing is a static table indexed by MessageType: each opcode has its
+ * handler, the accepted payload lengths, whether it needs a logged-in
+ * client, and counters (calls, bytes, rejected frames, handler time).
+ * Frames failing those checks are rejected before any handler runs.
+ */
+
+#ifndef DISPATCHER_H
+#define DISPATCHER_H
+
+#include "infrastructure/server_types.h"
+#include "system/protocol.h"
+
+/**
+ * @brief Checks the frame against the table, then calls the handler
+ * registered for `type`. Rejected frames get the opcode's failure reply,
+ * if it has one.
+ * @param cli The client that sent the packet.
+ * @param payload The received payload (may be NULL if len is 0).
+ * @param len Size of the payload.
+ */
+void dispatch_packet(Client *cli, MessageType type, void *payload, uint32_t len);
+
+/**
+ * @brief Runs the requests held back while the client's coroutine was
+ * waiting, in arrival order, until one suspends again.
+ */
+void dispatch_resume(Client *cli);
+
+/**
+ * @brief Whether `type` may run from TLS early data.
+ * Only opcodes whose repeated execution changes nothing qualify.
+ */
+int dispatch_is_replay_safe(MessageType type);
+
+/**
+ * @brief Whether `type` may appear in a MSG_BATCH_REQUEST: state-changing
+ * operations that do not return data.
+ */
+int dispatch_is_batchable(MessageType type);
+
+/**
+ * @brief Logs the per-opcode counters (sent SIGUSR1).
+ */
+void dispatch_log_stats(void);
+
+#endif
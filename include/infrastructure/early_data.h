@@ -0,0 +1,42 @@
+/**
+ * @file early_data.h
+ * @brief TLS 1.3 0-RTT: frames sent by a resuming client with its ClientHello.
+ *
+ * Early data can be replayed by an attacker, so it is opt-in (early_data=1),
+ * each ClientHello is accepted at most once within a replay window, and only
+ * replay-safe opcodes (see dispatch_is_replay_safe) are executed.
+ */
+
+#ifndef EARLY_DATA_H
+#define EARLY_DATA_H
+
+#include "infrastructure/server_types.h"
+#include <openssl/ssl.h>
+
+#define EARLY_DATA_DEFAULT_MAX 16384
+#define EARLY_DATA_REPLAY_WINDOW 10 /**< Seconds; older tickets are refused by age */
+
+/**
+ * @brief Allows up to `max_bytes` of early data on the context.
+ */
+void early_data_init(SSL_CTX *ctx, uint32_t max_bytes);
+
+/**
+ * @brief Reads any early data. Call instead of starting with SSL_accept();
+ * the handshake still has to be completed with SSL_accept() afterwards.
+ * On a nonblocking socket, call again when it is readable until done.
+ * @param buf Start with NULL: set to a malloc'd buffer (caller frees), left
+ * NULL if the client sent none.
+ * @param len Start with 0: bytes read so far.
+ * @return 1 when done, 0 to call again once the socket is ready (see
+ * SSL_want_write()), -1 if the connection must be dropped.
+ */
+int early_data_read(SSL *ssl, uint8_t **buf, uint32_t *len);
+
+/**
+ * @brief Dispatches the frames read by early_data_read(), once the client is registered.
+ * Frames with opcodes that are not replay-safe are dropped.
+ */
+void early_data_dispatch(Client *cli, const uint8_t *buf, uint32_t len);
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * @file executor.h
+ * @brief Sharded executor: per-key ordered work on a fixed set of threads.
+ *
+ * Work is submitted with a key (a conv_id, or a uid for user-scoped work)
+ * and always runs on the thread the key hashes to, in submission order.
+ * State owned by a key therefore needs no lock: one thread touches it, one
+ * task at a time, while other keys proceed in parallel on the other threads.
+ *
+ * Each thread has a lock-free inbox. Tasks may hand a completion back to the
+ * event loop (again lock-free, woken through an eventfd), which is where
+ * anything touching clients, membership or other loop state must happen.
+ */
+
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <stdint.h>
+#include "infrastructure/server_types.h"
+
+typedef void (*ExecutorFn)(void *arg);
+
+/**
+ * @brief Starts `threads` executors.
+ * @return The eventfd to watch for completions (see executor_complete()),
+ * or -1 when `threads` is 0: tasks then run inline on the caller.
+ */
+int executor_init(int threads);
+
+/**
+ * @brief Stops and joins the executors once their inboxes are empty, then
+ * runs the pending completions.
+ */
+void executor_shutdown(void);
+
+/**
+ * @brief Number of running executor threads (0: tasks run inline).
+ */
+int executor_threads(void);
+
+/**
+ * @brief Tasks submitted but not started yet, across all executors.
+ */
+int executor_backlog(void);
+
+/**
+ * @brief Queues `run(arg)` on the executor owning `key`, then `done(arg)` on
+ * the event loop. Either function may be NULL; `done` owns `arg`.
+ * @return 1 if queued (or run inline), 0 on allocation failure (nothing ran).
+ */
+int executor_submit(uint32_t key, ExecutorFn run, ExecutorFn done, void *arg);
+
+/**
+ * @brief Runs finished tasks' completions. Call on the event loop when the
+ * eventfd returned by executor_init() is readable.
+ */
+void executor_complete(void);
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * @file fanout.h
+ * @brief Delivery of one frame to a large audience, written by worker threads.
+ *
+ * The frame is serialized once and shared by every recipient's outbound
+ * queue (see outqueue.h). Queueing happens on the event loop, which keeps
+ * each client's frames in order; the writes (TLS encryption and socket
+ * sends) are split into shards of connections that the fan-out workers
+ * flush in parallel. Small audiences, or a server with no workers, are
+ * flushed inline.
+ *
+ * Each conversation keeps fan-out duration metrics, logged after every
+ * sharded delivery.
+ */
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include "infrastructure/server_types.h"
+
+typedef struct FanoutJob FanoutJob;
+
+/**
+ * @brief Starts the worker pool.
+ * @param workers Threads to start (0 flushes everything on the event loop).
+ * @param shard_size Connections per shard; audiences up to one shard are flushed inline.
+ */
+void fanout_init(int workers, int shard_size);
+
+/**
+ * @brief Changes the shard size for the next deliveries (event loop only).
+ */
+void fanout_set_shard(int shard_size);
+
+/**
+ * @brief Stops and joins the workers, after the queued shards are done.
+ */
+void fanout_shutdown(void);
+
+/**
+ * @brief Serializes the frame for a delivery to members of `conv_id`.
+ * @return NULL on allocation failure, or inside a batch (send per recipient
+ * with client_send() instead).
+ */
+FanoutJob *fanout_begin(uint32_t conv_id, MessageType type, const void *payload, uint32_t payload_len);
+
+/**
+ * @brief Queues the frame for `target` (nothing is written yet).
+ * @return 1 if queued, 0 if the client cannot take it.
+ */
+int fanout_add(FanoutJob *job, Client *target);
+
+/**
+ * @brief Writes the queued frames out, in shards on the workers, and
+ * records the duration. The job is freed when the last shard is done.
+ */
+void fanout_commit(FanoutJob *job);
+
+#endif
@@ -0,0 +1,66 @@
+/**
+ * @file handoff.h
+ * @brief Listener handoff between two server processes (graceful restart).
+ *
+ * On SIGUSR2 the running server opens the handoff socket and starts its
+ * successor: the binary at the same path, so a freshly deployed one. At
+ * startup the successor connects to that socket and receives the listening
+ * sockets (SCM_RIGHTS) instead of binding them. Both processes accept from
+ * the same kernel queues until the successor reports ready, so no
+ * connection is refused during the switch. The old process then stops
+ * accepting, asks its clients to reconnect and drains.
+ */
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+/**
+ * @brief A listening socket, as handed over.
+ */
+typedef struct
+{
+    int fd;
+    int tls; /**< 0 for plaintext listeners (local only) */
+    int tcp; /**< 0 for the unix socket */
+} Listener;
+
+// --- Successor side ---
+
+/**
+ * @brief Takes over the listeners of a server handing off on `path`.
+ * @return The number of listeners received, 0 if no server is handing off.
+ */
+int handoff_receive(const char *path, Listener *listeners, int max);
+
+/**
+ * @brief Tells the previous server to stop accepting. Call when the event
+ * loop is about to run.
+ */
+void handoff_ready(void);
+
+// --- Previous server side ---
+
+/**
+ * @brief Opens the handoff socket on `path` and starts the successor.
+ * @return The socket to watch (call handoff_send() when readable), -1 on failure.
+ */
+int handoff_begin(const char *path);
+
+/**
+ * @brief Sends the listeners to the successor that connected.
+ * @return The connection to watch (call handoff_poll() when readable), -1 on failure.
+ */
+int handoff_send(const Listener *listeners, int count);
+
+/**
+ * @brief Reads the successor's answer.
+ * @return 1 if it is ready, 0 if not yet, -1 if it failed (keep serving).
+ */
+int handoff_poll(void);
+
+/**
+ * @brief Closes the handoff sockets and removes the socket file.
+ */
+void handoff_end(void);
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * @file membership.h
+ * @brief In-memory member lists of conversations, as sorted uid vectors.
+ *
+ * A list is loaded from storage the first time a conversation is used,
+ * then updated in place by the handlers that change membership. Routing a
+ * message walks the vector directly, whatever the group size; membership
+ * tests are a binary search.
+ */
+
+#ifndef MEMBERSHIP_H
+#define MEMBERSHIP_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t *uids; /**< Ascending */
+    uint32_t count;
+    int type; /**< CONV_TYPE_* of the conversation */
+} MemberList;
+
+/**
+ * @brief Members of `conv_id`, loading them on first use.
+ * The list stays valid until the next membership change of that conversation.
+ * @return NULL if the conversation has no members (or does not exist).
+ */
+const MemberList *membership_get(uint32_t conv_id);
+
+int membership_contains(uint32_t conv_id, uint32_t uid);
+
+/**
+ * @brief Keep a loaded list in sync after storage_add_participant() /
+ * storage_remove_participant(). No-op if the list is not cached.
+ */
+void membership_add(uint32_t conv_id, uint32_t uid);
+void membership_remove(uint32_t conv_id, uint32_t uid);
+
+/**
+ * @brief Forgets a conversation (deleted).
+ */
+void membership_drop(uint32_t conv_id);
+
+#endif
@@ -0,0 +1,93 @@
+/**
+ * @file outqueue.h
+ * @brief Per-connection outbound queues of serialized, shared frames.
+ *
+ * A frame (header + payload) is serialized once and can sit in any number
+ * of queues; each queue holds a reference. Queues own their connection:
+ * the SSL handle and socket are released with the last reference, so a
+ * fan-out worker still writing to a client that just disconnected never
+ * touches a freed (or reused) connection.
+ *
+ * Appending never writes. outqueue_flush() writes whatever is pending,
+ * from whichever thread gets the connection first; the other callers
+ * return at once and the current writer picks their frames up. Sockets
+ * are nonblocking: when one is full the writer stops, EPOLLOUT is armed
+ * on it and the event loop resumes with outqueue_writable().
+ */
+
+#ifndef OUTQUEUE_H
+#define OUTQUEUE_H
+
+#include <stdint.h>
+#include "system/protocol.h"
+
+/** A queue holding more than this is a stalled reader: the connection gets shut down. */
+#define OUTQUEUE_MAX_BYTES (8u * 1024 * 1024)
+
+typedef struct OutFrame OutFrame;
+typedef struct OutQueue OutQueue;
+
+/**
+ * @brief Registers the event loop's epoll set, where full sockets get EPOLLOUT armed.
+ * Connections are registered in it under their fd.
+ */
+void outqueue_init(int epoll_fd);
+
+/**
+ * @brief Serializes one packet (wire header + payload). Starts with one reference.
+ */
+OutFrame *outframe_new(MessageType type, const void *payload, uint32_t payload_len);
+
+/**
+ * @brief Type and payload of a frame, as passed to outframe_new().
+ */
+MessageType outframe_type(const OutFrame *frame);
+const void *outframe_payload(const OutFrame *frame, uint32_t *len_out);
+
+void outframe_retain(OutFrame *frame);
+void outframe_release(OutFrame *frame);
+
+/**
+ * @brief Creates the queue of a connection and takes ownership of `t`
+ * (SSL_free and close happen on the last release). Starts with one reference.
+ */
+OutQueue *outqueue_new(Transport t);
+
+void outqueue_retain(OutQueue *q);
+void outqueue_release(OutQueue *q);
+
+/**
+ * @brief Drops pending frames and refuses new ones (the client is going away).
+ */
+void outqueue_close(OutQueue *q);
+
+/**
+ * @brief Appends a frame (taking a reference) without writing it.
+ * @return 1 if queued, -1 if the queue is closed or over OUTQUEUE_MAX_BYTES.
+ */
+int outqueue_push(OutQueue *q, OutFrame *frame);
+
+/**
+ * @brief Writes the pending frames, unless another thread is already doing so.
+ * Safe to call from any thread.
+ * @return 1 if the queue is healthy, -1 if it is closed (a write failed).
+ */
+int outqueue_flush(OutQueue *q);
+
+/**
+ * @brief EPOLLOUT handler: writes what the full socket held back.
+ */
+void outqueue_writable(OutQueue *q);
+
+/**
+ * @brief Takes the connection for reading on the event loop. Writers never
+ * block on the socket, so the wait is bounded.
+ */
+void outqueue_lock_io(OutQueue *q);
+
+/**
+ * @brief Gives the connection back, writing what was queued in the meantime.
+ */
+void outqueue_unlock_io(OutQueue *q);
+
+#endif
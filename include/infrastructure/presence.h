@@ -0,0 +1,34 @@
+/**
+ * @file presence.h
+ * @brief Tracks who is online and pushes changes to subscribed contacts.
+ *
+ * Offline transitions are delayed by PRESENCE_GRACE_MS (on the timer wheel,
+ * see timers.h): a user who reconnects within that window never appears
+ * offline to their contacts.
+ */
+
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include "infrastructure/server_types.h"
+
+#define PRESENCE_GRACE_MS 2000
+
+/**
+ * @brief Call after a successful login. Announces the user unless a pending
+ * offline event was cancelled (flap) or another connection was already online.
+ */
+void presence_on_login(Client *cli);
+
+/**
+ * @brief Call after the client has been removed from the client manager.
+ * Schedules an offline announcement if the user has no connection left.
+ */
+void presence_on_disconnect(uint32_t uid);
+
+/**
+ * @brief Overwrites `is_online` in each summary from the live client registry.
+ */
+void presence_fill(ContactSummary *contacts, int count);
+
+#endif
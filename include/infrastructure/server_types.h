@@ -8,17 +8,78 @@
 
 #include <stdint.h>
 #include "system/protocol.h"
+#include "infrastructure/timers.h"
 
 /**
- * @brief Represents a connected client on the server.
+ * @brief A request held back while the client's coroutine waits (see coroutine.h).
+ */
+typedef struct DeferredPacket
+{
+    MessageType type;
+    uint32_t len;
+    struct DeferredPacket *next;
+    uint8_t payload[]; /**< NUL-terminated, like recv_packet() payloads */
+} DeferredPacket;
+
+/**
+ * @brief Request classes with their own rate (see admission.h).
+ */
+typedef enum
+{
+    ADMIT_NONE = 0, /**< Not rate limited */
+    ADMIT_MESSAGE,  /**< Cheap writes: messages, acks, group and contact changes */
+    ADMIT_QUERY,    /**< Reads that rebuild lists or walk history; shed first */
+    ADMIT_AUTH,     /**< Password hashing and session setup */
+    ADMIT_TELEMETRY, /**< Telemetry samples, which have no per-channel limit by default */
+    ADMIT_CLASSES
+} AdmissionClass;
+
+/**
+ * @brief Per-connection token bucket of one admission class.
  */
 typedef struct
 {
-    int fd;         /**< File descriptor for the socket */
-    SSL *ssl;       /**< SSL connection handle */
+    double tokens;
+    int64_t refill_ms; /**< 0 until first use (the bucket starts full) */
+} TokenBucket;
+
+/**
+ * @brief Represents a connected client on the server.
+ */
+typedef struct Client
+{
+    int fd;         /**< File descriptor for the socket (synthetic and negative for gateway sessions) */
+    Transport transport; /**< TLS or plaintext connection (see protocol.h) */
+    struct OutQueue *out; /**< Outbound queue, owns the connection (NULL for gateway sessions) */
     uint32_t uid;   /**< Authenticated User ID (0 if guest) */
     char username[MAX_NAME_LEN];
     int is_online;  /**< Status flag */
+    int presence_subscribed; /**< 1 if the client wants MSG_PRESENCE_UPDATE pushes */
+    uint32_t gw_session; /**< Non-zero for a logical session carried by a gateway */
+    struct Client *gateway; /**< Connection carrying this session (when gw_session is set) */
+    int gw_sessions; /**< Logical sessions open on this connection, if it is a gateway */
+    struct TopicState *topics; /**< Topic subscriptions (see topics.h), NULL if none */
+    uint64_t conn_id; /**< Never reused, unlike fds (see ClientRef) */
+    struct Coroutine *co; /**< Handler coroutine in flight, NULL if none */
+    DeferredPacket *deferred; /**< Requests received meanwhile, oldest first */
+    DeferredPacket *deferred_tail;
+    int deferred_count;
+    TokenBucket buckets[ADMIT_CLASSES]; /**< Request budgets, indexed by AdmissionClass */
+    uint64_t last_rx;  /**< Tick of the last packet received (see timers_now()) */
+    uint8_t *rx;       /**< Bytes received but not yet a whole packet (direct connections only) */
+    uint32_t rx_len;
+    uint32_t rx_cap;
+    Timer heartbeat;   /**< Idle check and ping schedule (direct connections only) */
 } Client;
 
+/**
+ * @brief Names a client across asynchronous work (executor tasks): resolve it
+ * again with client_resolve() before use, the client may be gone.
+ */
+typedef struct
+{
+    int fd;
+    uint64_t conn_id;
+} ClientRef;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+/**
+ * @file session.h
+ * @brief Stateless session tokens for MSG_RESUME.
+ *
+ * A token carries the user's identity and an expiry, signed with a server
+ * secret. Verifying it costs one HMAC and one primary key lookup (the
+ * user's revocation time): no crypt().
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "system/protocol.h"
+
+/**
+ * @brief Sets the signing key and token lifetime.
+ * @param secret Configured session_key, may be empty.
+ * @param fallback Used to derive a key when `secret` is empty (the db_key),
+ * so tokens survive restarts without extra configuration.
+ */
+void session_init(const char *secret, const char *fallback, int ttl_seconds);
+
+/**
+ * @brief Changes the lifetime of tokens issued from now on, keeping the key
+ * (and so every token already issued).
+ */
+void session_set_ttl(int ttl_seconds);
+
+/**
+ * @brief Issues a fresh token for the given identity.
+ */
+void session_issue(const MyInfoPayload *me, SessionToken *out);
+
+/**
+ * @brief Checks signature, expiry and revocation.
+ * @return 1 if valid (identity copied to `me_out`), 0 otherwise.
+ */
+int session_verify(const SessionToken *token, MyInfoPayload *me_out);
+
+/**
+ * @brief Rejects every token issued to `uid` before now (e.g. after a password
+ * change). Stored in the database, so it holds across restarts.
+ */
+void session_revoke_user(uint32_t uid);
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * @file stream.h
+ * @brief Chunked responses (MSG_STREAM_BEGIN / CHUNK / END) with a bounded buffer.
+ *
+ * Large result sets are written row by row; the writer flushes a
+ * MSG_STREAM_CHUNK every time its STREAM_CHUNK_SIZE buffer fills up, so peak
+ * memory per response does not depend on the number of rows.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "infrastructure/server_types.h"
+#include "system/protocol.h"
+
+/**
+ * @brief State of one outgoing stream. Lives on the caller's stack.
+ */
+typedef struct
+{
+    Client *cli;
+    StreamHeader header;                 /**< Header of the next frame */
+    uint32_t used;                       /**< Bytes buffered in data */
+    int failed;                          /**< Set when a send fails; further writes are dropped */
+    uint8_t data[STREAM_CHUNK_SIZE];
+} ResponseStream;
+
+/**
+ * @brief Opens a stream and sends MSG_STREAM_BEGIN.
+ * @param inner_type The response type being streamed (e.g. MSG_RESP_HISTORY).
+ */
+void stream_begin(ResponseStream *s, Client *cli, MessageType inner_type);
+
+/**
+ * @brief Buffers a record, flushing a chunk first if it would not fit.
+ * Records up to STREAM_CHUNK_SIZE bytes are never split across chunks.
+ * @return 1 on success, 0 if the stream has failed.
+ */
+int stream_write(ResponseStream *s, const void *data, uint32_t len);
+
+/**
+ * @brief Flushes the remaining data and sends MSG_STREAM_END.
+ */
+void stream_end(ResponseStream *s);
+
+/**
+ * @brief StorageRowCallback adapter: writes `row_size` bytes of each row.
+ * Pass a StreamRowSink as ctx.
+ */
+typedef struct
+{
+    ResponseStream *stream;
+    uint32_t row_size; /**< 0 for NUL-terminated string rows */
+} StreamRowSink;
+
+int stream_row(const void *row, void *ctx);
+
+/**
+ * @brief Growable buffer of fixed-size rows, for unsolicited refreshes that
+ * must stay a single frame (so batches can coalesce them).
+ */
+typedef struct
+{
+    uint8_t *data;
+    uint32_t used;     /**< Bytes filled */
+    uint32_t cap;
+    uint32_t row_size;
+} RowBuffer;
+
+/**
+ * @brief StorageRowCallback adapter: appends `row_size` bytes of each row.
+ * Pass a RowBuffer (zeroed, with row_size set) as ctx.
+ */
+int row_buffer_add(const void *row, void *ctx);
+void row_buffer_free(RowBuffer *b);
+
+#endif
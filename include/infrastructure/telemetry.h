@@ -0,0 +1,71 @@
+/**
+ * @file telemetry.h
+ * @brief Ring-buffer storage for CONV_TYPE_TELEMETRY conversations.
+ *
+ * Each channel is one fixed-size file of TelemetryRecord slots, memory-mapped
+ * and written in place. Samples are not encrypted and never touch SQLite, so
+ * ingest costs a copy into the page cache. When the ring is full, the oldest
+ * samples are overwritten. Timestamps never decrease within a channel, so
+ * time-range reads use a binary search.
+ *
+ * A channel is owned by the executor of its conv_id (see executor.h):
+ * append, read, configure and drop run there, so channels need no lock and
+ * different channels ingest in parallel. telemetry_can_access() is the only
+ * call made on the event loop.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "system/storage.h"
+
+/**
+ * @brief Sets the ring directory (created if missing) and the limits used by
+ * channels without their own.
+ */
+void telemetry_init(const char *dir, uint32_t default_rate, uint32_t default_retention);
+
+/**
+ * @brief Changes the defaults applied to channels opened from now on.
+ */
+void telemetry_set_defaults(uint32_t default_rate, uint32_t default_retention);
+
+/**
+ * @brief Whether `uid` is a participant of telemetry channel `conv_id`.
+ * Event loop only (reads the membership cache).
+ */
+int telemetry_can_access(uint32_t conv_id, uint32_t uid);
+
+/**
+ * @brief Appends one sample, subject to the channel's rate limit.
+ * @return 1 if stored, 0 if dropped by the rate limit, -1 on error.
+ */
+int telemetry_append(uint32_t conv_id, uint32_t sender_uid, const void *data, uint16_t len);
+
+/**
+ * @brief Visits the stored samples (TelemetryRecord rows) with
+ * from_ms <= timestamp <= to_ms, oldest first.
+ * @param max_count Stop after this many rows (0 = no limit).
+ * @return Number of rows visited.
+ */
+int telemetry_each(uint32_t conv_id, int64_t from_ms, int64_t to_ms, uint32_t max_count,
+                   StorageRowCallback cb, void *ctx);
+
+/**
+ * @brief Applies limits already saved with storage_set_telemetry_limits().
+ * A retention change resizes the ring and keeps the newest samples.
+ */
+int telemetry_configure(uint32_t conv_id, uint32_t max_rate, uint32_t retention);
+
+/**
+ * @brief Closes the channel and deletes its ring file (conversation deleted).
+ */
+void telemetry_drop(uint32_t conv_id);
+
+/**
+ * @brief Unmaps every open channel. Call at shutdown.
+ */
+void telemetry_close_all(void);
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * @file timers.h
+ * @brief Hierarchical timer wheel driven by a timerfd in the epoll set.
+ *
+ * Timers are intrusive (embedded in the object they belong to), so arming
+ * and cancelling never allocate, and both are O(1) whatever the number of
+ * timers. Far deadlines sit in coarser levels and move down as they come
+ * closer: each timer is touched at most once per level.
+ *
+ * Resolution is TIMER_TICK_MS. Everything runs on the event loop.
+ */
+
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include <stdint.h>
+
+#define TIMER_TICK_MS 100
+
+typedef void (*TimerFn)(void *arg);
+
+typedef struct Timer
+{
+    struct Timer *next;
+    struct Timer **pprev; /**< NULL when not armed */
+    uint64_t expires;     /**< Tick */
+    TimerFn fn;
+    void *arg;
+} Timer;
+
+/**
+ * @brief Creates the tick source.
+ * @return The timerfd to watch (call timers_run() when readable), -1 on failure.
+ */
+int timers_init(void);
+
+/**
+ * @brief Advances the wheel by the ticks elapsed and runs the expired timers.
+ */
+void timers_run(void);
+
+/**
+ * @brief Ticks since timers_init(), for cheap activity timestamps.
+ */
+uint64_t timers_now(void);
+
+/**
+ * @brief Prepares a timer (a zeroed Timer is also valid, and disarmed).
+ */
+void timer_init(Timer *t, TimerFn fn, void *arg);
+
+/**
+ * @brief (Re)arms `t` to fire once in `ms` milliseconds, rounded up to a tick.
+ */
+void timer_arm(Timer *t, uint32_t ms);
+
+/**
+ * @brief Disarms `t`. Does nothing if it is not armed.
+ */
+void timer_cancel(Timer *t);
+
+#endif
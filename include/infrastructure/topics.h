@@ -0,0 +1,64 @@
+/**
+ * @file topics.h
+ * @brief Publish/subscribe over hierarchical topic names.
+ *
+ * Filters and retained values share one trie keyed by topic level. A
+ * publish walks only the branches that can match (the literal level, '+'
+ * and '#'), so its cost grows with the number of matches rather than the
+ * number of subscriptions.
+ *
+ * Every topic belongs to a namespace picked by its first levels (the roots
+ * are configurable, an empty root turns its namespace off):
+ *   user/<uid>/...      only that user
+ *   conv/<conv_id>/...  participants of that conversation
+ *   <public_root>/...   every authenticated client (off by default)
+ * Filters must name their namespace literally ("user/+/#" and "#" are
+ * refused). Access is checked on subscribe and publish, and again on each
+ * delivery. Retained values are capped in count and bytes across all topics.
+ */
+
+#ifndef TOPICS_H
+#define TOPICS_H
+
+#include "infrastructure/server_types.h"
+#include "system/protocol.h"
+#include "system/config_loader.h"
+
+/** Filters one client may hold at once. */
+#define TOPIC_MAX_SUBSCRIPTIONS 256
+
+/**
+ * @brief Applies the namespace roots and retained caps of `config`. May be
+ * called again with the same roots (the trie was authorized under them);
+ * values already retained stay even if over a lowered cap.
+ */
+void topics_init(const AppConfig *config);
+
+/**
+ * @brief Adds a filter for `cli` and pushes the retained values it matches.
+ * @return 1 on success, 0 if the filter is invalid or outside the client's
+ * namespaces, or the client is at its limit.
+ */
+int topics_subscribe(Client *cli, const char *filter);
+
+/**
+ * @brief Removes one filter of `cli`.
+ * @return 1 if it was subscribed.
+ */
+int topics_unsubscribe(Client *cli, const char *filter);
+
+/**
+ * @brief Delivers a message to every matching subscriber (once per client),
+ * and stores or clears the retained value if `retain` is set. A value over
+ * the retained caps is delivered but not kept.
+ * @return Number of clients reached, -1 if the topic name is invalid or the
+ * sender may not publish to it.
+ */
+int topics_publish(Client *sender, const char *topic, const void *data, uint16_t len, int retain);
+
+/**
+ * @brief Drops all filters of a client. Call when it disconnects.
+ */
+void topics_release(Client *cli);
+
+#endif
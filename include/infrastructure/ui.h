@@ -55,6 +55,12 @@ void ui_draw_settings(const MyInfoPayload *info);
 void ui_draw_group_settings(ConversationSummary *conv);
 void ui_draw_group_members(GroupMemberSummary *members, int count, int selection_idx, int is_admin);
 
+/**
+ * @brief Sets the link status shown in the chat header (empty to hide it).
+ * @param alarm 1 to highlight it (link stalled).
+ */
+void ui_set_link_status(const char *status, int alarm);
+
 // --- Helpers ---
 void ui_prompt_friend_code(char *code_out);
 void ui_input_string(int y, int x, const char* label, char *buffer, int max_len);
@@ -24,6 +24,27 @@ int service_register(const char *email, const char *username, const char *passwo
  */
 int service_login(const char *email, const char *password);
 
+/**
+ * @brief Logs in with a saved session token instead of the password.
+ * Same blocking flow and result as service_login().
+ */
+int service_resume(const SessionToken *token);
+
+/**
+ * @brief Writes MSG_RESUME and MSG_REQ_BOOTSTRAP as TLS 1.3 early data.
+ * Call after offering a saved TLS session and before SSL_connect().
+ * If the server accepts the early data, finish with service_await_login();
+ * otherwise fall back to service_resume().
+ * @return 1 if the frames were written as early data.
+ */
+int service_resume_early(const SessionToken *token);
+
+/**
+ * @brief Waits for the answer to a login or resume that was already sent.
+ * @return 1 if login succeeded, 0 otherwise.
+ */
+int service_await_login(void);
+
 /**
  * @brief Clears the session file.
  */
@@ -0,0 +1,40 @@
+/**
+ * @file batch_service.h
+ * @brief Client-side service for grouping several requests into one MSG_BATCH_REQUEST frame.
+ */
+
+#ifndef BATCH_SERVICE_H
+#define BATCH_SERVICE_H
+
+#include "system/protocol.h"
+
+/**
+ * @brief Accumulates sub-frames until service_batch_send() is called.
+ */
+typedef struct BatchBuilder
+{
+    uint8_t *buf;   /**< Concatenated sub-frames */
+    uint32_t len;
+    int count;
+} BatchBuilder;
+
+void service_batch_init(BatchBuilder *b);
+
+/**
+ * @brief Appends a request to the batch.
+ * @return 1 on success, 0 if the batch is full or allocation failed.
+ */
+int service_batch_add(BatchBuilder *b, MessageType type, const void *payload, uint32_t len);
+
+/**
+ * @brief Sends the batch (if not empty) and releases its buffer.
+ * The server answers with MSG_BATCH_RESULT.
+ */
+void service_batch_send(BatchBuilder *b);
+
+/**
+ * @brief Accepts every pending friend request in a single round trip.
+ */
+void service_accept_all_requests(void);
+
+#endif
@@ -18,4 +18,9 @@ void service_send_text(uint32_t conv_id, const char *text);
  */
 void service_req_history(uint32_t conv_id);
 
+/**
+ * @brief Confirms receipt of offline messages up to and including `last_message_id`.
+ */
+void service_ack_offline(uint32_t last_message_id);
+
 #endif
\ No newline at end of file
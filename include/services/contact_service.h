@@ -11,6 +11,11 @@
 void service_refresh_contacts(void);
 void service_refresh_requests(void);
 
+/**
+ * @brief Asks the server to push MSG_PRESENCE_UPDATE when a contact comes online or leaves.
+ */
+void service_subscribe_presence(void);
+
 /**
  * @brief Sends a friend request using a friend code.
  */
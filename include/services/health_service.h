@@ -0,0 +1,34 @@
+/**
+ * @file health_service.h
+ * @brief Client-side link health: round-trip time and jitter measured with MSG_PING.
+ *
+ * The server answers MSG_PING from its event loop, so a high RTT with low
+ * jitter points at a slow link, while spikes that come and go usually mean
+ * the server was busy.
+ */
+
+#ifndef HEALTH_SERVICE_H
+#define HEALTH_SERVICE_H
+
+#include "system/protocol.h"
+
+#define HEALTH_PROBE_MS 2000   /**< Probe period */
+#define HEALTH_STALL_PROBES 3  /**< Unanswered probes before the link is shown as stalled */
+
+/**
+ * @brief Sends a probe when one is due and refreshes the chat header status.
+ * Call from the UI loop (at least every HEALTH_PROBE_MS).
+ */
+void service_health_tick(void);
+
+/**
+ * @brief Records the round trip of one of our probes. Call on MSG_PONG.
+ */
+void service_health_on_pong(const PingPayload *pong);
+
+/**
+ * @brief Logs the session summary: RTT percentiles, jitter and lost probes.
+ */
+void service_health_report(void);
+
+#endif
@@ -9,6 +9,41 @@
 #define DEFAULT_PORT 8080
 #define DEFAULT_HOST "localhost"
 #define DEFAULT_DB_PATH "data/messagerie.db"
+#define DEFAULT_SESSION_TTL (7 * 24 * 3600)
+#define DEFAULT_TICKET_ROTATION 3600
+#define DEFAULT_GATEWAY_SESSIONS 8192
+#define DEFAULT_TELEMETRY_RATE 1000
+#define DEFAULT_TELEMETRY_RETENTION 65536
+#define DEFAULT_TOPIC_USER_ROOT "user"
+#define DEFAULT_TOPIC_CONV_ROOT "conv"
+#define DEFAULT_TOPIC_RETAINED_MAX 10000
+#define DEFAULT_TOPIC_RETAINED_KB 16384
+#define DEFAULT_FANOUT_WORKERS 4
+#define DEFAULT_FANOUT_SHARD 1024
+#define DEFAULT_EXECUTOR_THREADS 2
+#define DEFAULT_RATE_MESSAGES 50
+#define DEFAULT_BURST_MESSAGES 100
+#define DEFAULT_RATE_QUERIES 10
+#define DEFAULT_BURST_QUERIES 40
+#define DEFAULT_RATE_AUTH 2
+#define DEFAULT_BURST_AUTH 5
+#define DEFAULT_RATE_TELEMETRY 1000
+#define DEFAULT_BURST_TELEMETRY 2000
+#define DEFAULT_OVERLOAD_LAG_MS 100
+#define DEFAULT_OVERLOAD_BACKLOG 1024
+#define DEFAULT_HANDSHAKE_TIMEOUT 10
+#define DEFAULT_HEARTBEAT_INTERVAL 30
+#define DEFAULT_IDLE_TIMEOUT 90
+#define DEFAULT_LISTEN_BACKLOG 1024
+#define DEFAULT_MAX_CONNECTIONS 10000
+#define DEFAULT_MAX_CONNECTIONS_PER_IP 64
+#define DEFAULT_TCP_KEEPALIVE 60
+#define DEFAULT_DRAIN_TIMEOUT 30
+#define DEFAULT_RECONNECT_SPREAD 10
+#define DEFAULT_LOG_LEVEL "debug"
+#define DEFAULT_DB_SYNCHRONOUS "full"
+#define DEFAULT_DB_CACHE_KB 8192
+#define DEFAULT_DB_MAINTENANCE 300
 
 typedef struct {
     // Shared
@@ -23,6 +58,53 @@ typedef struct {
     char server_cert_path[512];
     char server_key_path[512];
 		char db_encryption_key[256];
+    char session_key[256];  // Optional: derived from db_key when empty
+    int session_ttl;        // Session token lifetime in seconds
+    char ticket_key[256];   // Optional: TLS ticket master secret
+    int ticket_rotation;    // TLS ticket key period in seconds
+    int early_data;         // 1 to accept TLS 1.3 0-RTT data
+    int early_data_max;     // Max early data bytes per connection
+    int ktls;               // 1 to offload record crypto to the kernel
+    int plain_port;         // Optional plaintext listener on 127.0.0.1 (0 = off)
+    char unix_socket[108];  // Optional plaintext Unix domain socket path
+    int gateway;            // 1 to let connections multiplex device sessions
+    int gateway_max_sessions; // Logical sessions per gateway connection
+    int telemetry_rate;     // Default samples/s per telemetry channel (0 = unlimited)
+    int telemetry_retention; // Default samples kept per telemetry channel
+    char topic_user_root[32];   // Topics <root>/<uid>/... belong to that user (empty = off)
+    char topic_conv_root[32];   // Topics <root>/<conv_id>/... belong to its participants (empty = off)
+    char topic_public_root[32]; // Topics <root>/... open to every client (empty = off)
+    int topic_retained_max; // Retained topic values kept server-wide (0 = unlimited)
+    int topic_retained_kb;  // Bytes of retained values server-wide, in KiB (0 = unlimited)
+    int fanout_workers;     // Threads writing large deliveries (0 = event loop only)
+    int fanout_shard;       // Connections per fan-out shard
+    int executor_threads;   // Per-conversation executor threads (0 = event loop only)
+    int rate_messages;      // Messages/s per connection (0 = unlimited)
+    int burst_messages;
+    int rate_queries;       // History and list requests/s per connection (0 = unlimited)
+    int burst_queries;
+    int rate_auth;          // Register/login/resume attempts/s per connection (0 = unlimited)
+    int burst_auth;
+    int rate_telemetry;     // Telemetry samples/s per connection (0 = unlimited)
+    int burst_telemetry;
+    int overload_lag_ms;    // Loop iteration time that starts shedding (0 = off)
+    int overload_backlog;   // Executor backlog that starts shedding (0 = off)
+    int handshake_timeout;  // Seconds to complete the TLS handshake
+    int heartbeat_interval; // Seconds of silence before the server pings (0 = no pings)
+    int idle_timeout;       // Seconds of silence before a connection is dropped (0 = never)
+    int listen_backlog;     // Pending connections queued by the kernel (capped by somaxconn)
+    int max_connections;    // Open connections, handshakes included (0 = unlimited)
+    int max_connections_per_ip; // Per remote address; loopback and unix exempt (0 = unlimited)
+    int tcp_keepalive;      // Idle seconds before TCP keepalive probes (0 = off)
+    char handoff_socket[108]; // Optional: Unix socket the listeners are handed over on (SIGUSR2)
+    int drain_timeout;      // Seconds the old process serves its clients after a handoff
+    int reconnect_spread;   // Seconds over which clients are told to reconnect
+    char log_level[16];     // debug, info, warn or error
+    int db_wal;             // 1 for write-ahead logging (readers never block the writer)
+    char db_synchronous[16]; // full or normal (normal: WAL commits skip the fsync)
+    int db_cache_kb;        // Page cache per connection, in KiB
+    int db_mmap_mb;         // Database bytes read through mmap, in MiB (0 = off)
+    int db_maintenance;     // Seconds between statistics and vacuum runs (0 = no maintenance thread)
 } AppConfig;
 
 /**
@@ -47,6 +129,11 @@ int config_save_client(const char *path, const AppConfig *config);
  */
 void config_get_client_path(char *buffer, size_t size);
 
+/**
+ * @brief Builds the path of a file in the client directory (~/.mot/<name>).
+ */
+void config_get_client_file(const char *name, char *buffer, size_t size);
+
 void apply_defaults(AppConfig *config);
 
 #endif
\ No newline at end of file
@@ -27,6 +27,17 @@ void log_init(const char *basename);
  */
 void log_close(void);
 
+/**
+ * @brief Drops messages below `min` (LOG_DEBUG, the default, keeps everything).
+ */
+void log_set_level(LogLevel min);
+
+/**
+ * @brief Parses "debug", "info", "warn" or "error".
+ * @return 1 if `name` is a level (stored in `out`), 0 otherwise.
+ */
+int log_level_from_name(const char *name, LogLevel *out);
+
 /**
  * @brief Changes the log filename (e.g., after user login to include UID).
  */
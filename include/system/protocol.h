@@ -26,14 +26,20 @@
 #define FRIEND_CODE_LEN 7
 
 // Logic Limits
-#define MAX_PARTICIPANTS 10
-#define MAX_MEMBERS 50
+#define MAX_PARTICIPANTS 10 /**< uids in the fixed part of CreateConvPayload (groups can be larger) */
+#define MAX_CREATE_PARTICIPANTS 4096 /**< uids one extended CreateConvPayload may carry */
+#define MAX_BATCH_OPS 64
+#define MAX_FRAME_LEN (1024 * 1024) /**< Largest payload either side accepts; longer frames close the connection */
 
 // Types & Roles
 #define CONV_TYPE_PRIVATE 0
 #define CONV_TYPE_GROUP 1
+#define CONV_TYPE_TELEMETRY 2
+#define CONV_TYPE_BROADCAST 3 /**< Only admins post; members are not queued offline */
 #define ROLE_MEMBER 0
 #define ROLE_ADMIN 1
+#define CONV_EVENT_CHANGED 0 /**< Added or changed: insert or update the entry */
+#define CONV_EVENT_REMOVED 1 /**< Deleted, or the client was removed from it */
 
 /**
  * @brief Enumeration of all supported message types.
@@ -48,12 +54,12 @@ typedef enum Protocol
     MSG_REGISTER_SUCCESS,   /**< Response: Empty */
     MSG_REGISTER_FAIL,      /**< Response: Empty */
     MSG_LOGIN,              /**< Request: LoginPayload */
-    MSG_LOGIN_SUCCESS,      /**< Response: MyInfoPayload */
+    MSG_LOGIN_SUCCESS,      /**< Response: LoginSuccessPayload */
     MSG_LOGIN_FAIL,         /**< Response: Empty */
 
     // --- User Profile ---
     MSG_UPDATE_USER,        /**< Request: UpdateUserPayload */
-    MSG_UPDATE_SUCCESS,     /**< Response: Empty */
+    MSG_UPDATE_SUCCESS,     /**< Response: SessionToken (replaces the previous one) */
     MSG_UPDATE_FAIL,        /**< Response: Empty */
 
     // --- Contacts ---
@@ -78,7 +84,7 @@ typedef enum Protocol
     MSG_ADD_MEMBER = 24,    /**< Request: AddMemberPayload */
     MSG_MEMBER_ADDED,       /**< Response: Empty */
     MSG_REQ_MEMBERS,        /**< Request: ReqMembersPayload */
-    MSG_RESP_MEMBERS,       /**< Response: Array of GroupMemberSummary */
+    MSG_RESP_MEMBERS,       /**< Response: Array of GroupMemberSummary, in uid order */
     MSG_KICK_MEMBER,        /**< Request: KickMemberPayload */
     MSG_DELETE_GROUP,       /**< Request: DeleteGroupPayload */
 
@@ -88,6 +94,59 @@ typedef enum Protocol
     MSG_REQ_HISTORY,        /**< Request: RequestHistoryPayload */
     MSG_RESP_HISTORY,       /**< Response: Raw char string (history) */
 
+    // --- Batching ---
+    MSG_BATCH_REQUEST,      /**< Request: Concatenated sub-frames (Header + Payload each) */
+    MSG_BATCH_RESULT,       /**< Response: Array of BatchResultEntry */
+
+    // --- Streaming ---
+    MSG_STREAM_BEGIN,       /**< Response: StreamHeader (inner_type announces the streamed response) */
+    MSG_STREAM_CHUNK,       /**< Response: StreamHeader + up to STREAM_CHUNK_SIZE bytes */
+    MSG_STREAM_END,         /**< Response: StreamHeader (seq = number of chunks sent) */
+
+    // --- Presence ---
+    MSG_PRESENCE_SUBSCRIBE, /**< Request: Empty */
+    MSG_PRESENCE_UPDATE,    /**< Async Push: PresencePayload */
+
+    // --- Offline Delivery ---
+    MSG_OFFLINE_MESSAGES,   /**< Async Push (streamed): Array of OfflineMessage, one page. Acking it sends the next */
+    MSG_OFFLINE_ACK,        /**< Request: OfflineAckPayload */
+
+    // --- Login Bootstrap ---
+    MSG_REQ_BOOTSTRAP,      /**< Request: BootstrapRequestPayload (may be pipelined after MSG_LOGIN) */
+    MSG_BOOTSTRAP,          /**< Response (streamed): BootstrapHeader + lists */
+
+    // --- Session Resume ---
+    MSG_RESUME,             /**< Request: SessionToken. Answered like MSG_LOGIN */
+
+    // --- Gateway Multiplexing ---
+    MSG_GW_FRAME,           /**< Both ways: GatewayFrameHeader + inner payload, for one logical session */
+    MSG_GW_CLOSE,           /**< Both ways: GatewayFrameHeader (inner_type 0). Ends a logical session */
+
+    // --- Telemetry Channels ---
+    MSG_TELEMETRY_PUSH,     /**< Request: TelemetryPushPayload (6 + len bytes). No reply */
+    MSG_TELEMETRY_CONFIG,   /**< Request: TelemetryConfigPayload (admin only) */
+    MSG_REQ_TELEMETRY,      /**< Request: TelemetryQueryPayload */
+    MSG_RESP_TELEMETRY,     /**< Response (streamed): Array of TelemetryRecord, oldest first */
+
+    // --- Topics (Publish / Subscribe) ---
+    MSG_SUBSCRIBE,          /**< Request: TopicFilterPayload. Retained values are pushed right away */
+    MSG_UNSUBSCRIBE,        /**< Request: TopicFilterPayload */
+    MSG_PUBLISH,            /**< Request: PublishPayload (header + len bytes). No reply */
+    MSG_TOPIC_MESSAGE,      /**< Async Push: TopicMessage (header + len bytes) */
+
+    // --- Admission Control ---
+    MSG_RETRY_AFTER,        /**< Response: RetryAfterPayload. The request was not run */
+
+    // --- Heartbeat ---
+    MSG_PING,               /**< Both ways: PingPayload. Answered with MSG_PONG */
+    MSG_PONG,               /**< Both ways: the PingPayload of the MSG_PING, echoed */
+
+    // --- Graceful Restart ---
+    MSG_RECONNECT,          /**< Server -> Client: ReconnectPayload. The server is being replaced */
+
+    // --- Conversation Updates ---
+    MSG_CONV_UPDATED,       /**< Async Push: ConvUpdatePayload. One conversation added, changed or removed */
+
     MSG_DISCONNECT          /**< Internal/Signal: Connection closed */
 } MessageType;
 
@@ -157,6 +216,8 @@ typedef struct __attribute__((packed))
     char name[32];
     char description[MAX_DESC_LEN];
     uint32_t participants_count;
+    /** Groups larger than MAX_PARTICIPANTS send the payload extended to
+     *  offsetof(CreateConvPayload, participant_uids) + 4 * participants_count bytes. */
     uint32_t participant_uids[MAX_PARTICIPANTS];
 } CreateConvPayload;
 
@@ -170,6 +231,18 @@ typedef struct __attribute__((packed))
     uint8_t my_role; /**< ROLE_MEMBER or ROLE_ADMIN */
 } ConversationSummary;
 
+/**
+ * @brief Pushed to members when a conversation changes, instead of their
+ * whole list. For a conversation the client already lists, only type, name
+ * and description apply: its unread_count and my_role stay (roles are set on
+ * joining). Only conv_id is set in a CONV_EVENT_REMOVED.
+ */
+typedef struct __attribute__((packed))
+{
+    uint8_t event; /**< CONV_EVENT_* */
+    ConversationSummary conv;
+} ConvUpdatePayload;
+
 // 5. Messaging
 typedef struct __attribute__((packed))
 {
@@ -205,6 +278,8 @@ typedef struct __attribute__((packed))
 
 typedef struct __attribute__((packed)) {
     uint32_t conv_id;
+    uint32_t after_uid; /**< Page start: members with a greater uid (0 = first page) */
+    uint32_t limit;     /**< Page size (0 = all remaining) */
 } ReqMembersPayload;
 
 typedef struct __attribute__((packed)) {
@@ -222,8 +297,198 @@ typedef struct __attribute__((packed)) {
     uint32_t conv_id;
 } DeleteGroupPayload;
 
+// 6. Batching
+typedef struct __attribute__((packed)) {
+    uint32_t request_type; /**< MessageType of the sub-frame */
+    uint32_t reply_type;   /**< MessageType of the reply it produced, 0 if none/rejected */
+} BatchResultEntry;
+
+// 7. Streaming
+typedef struct __attribute__((packed)) {
+    uint32_t stream_id;  /**< Identifies the stream among interleaved ones */
+    uint32_t seq;        /**< Chunk sequence number, starting at 0 */
+    uint32_t inner_type; /**< MessageType whose payload is being streamed */
+} StreamHeader;
+
+/** Maximum data bytes carried by a single MSG_STREAM_CHUNK. */
+#define STREAM_CHUNK_SIZE (BUFFER_SIZE - sizeof(StreamHeader))
+
+// 8. Presence
+typedef struct __attribute__((packed)) {
+    uint32_t uid;
+    uint8_t is_online;
+} PresencePayload;
+
+// 9. Offline Delivery
+typedef struct __attribute__((packed)) {
+    uint32_t message_id;
+    uint32_t conv_id;
+    uint32_t sender_uid;
+    char sender_username[MAX_NAME_LEN];
+    int64_t timestamp;
+    char text[MAX_TEXT_LEN];
+} OfflineMessage;
+
+typedef struct __attribute__((packed)) {
+    uint32_t last_message_id; /**< Highest message_id the client has processed */
+} OfflineAckPayload;
+
+// 10. Login Bootstrap
+typedef struct __attribute__((packed)) {
+    uint64_t known_version; /**< Version the client already holds, 0 if none */
+} BootstrapRequestPayload;
+
+/**
+ * @brief Start of a MSG_BOOTSTRAP payload. Followed by
+ * ContactSummary[contacts_count], ContactSummary[requests_count] and
+ * ConversationSummary[conv_count]. When `unchanged` is set all counts are 0
+ * and the client keeps the lists it has.
+ */
+typedef struct __attribute__((packed)) {
+    uint64_t version;
+    uint8_t unchanged;
+    MyInfoPayload me;
+    uint32_t contacts_count;
+    uint32_t requests_count;
+    uint32_t conv_count;
+} BootstrapHeader;
+
+// 11. Sessions
+#define SESSION_MAC_LEN 32
+
+/**
+ * @brief Signed proof of a past login, opaque to the client.
+ * Presented with MSG_RESUME instead of the password.
+ */
+typedef struct __attribute__((packed)) {
+    MyInfoPayload me;
+    int64_t issued_at_ms; /**< Unix time in milliseconds */
+    int64_t expires_at;   /**< Unix time in seconds */
+    uint8_t mac[SESSION_MAC_LEN]; /**< HMAC-SHA256 over the fields above */
+} SessionToken;
+
+typedef struct __attribute__((packed)) {
+    MyInfoPayload me;
+    SessionToken token;
+} LoginSuccessPayload;
+
+// 12. Gateway Multiplexing
+/**
+ * @brief Prefix of MSG_GW_FRAME / MSG_GW_CLOSE. A gateway connection carries
+ * the traffic of many devices; `session_id` (chosen by the gateway, non-zero)
+ * tells them apart. The inner frame is a regular packet of `inner_type`.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t session_id;
+    uint32_t inner_type;
+} GatewayFrameHeader;
+
+// 13. Telemetry Channels
+/** Maximum bytes in one sample (a TelemetryRecord is 256 bytes). */
+#define TELEMETRY_SAMPLE_MAX 242
+
+/**
+ * @brief One binary sample for a CONV_TYPE_TELEMETRY conversation.
+ * Only the first 6 + len bytes need to be sent.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t conv_id;
+    uint16_t len;
+    uint8_t data[TELEMETRY_SAMPLE_MAX];
+} TelemetryPushPayload;
+
+typedef struct __attribute__((packed)) {
+    int64_t timestamp_ms; /**< Server receive time, Unix milliseconds */
+    uint32_t sender_uid;
+    uint16_t len;
+    uint8_t data[TELEMETRY_SAMPLE_MAX];
+} TelemetryRecord;
+
+typedef struct __attribute__((packed)) {
+    uint32_t conv_id;
+    uint32_t max_rate;  /**< Samples per second accepted (0 = unlimited) */
+    uint32_t retention; /**< Samples kept on disk (0 = server default) */
+} TelemetryConfigPayload;
+
+typedef struct __attribute__((packed)) {
+    uint32_t conv_id;
+    int64_t from_ms;    /**< Inclusive */
+    int64_t to_ms;      /**< Inclusive, 0 = now */
+    uint32_t max_count; /**< 0 = the server maximum (65536 rows), which also caps larger values */
+} TelemetryQueryPayload;
+
+// 14. Topics
+/**
+ * Topic names are '/'-separated levels (e.g. "site/3/floor/2/temp").
+ * Subscription filters may use '+' for exactly one level and a final '#'
+ * for any number of levels (including none).
+ */
+#define TOPIC_MAX_LEN 128
+#define TOPIC_MAX_DEPTH 32
+#define TOPIC_PAYLOAD_MAX 512
+
+typedef struct __attribute__((packed)) {
+    char filter[TOPIC_MAX_LEN];
+} TopicFilterPayload;
+
+/**
+ * @brief Only the first offsetof(PublishPayload, data) + len bytes need to be sent.
+ * With `retain` set, the value is kept for future subscribers (len 0 clears it).
+ */
+typedef struct __attribute__((packed)) {
+    char topic[TOPIC_MAX_LEN];
+    uint8_t retain;
+    uint16_t len;
+    uint8_t data[TOPIC_PAYLOAD_MAX];
+} PublishPayload;
+
+typedef struct __attribute__((packed)) {
+    char topic[TOPIC_MAX_LEN];
+    uint32_t sender_uid;
+    uint8_t retained; /**< 1 when replayed on subscribe */
+    uint16_t len;
+    uint8_t data[TOPIC_PAYLOAD_MAX];
+} TopicMessage;
+
+// 15. Admission Control
+/**
+ * @brief Sent instead of the reply when a request is over the connection's
+ * rate, or shed while the server is overloaded. Resend after `retry_ms`.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t request_type; /**< MessageType of the refused request */
+    uint32_t retry_ms;
+} RetryAfterPayload;
+
+// 16. Heartbeat
+/**
+ * @brief The server pings connections that have been silent for a while and
+ * drops those that stay silent (see idle_timeout); answering keeps them open.
+ */
+typedef struct __attribute__((packed)) {
+    uint64_t stamp; /**< Chosen by the sender, echoed as is */
+} PingPayload;
+
+// 17. Graceful Restart
+/**
+ * @brief Sent to every connection when a new server process has taken over
+ * the listeners. The connection is closed after the drain period; delays are
+ * spread so that clients come back gradually.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t delay_ms; /**< Wait this long, then reconnect and resume the session */
+} ReconnectPayload;
+
 // --- SSL & NETWORK FUNCTIONS ---
 
+/**
+ * @brief A connected byte stream: TLS when `ssl` is set, the plain socket `fd` otherwise.
+ */
+typedef struct Transport {
+    SSL *ssl;
+    int fd;
+} Transport;
+
 /**
  * @brief Initialize OpenSSL libraries. Call once at startup.
  */
@@ -249,6 +514,44 @@ SSL_CTX *create_context(int is_server);
  */
 void configure_context(SSL_CTX *ctx, const char *cert_file, const char *key_file);
 
+/**
+ * @brief Same as configure_context(), but reports failures instead of exiting.
+ * @return 1 if the certificate and a matching key were loaded, 0 otherwise.
+ */
+int load_certificate(SSL_CTX *ctx, const char *cert_file, const char *key_file);
+
+/**
+ * @brief Enables TLS session resumption with rotating ticket keys (server side).
+ * Keys are derived from `secret` per `rotation_seconds` period, so every
+ * process sharing the secret accepts the same tickets, including after a
+ * restart. Tickets from the previous period are still accepted and renewed.
+ * The secret belongs to `ctx`: configuring another context leaves it alone.
+ * @param secret Master secret from config. If empty, OpenSSL's per-process
+ * random keys are kept.
+ * @param previous Context `ctx` replaces (on reload), or NULL. Without a
+ * secret, its random keys are copied so issued tickets stay valid.
+ * @return 1 if configured keys are in use, 2 if previous's keys were copied,
+ * 0 if fresh random keys are used.
+ */
+int configure_session_tickets(SSL_CTX *ctx, const char *secret, int rotation_seconds, SSL_CTX *previous);
+
+#define KTLS_SEND 1
+#define KTLS_RECV 2
+
+/**
+ * @brief Asks OpenSSL to hand record encryption to the kernel (kTLS) after
+ * each handshake. Connections silently stay in user space when the kernel
+ * `tls` module or the negotiated cipher is not supported.
+ * @return 1 if this OpenSSL build supports kTLS, 0 otherwise.
+ */
+int configure_ktls(SSL_CTX *ctx);
+
+/**
+ * @brief Reports which directions of an established connection use kTLS.
+ * @return Bitmask of KTLS_SEND / KTLS_RECV (0 = user space).
+ */
+int ssl_ktls_status(SSL *ssl);
+
 /**
  * @brief Loads a CA certificate from a memory string into the SSL Context for verification.
  * @param ctx The SSL Context.
@@ -275,8 +578,57 @@ int send_packet(SSL *ssl, MessageType type, const void *payload, uint32_t payloa
  * @param type_out Pointer to store received MessageType.
  * @param payload_out Pointer to store pointer to allocated payload buffer.
  * @param payload_len_out Pointer to store size of received payload.
- * @return >0 on success (bytes received), 0 on clean disconnect, -1 on error.
+ * @return >0 on success (bytes received), 0 on clean disconnect, -1 on error
+ * (including a header announcing more than MAX_FRAME_LEN).
  */
 int recv_packet(SSL *ssl, MessageType *type_out, void **payload_out, uint32_t *payload_len_out);
 
+/**
+ * @brief Writes all `len` bytes to the transport.
+ * @return 0 on success, -1 on failure.
+ */
+int send_all(const Transport *t, const void *data, size_t len);
+
+/**
+ * @brief One read on a nonblocking transport.
+ * @return Bytes read, 0 if nothing is available yet, -1 on disconnect or error.
+ */
+int transport_read_some(const Transport *t, void *data, size_t len);
+
+/**
+ * @brief One write on a nonblocking transport. Over TLS, a write that
+ * returned 0 must be retried with the same data and length.
+ * @return Bytes written, 0 if the socket buffer is full, -1 on error.
+ */
+int transport_write_some(const Transport *t, const void *data, size_t len);
+
+/**
+ * @brief send_packet() over any Transport (TLS or plaintext).
+ */
+int transport_send_packet(const Transport *t, MessageType type, const void *payload, uint32_t payload_len);
+
+/**
+ * @brief recv_packet() over any Transport (TLS or plaintext).
+ */
+int transport_recv_packet(const Transport *t, MessageType *type_out, void **payload_out, uint32_t *payload_len_out);
+
+// --- FRAME BUFFERS ---
+
+/**
+ * @brief Appends a full frame (Header + Payload) to a growable buffer.
+ * Used to build MSG_BATCH_REQUEST envelopes. The header uses the same encoding as on the wire.
+ * @param buf Pointer to the buffer (reallocated as needed, caller frees).
+ * @param len Pointer to the current buffer length (updated).
+ * @return 1 on success, -1 on allocation failure.
+ */
+int frame_append(uint8_t **buf, uint32_t *len, MessageType type, const void *payload, uint32_t payload_len);
+
+/**
+ * @brief Reads the next frame from a buffer built with frame_append().
+ * @param offset In/out cursor into the buffer.
+ * @param payload_out Set to point inside buf (not copied), NULL if empty.
+ * @return 1 if a frame was read, 0 at end of buffer, -1 if the buffer is malformed.
+ */
+int frame_next(const uint8_t *buf, uint32_t len, uint32_t *offset, MessageType *type_out, const void **payload_out, uint32_t *payload_len_out);
+
 #endif
\ No newline at end of file
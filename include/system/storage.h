@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 #include "system/protocol.h"
+#include "system/config_loader.h"
 
 /**
  * @brief Internal User structure representing a row in the 'users' table.
@@ -27,36 +28,103 @@ typedef struct User {
  */
 int storage_init(const char *db_path);
 
+/**
+ * @brief Applies the journal, sync, cache and mmap settings of `config` and,
+ * when db_maintenance is set, starts the maintenance thread. It checkpoints
+ * the write-ahead log in the background (commits no longer do it) and
+ * periodically refreshes planner statistics and returns free pages to the
+ * filesystem, on a connection of its own. Call once, after storage_init().
+ */
+void storage_tune(const AppConfig *config);
+
 /**
  * @brief Creates a timestamped copy of the database in data/backups/.
+ * Goes through SQLite, so commits still in the write-ahead log are included.
  */
 void storage_backup(const char *db_path);
 
 /**
- * @brief Closes the database connection.
+ * @brief Stops the maintenance thread and closes the database connection.
  */
 void storage_close(void);
 
+// --- Transactions ---
+
+/**
+ * @brief Opens a transaction so the following writes are committed together.
+ * Calls nest: inner levels are savepoints of the outermost transaction.
+ * @return 1 on success, 0 on failure.
+ */
+int storage_begin(void);
+
+/**
+ * @brief Commits the innermost level opened by storage_begin() (into the
+ * enclosing one, if nested).
+ * @return 1 on success, 0 on failure (the level is still open: roll it back).
+ */
+int storage_commit(void);
+
+/**
+ * @brief Discards the writes of the innermost level opened by storage_begin()
+ * and closes it. Enclosing levels stay open.
+ */
+void storage_rollback(void);
+
+// --- Row Iteration ---
+
+/**
+ * @brief Callback invoked once per row by the storage_each_* iterators.
+ * @param row Pointer to the row (struct or string), only valid during the call.
+ * @return 1 to continue, 0 to stop iterating.
+ */
+typedef int (*StorageRowCallback)(const void *row, void *ctx);
+
 // --- User Management ---
 
+/**
+ * @brief Hashes a password (SHA-512 crypt). Uses a fresh salt when `setting`
+ * is NULL, else the salt and parameters of `setting` (a stored hash).
+ * Touches no database state, so it may run on an executor thread.
+ * @return 1 on success, 0 on failure.
+ */
+int storage_hash_password(const char *password, const char *setting, char *hash_out, size_t size);
+
+/**
+ * @brief Whether `password` matches `stored_hash`. Executor-safe, like storage_hash_password().
+ */
+int storage_verify_password(const char *password, const char *stored_hash);
+
 /**
  * @brief Creates a new user.
+ * @param password_hash From storage_hash_password().
  * @param friend_code_out Buffer to receive the generated unique friend code.
  * @return 1 on success, 0 on failure (e.g., email already exists).
  */
-int storage_register_user(const char *email, const char *username, const char *password, char *friend_code_out);
+int storage_register_user(const char *email, const char *username, const char *password_hash, char *friend_code_out);
 
 /**
- * @brief Verifies email and password against the database.
- * @param user_out Populated with user data if credentials are valid.
- * @return 1 on success, 0 on failure.
+ * @brief Loads a user by email, password hash included (check it with
+ * storage_verify_password()).
+ * @return 1 if found, 0 otherwise.
+ */
+int storage_get_user_by_email(const char *email, User *user_out);
+
+/**
+ * @brief Updates user credentials. Empty values are left unchanged.
+ * @param new_password_hash From storage_hash_password(), or NULL.
  */
-int storage_check_credentials(const char *email, const char *password, User *user_out);
+int storage_update_user(uint32_t uid, const char *new_username, const char *new_password_hash);
 
 /**
- * @brief Updates user credentials.
+ * @brief Invalidates the session tokens of `uid` issued before `not_before_ms`
+ * (wall clock). Persistent, so it outlives restarts and handoffs.
  */
-int storage_update_user(uint32_t uid, const char *new_username, const char *new_password);
+int storage_revoke_sessions(uint32_t uid, int64_t not_before_ms);
+
+/**
+ * @brief Issue time a token of `uid` must reach to be valid (0 if never revoked).
+ */
+int64_t storage_sessions_not_before(uint32_t uid);
 
 // --- Lookups ---
 
@@ -78,12 +146,11 @@ int storage_remove_request(uint32_t from_uid, uint32_t to_uid);
 int storage_add_friendship(uint32_t uid_a, uint32_t uid_b);
 
 /**
- * @brief Populates out_array with the user's contacts.
- * @return Number of contacts retrieved.
+ * @brief Streams the user's contacts (ContactSummary rows) without buffering them.
+ * @return Number of rows visited.
  */
-int storage_get_contacts_data(uint32_t uid, ContactSummary *out_array, int max_count);
-
-int storage_get_requests_data(uint32_t uid, ContactSummary *out_array, int max_count);
+int storage_each_contact(uint32_t uid, StorageRowCallback cb, void *ctx);
+int storage_each_request(uint32_t uid, StorageRowCallback cb, void *ctx);
 
 // --- Group / Conversation Management ---
 
@@ -99,19 +166,79 @@ uint32_t storage_create_conversation(uint8_t type, const char *name, const char
  */
 uint32_t storage_find_private_conversation(uint32_t uid_a, uint32_t uid_b);
 
-int storage_get_user_conversations(uint32_t uid, ConversationSummary *out_array, int max_count);
-int storage_get_conv_participants(uint32_t conv_id, uint32_t *out_uids, int max_count);
+/**
+ * @brief Visits the participant uids (uint32_t rows) of a conversation in ascending order.
+ * @return Number of rows visited.
+ */
+int storage_each_conv_participant(uint32_t conv_id, StorageRowCallback cb, void *ctx);
 
 int storage_is_admin(uint32_t conv_id, uint32_t uid);
 int storage_update_group(uint32_t conv_id, const char *name, const char *desc);
 int storage_add_participant(uint32_t conv_id, uint32_t uid, int role);
 int storage_remove_participant(uint32_t conv_id, uint32_t uid);
+/**
+ * @brief Deletes a conversation with its messages, participants and telemetry
+ * settings, in one transaction (a savepoint inside a batch).
+ * @return 1 if deleted, 0 if nothing changed.
+ */
 int storage_delete_conversation(uint32_t conv_id);
-int storage_get_group_members(uint32_t conv_id, GroupMemberSummary *out_array, int max_count);
+
+/**
+ * @brief Returns the conversation type (CONV_TYPE_*), or -1 if it does not exist.
+ */
+int storage_get_conv_type(uint32_t conv_id);
+
+/**
+ * @brief Per-channel limits of a telemetry conversation.
+ * @return 1 if limits were set for this channel, 0 if the defaults apply.
+ */
+int storage_get_telemetry_limits(uint32_t conv_id, uint32_t *max_rate, uint32_t *retention);
+int storage_set_telemetry_limits(uint32_t conv_id, uint32_t max_rate, uint32_t retention);
+
+/**
+ * @brief Row iterators for conversations (ConversationSummary) and members (GroupMemberSummary).
+ * Members come in uid order, starting after `after_uid`, at most `limit` rows (0 = all).
+ * @return Number of rows visited.
+ */
+int storage_each_user_conversation(uint32_t uid, StorageRowCallback cb, void *ctx);
+
+/**
+ * @brief One conversation as `uid` sees it (role, private chat naming).
+ * With a uid that is not a participant, my_role is ROLE_MEMBER.
+ * @return 1 if the conversation exists.
+ */
+int storage_get_conversation(uint32_t conv_id, uint32_t uid, ConversationSummary *out);
+int storage_each_group_member(uint32_t conv_id, uint32_t after_uid, uint32_t limit, StorageRowCallback cb, void *ctx);
 
 // --- Messaging ---
 
-void storage_log_message(uint32_t conv_id, uint32_t sender_uid, const char *text);
+/**
+ * @brief Stores an (encrypted) message.
+ * @return The new message id, or 0 on failure.
+ */
+uint32_t storage_log_message(uint32_t conv_id, uint32_t sender_uid, const char *text);
+
+// --- Offline Delivery ---
+
+/**
+ * @brief Records that `msg_id` still has to be delivered to `uid`.
+ */
+int storage_add_pending_delivery(uint32_t uid, uint32_t msg_id);
+
+int storage_has_pending_deliveries(uint32_t uid);
+
+/**
+ * @brief Streams the user's undelivered messages (OfflineMessage rows), oldest
+ * first, at most `limit` of them (0 = all).
+ * @return Number of rows visited.
+ */
+int storage_each_pending_message(uint32_t uid, uint32_t limit, StorageRowCallback cb, void *ctx);
+
+/**
+ * @brief Removes delivered entries up to and including `up_to_msg_id`.
+ * @return Number of entries removed.
+ */
+int storage_clear_pending_deliveries(uint32_t uid, uint32_t up_to_msg_id);
 
 /**
  * @brief Retrieves the last 50 messages for a conversation.
@@ -120,4 +247,10 @@ void storage_log_message(uint32_t conv_id, uint32_t sender_uid, const char *text
  */
 char* storage_get_history(uint32_t conv_id);
 
+/**
+ * @brief Streams the same history one formatted line (NUL-terminated string) at a time.
+ * @return Number of lines visited.
+ */
+int storage_each_history_line(uint32_t conv_id, StorageRowCallback cb, void *ctx);
+
 #endif
\ No newline at end of file
@@ -7,6 +7,47 @@ DB_PATH=${DB_PATH:-data/messagerie.db}
 CERT_FILE=${CERT_FILE:-server.crt}
 KEY_FILE=${KEY_FILE:-server.key}
 DB_KEY=${DB_KEY:-}
+SESSION_KEY=${SESSION_KEY:-}
+SESSION_TTL=${SESSION_TTL:-604800}
+TICKET_KEY=${TICKET_KEY:-}
+TICKET_ROTATION=${TICKET_ROTATION:-3600}
+EARLY_DATA=${EARLY_DATA:-0}
+KTLS=${KTLS:-0}
+PLAIN_PORT=${PLAIN_PORT:-0}
+UNIX_SOCKET=${UNIX_SOCKET:-}
+GATEWAY=${GATEWAY:-0}
+GATEWAY_MAX_SESSIONS=${GATEWAY_MAX_SESSIONS:-8192}
+TELEMETRY_RATE=${TELEMETRY_RATE:-1000}
+TELEMETRY_RETENTION=${TELEMETRY_RETENTION:-65536}
+TOPIC_USER_ROOT=${TOPIC_USER_ROOT:-user}
+TOPIC_CONV_ROOT=${TOPIC_CONV_ROOT:-conv}
+TOPIC_PUBLIC_ROOT=${TOPIC_PUBLIC_ROOT:-}
+TOPIC_RETAINED_MAX=${TOPIC_RETAINED_MAX:-10000}
+TOPIC_RETAINED_KB=${TOPIC_RETAINED_KB:-16384}
+FANOUT_WORKERS=${FANOUT_WORKERS:-4}
+FANOUT_SHARD=${FANOUT_SHARD:-1024}
+EXECUTOR_THREADS=${EXECUTOR_THREADS:-2}
+RATE_MESSAGES=${RATE_MESSAGES:-50}
+BURST_MESSAGES=${BURST_MESSAGES:-100}
+RATE_QUERIES=${RATE_QUERIES:-10}
+BURST_QUERIES=${BURST_QUERIES:-40}
+RATE_AUTH=${RATE_AUTH:-2}
+BURST_AUTH=${BURST_AUTH:-5}
+RATE_TELEMETRY=${RATE_TELEMETRY:-1000}
+BURST_TELEMETRY=${BURST_TELEMETRY:-2000}
+OVERLOAD_LAG_MS=${OVERLOAD_LAG_MS:-100}
+OVERLOAD_BACKLOG=${OVERLOAD_BACKLOG:-1024}
+HANDSHAKE_TIMEOUT=${HANDSHAKE_TIMEOUT:-10}
+HEARTBEAT_INTERVAL=${HEARTBEAT_INTERVAL:-30}
+IDLE_TIMEOUT=${IDLE_TIMEOUT:-90}
+LISTEN_BACKLOG=${LISTEN_BACKLOG:-1024}
+MAX_CONNECTIONS=${MAX_CONNECTIONS:-10000}
+MAX_CONNECTIONS_PER_IP=${MAX_CONNECTIONS_PER_IP:-64}
+TCP_KEEPALIVE=${TCP_KEEPALIVE:-60}
+HANDOFF_SOCKET=${HANDOFF_SOCKET:-}
+DRAIN_TIMEOUT=${DRAIN_TIMEOUT:-30}
+RECONNECT_SPREAD=${RECONNECT_SPREAD:-10}
+LOG_LEVEL=${LOG_LEVEL:-debug}
 
 echo "⚙️  Generating server.conf..."
 cat > server.conf <<EOF
@@ -16,6 +57,52 @@ db_path=$DB_PATH
 cert_file=$CERT_FILE
 key_file=$KEY_FILE
 db_key=$DB_KEY
+session_key=$SESSION_KEY
+session_ttl=$SESSION_TTL
+ticket_key=$TICKET_KEY
+ticket_rotation=$TICKET_ROTATION
+early_data=$EARLY_DATA
+ktls=$KTLS
+plain_port=$PLAIN_PORT
+unix_socket=$UNIX_SOCKET
+gateway=$GATEWAY
+gateway_max_sessions=$GATEWAY_MAX_SESSIONS
+telemetry_rate=$TELEMETRY_RATE
+telemetry_retention=$TELEMETRY_RETENTION
+topic_user_root=$TOPIC_USER_ROOT
+topic_conv_root=$TOPIC_CONV_ROOT
+topic_public_root=$TOPIC_PUBLIC_ROOT
+topic_retained_max=$TOPIC_RETAINED_MAX
+topic_retained_kb=$TOPIC_RETAINED_KB
+fanout_workers=$FANOUT_WORKERS
+fanout_shard=$FANOUT_SHARD
+executor_threads=$EXECUTOR_THREADS
+rate_messages=$RATE_MESSAGES
+burst_messages=$BURST_MESSAGES
+rate_queries=$RATE_QUERIES
+burst_queries=$BURST_QUERIES
+rate_auth=$RATE_AUTH
+burst_auth=$BURST_AUTH
+rate_telemetry=$RATE_TELEMETRY
+burst_telemetry=$BURST_TELEMETRY
+overload_lag_ms=$OVERLOAD_LAG_MS
+overload_backlog=$OVERLOAD_BACKLOG
+handshake_timeout=$HANDSHAKE_TIMEOUT
+heartbeat_interval=$HEARTBEAT_INTERVAL
+idle_timeout=$IDLE_TIMEOUT
+listen_backlog=$LISTEN_BACKLOG
+max_connections=$MAX_CONNECTIONS
+max_connections_per_ip=$MAX_CONNECTIONS_PER_IP
+tcp_keepalive=$TCP_KEEPALIVE
+handoff_socket=$HANDOFF_SOCKET
+drain_timeout=$DRAIN_TIMEOUT
+reconnect_spread=$RECONNECT_SPREAD
+log_level=$LOG_LEVEL
+db_wal=$DB_WAL
+db_synchronous=$DB_SYNCHRONOUS
+db_cache_kb=$DB_CACHE_KB
+db_mmap_mb=$DB_MMAP_MB
+db_maintenance=$DB_MAINTENANCE
 EOF
 
 echo "✅ Configuration generated."
@@ -8,6 +8,7 @@ AppState app;
 void app_init(void) {
     memset(&app, 0, sizeof(AppState));
     pthread_mutex_init(&app.state_lock, NULL);
+    pthread_mutex_init(&app.send_lock, NULL);
     app.current_state = STATE_START;
 
 		app.contacts = NULL;
@@ -25,9 +26,18 @@ void app_cleanup(void) {
     if (app.conversations) free(app.conversations);
     if (app.current_group_members) free(app.current_group_members);
     if (app.chat_history) free(app.chat_history);
+    if (app.pending_unread) free(app.pending_unread);
     
     pthread_mutex_unlock(&app.state_lock);
     pthread_mutex_destroy(&app.state_lock);
+    pthread_mutex_destroy(&app.send_lock);
+}
+
+int app_send(MessageType type, const void *payload, uint32_t payload_len) {
+    pthread_mutex_lock(&app.send_lock);
+    int rc = send_packet(app.ssl, type, payload, payload_len);
+    pthread_mutex_unlock(&app.send_lock);
+    return rc;
 }
 
 void app_remove_request(int index) {
@@ -56,8 +66,80 @@ void app_append_history(const char *text) {
         char *ptr = realloc(app.chat_history, total);
         if (ptr) {
             app.chat_history = ptr;
-            strcat(app.chat_history, text);
+            memcpy(app.chat_history + app.chat_history_len, text, new_len + 1);
             app.chat_history_len += new_len;
         }
     }
-}
\ No newline at end of file
+}
+
+void app_add_unread(uint32_t conv_id, int count) {
+    for (int i = 0; i < app.conv_count; i++) {
+        if (app.conversations[i].conv_id == conv_id) {
+            app.conversations[i].unread_count += count;
+            return;
+        }
+    }
+
+    for (int i = 0; i < app.pending_unread_count; i++) {
+        if (app.pending_unread[i].conv_id == conv_id) {
+            app.pending_unread[i].count += count;
+            return;
+        }
+    }
+
+    PendingUnread *ptr = realloc(app.pending_unread, (app.pending_unread_count + 1) * sizeof(PendingUnread));
+    if (!ptr) return;
+    app.pending_unread = ptr;
+    app.pending_unread[app.pending_unread_count].conv_id = conv_id;
+    app.pending_unread[app.pending_unread_count].count = count;
+    app.pending_unread_count++;
+}
+
+void app_apply_pending_unread(void) {
+    int kept = 0;
+    for (int i = 0; i < app.pending_unread_count; i++) {
+        int applied = 0;
+        for (int j = 0; j < app.conv_count; j++) {
+            if (app.conversations[j].conv_id == app.pending_unread[i].conv_id) {
+                app.conversations[j].unread_count += app.pending_unread[i].count;
+                applied = 1;
+                break;
+            }
+        }
+        if (!applied) app.pending_unread[kept++] = app.pending_unread[i];
+    }
+    app.pending_unread_count = kept;
+}
+
+void app_apply_conv_update(const ConvUpdatePayload *update) {
+    int idx = -1;
+    for (int i = 0; i < app.conv_count; i++) {
+        if (app.conversations[i].conv_id == update->conv.conv_id) {
+            idx = i;
+            break;
+        }
+    }
+
+    if (update->event == CONV_EVENT_REMOVED) {
+        if (idx < 0) return;
+        memmove(&app.conversations[idx], &app.conversations[idx + 1],
+                (size_t)(app.conv_count - idx - 1) * sizeof(ConversationSummary));
+        app.conv_count--;
+        return;
+    }
+
+    if (idx >= 0) {
+        // Keep the local unread counter and role
+        ConversationSummary *c = &app.conversations[idx];
+        c->type = update->conv.type;
+        memcpy(c->name, update->conv.name, sizeof(c->name));
+        memcpy(c->description, update->conv.description, sizeof(c->description));
+        return;
+    }
+
+    ConversationSummary *ptr = realloc(app.conversations, (app.conv_count + 1) * sizeof(ConversationSummary));
+    if (!ptr) return;
+    app.conversations = ptr;
+    app.conversations[app.conv_count++] = update->conv;
+    app_apply_pending_unread();
+}
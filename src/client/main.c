@@ -12,6 +12,7 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <sys/stat.h>
+#include <time.h>
 
 // Dynamic include at compilation
 #include "server_cert.h"
@@ -30,161 +31,741 @@
 #include "services/chat_service.h"
 #include "services/group_service.h"
 #include "services/contact_service.h"
+#include "services/batch_service.h"
+#include "services/health_service.h"
 
-void *network_thread(void *arg)
+// Bounds on reassembly: a stream past MAX_STREAM_BYTES is abandoned, and
+// beginning more than MAX_STREAMS at once abandons the oldest
+#define MAX_STREAM_BYTES (8 * 1024 * 1024)
+#define MAX_STREAMS 4
+
+// Inbound stream being reassembled (see MSG_STREAM_BEGIN)
+typedef struct InboundStream
 {
-	(void)arg;
-	MessageType type;
-	void *payload;
+	uint32_t stream_id;
+	uint32_t next_seq;
+	MessageType inner_type;
+	char *buf;
 	uint32_t len;
+	struct InboundStream *next;
+} InboundStream;
 
-	while (recv_packet(app.ssl, &type, &payload, &len) > 0)
+static InboundStream *streams = NULL;
+
+/**
+ * Applies one decoded packet to the app state.
+ * Handlers take ownership of the payload by setting it to NULL.
+ */
+static void handle_packet(MessageType type, void **payload_ref, uint32_t len);
+
+// Copies `count` records of `size` bytes out of a bootstrap payload
+static void *take_section(const uint8_t **cursor, uint32_t count, size_t size)
+{
+	if (count == 0)
+		return NULL;
+	void *out = malloc(count * size);
+	if (out)
+		memcpy(out, *cursor, count * size);
+	*cursor += count * size;
+	return out;
+}
+
+static void apply_bootstrap(const void *payload, uint32_t len)
+{
+	if (!payload || len < sizeof(BootstrapHeader))
+		return;
+
+	BootstrapHeader h;
+	memcpy(&h, payload, sizeof(h));
+	if (h.unchanged)
+		return; // Lists we hold are current
+
+	uint64_t expected = sizeof(h) + (uint64_t)(h.contacts_count + h.requests_count) * sizeof(ContactSummary) + (uint64_t)h.conv_count * sizeof(ConversationSummary);
+	if (len < expected)
+	{
+		log_print(LOG_WARN, "Truncated bootstrap (%u of %llu bytes)", len, (unsigned long long)expected);
+		return;
+	}
+
+	const uint8_t *cursor = (const uint8_t *)payload + sizeof(h);
+
+	pthread_mutex_lock(&app.state_lock);
+	app.my_info = h.me;
+	app.bootstrap_version = h.version;
+
+	free(app.contacts);
+	app.contacts = take_section(&cursor, h.contacts_count, sizeof(ContactSummary));
+	app.contacts_count = app.contacts ? (int)h.contacts_count : 0;
+
+	free(app.requests);
+	app.requests = take_section(&cursor, h.requests_count, sizeof(ContactSummary));
+	app.requests_count = app.requests ? (int)h.requests_count : 0;
+
+	free(app.conversations);
+	app.conversations = take_section(&cursor, h.conv_count, sizeof(ConversationSummary));
+	app.conv_count = app.conversations ? (int)h.conv_count : 0;
+	app_apply_pending_unread();
+	pthread_mutex_unlock(&app.state_lock);
+}
+
+static InboundStream *find_stream(uint32_t stream_id, InboundStream **prev_out)
+{
+	InboundStream *prev = NULL;
+	InboundStream *s = streams;
+	while (s && s->stream_id != stream_id)
+	{
+		prev = s;
+		s = s->next;
+	}
+	if (prev_out)
+		*prev_out = prev;
+	return s;
+}
+
+static void drop_stream(InboundStream *s, InboundStream *prev)
+{
+	if (prev)
+		prev->next = s->next;
+	else
+		streams = s->next;
+	free(s->buf);
+	free(s);
+}
+
+static void handle_stream(MessageType type, void *payload, uint32_t len)
+{
+	if (!payload || len < sizeof(StreamHeader))
+		return;
+
+	StreamHeader *h = (StreamHeader *)payload;
+	char *data = (char *)payload + sizeof(StreamHeader); // NUL-terminated by recv_packet
+	uint32_t data_len = len - sizeof(StreamHeader);
+
+	InboundStream *prev;
+	InboundStream *s = find_stream(h->stream_id, &prev);
+
+	if (type == MSG_STREAM_BEGIN)
 	{
-		switch (type)
+		if (s)
+			drop_stream(s, prev);
+
+		int open_streams = 0;
+		InboundStream *oldest = NULL, *before_oldest = NULL;
+		for (InboundStream *o = streams, *p = NULL; o; p = o, o = o->next)
 		{
-		case MSG_RESP_CONVERSATIONS:
+			open_streams++;
+			oldest = o;
+			before_oldest = p;
+		}
+		if (open_streams >= MAX_STREAMS)
 		{
-			if (payload)
-			{
-				pthread_mutex_lock(&app.state_lock);
-				// Free old
-				if (app.conversations)
-					free(app.conversations);
+			log_print(LOG_WARN, "Stream %u: too many open streams, abandoning %u", h->stream_id, oldest->stream_id);
+			drop_stream(oldest, before_oldest);
+		}
 
-				// Take ownership of payload
-				app.conversations = (ConversationSummary *)payload;
-				app.conv_count = len / sizeof(ConversationSummary);
+		s = calloc(1, sizeof(InboundStream));
+		if (!s)
+			return;
+		s->stream_id = h->stream_id;
+		s->inner_type = h->inner_type;
+		s->buf = malloc(1); // Non-NULL even when empty so empty lists get applied
+		s->next = streams;
+		streams = s;
 
-				// Set payload to NULL so it's not freed at end of loop
-				payload = NULL;
-				pthread_mutex_unlock(&app.state_lock);
-			}
-			app.needs_redraw = 1;
-			break;
+		if (s->inner_type == MSG_RESP_HISTORY)
+		{
+			pthread_mutex_lock(&app.state_lock);
+			free(app.chat_history);
+			app.chat_history = NULL;
+			app.chat_history_len = 0;
+			pthread_mutex_unlock(&app.state_lock);
 		}
-		case MSG_CONV_CREATED:
+		return;
+	}
+
+	if (!s)
+		return;
+
+	if (type == MSG_STREAM_CHUNK)
+	{
+		if (h->seq != s->next_seq)
 		{
-			service_req_conversations();
-			app.needs_redraw = 1;
-			break;
+			log_print(LOG_WARN, "Stream %u: chunk %u out of order (expected %u), dropped", h->stream_id, h->seq, s->next_seq);
+			drop_stream(s, prev);
+			return;
 		}
-		case MSG_RTE_TEXT:
+		s->next_seq++;
+
+		if (s->len + data_len > MAX_STREAM_BYTES)
 		{
-			RoutedMessagePayload *p = (RoutedMessagePayload *)payload;
+			log_print(LOG_WARN, "Stream %u: over %d bytes, abandoned", h->stream_id, MAX_STREAM_BYTES);
+			drop_stream(s, prev);
+			return;
+		}
+
+		if (s->inner_type == MSG_RESP_HISTORY)
+		{
+			// History goes straight to the chat buffer (only counted here);
+			// the UI redraws once the stream ends
 			pthread_mutex_lock(&app.state_lock);
+			app_append_history(data);
+			pthread_mutex_unlock(&app.state_lock);
+			s->len += data_len;
+			return;
+		}
 
-			if (app.current_state == STATE_CHAT && app.current_conv_id == p->conv_id)
-			{
-				char line[1200];
-				snprintf(line, sizeof(line), "[%s]: %s\n", p->sender_username, p->text);
-				app_append_history(line); // Use new helper
-				ui_draw_chat(app.current_conv_name, app.chat_history ? app.chat_history : "", app.chat_input_buffer);
-			}
-			else
+		char *grown = realloc(s->buf, s->len + data_len + 1);
+		if (!grown)
+		{
+			drop_stream(s, prev);
+			return;
+		}
+		s->buf = grown;
+		memcpy(s->buf + s->len, data, data_len);
+		s->len += data_len;
+		return;
+	}
+
+	if (type == MSG_STREAM_END)
+	{
+		if (h->seq != s->next_seq)
+			log_print(LOG_WARN, "Stream %u ended after %u chunks, received %u", h->stream_id, h->seq, s->next_seq);
+		else if (s->inner_type != MSG_RESP_HISTORY)
+		{
+			void *assembled = s->buf;
+			handle_packet(s->inner_type, &assembled, s->len);
+			s->buf = assembled; // NULL if ownership was taken
+		}
+		drop_stream(s, prev);
+		app.needs_redraw = 1;
+	}
+}
+
+static void handle_packet(MessageType type, void **payload_ref, uint32_t len)
+{
+	void *payload = *payload_ref;
+
+	switch (type)
+	{
+	case MSG_RESP_CONVERSATIONS:
+	{
+		if (payload)
+		{
+			pthread_mutex_lock(&app.state_lock);
+			// Free old
+			if (app.conversations)
+				free(app.conversations);
+
+			// Take ownership of payload
+			app.conversations = (ConversationSummary *)payload;
+			app.conv_count = len / sizeof(ConversationSummary);
+			app_apply_pending_unread();
+
+			// Set payload to NULL so it's not freed at end of loop
+			payload = NULL;
+			pthread_mutex_unlock(&app.state_lock);
+		}
+		app.needs_redraw = 1;
+		break;
+	}
+	case MSG_CONV_UPDATED:
+	{
+		if (payload && len >= sizeof(ConvUpdatePayload))
+		{
+			pthread_mutex_lock(&app.state_lock);
+			app_apply_conv_update((const ConvUpdatePayload *)payload);
+			pthread_mutex_unlock(&app.state_lock);
+		}
+		app.needs_redraw = 1;
+		break;
+	}
+	case MSG_CONV_CREATED:
+	{
+		service_req_conversations();
+		app.needs_redraw = 1;
+		break;
+	}
+	case MSG_RTE_TEXT:
+	{
+		RoutedMessagePayload *p = (RoutedMessagePayload *)payload;
+		pthread_mutex_lock(&app.state_lock);
+
+		if (app.current_state == STATE_CHAT && app.current_conv_id == p->conv_id)
+		{
+			char line[1200];
+			snprintf(line, sizeof(line), "[%s]: %s\n", p->sender_username, p->text);
+			app_append_history(line); // Use new helper
+			ui_draw_chat(app.current_conv_name, app.chat_history ? app.chat_history : "", app.chat_input_buffer);
+		}
+		else
+		{
+			// Simple update unread check
+			for (int i = 0; i < app.conv_count; i++)
 			{
-				// Simple update unread check
-				for (int i = 0; i < app.conv_count; i++)
+				if (app.conversations[i].conv_id == p->conv_id)
 				{
-					if (app.conversations[i].conv_id == p->conv_id)
-					{
-						app.conversations[i].unread_count++;
-						app.needs_redraw = 1;
-						break;
-					}
+					app.conversations[i].unread_count++;
+					app.needs_redraw = 1;
+					break;
 				}
 			}
+		}
+		pthread_mutex_unlock(&app.state_lock);
+		app.needs_redraw = 1;
+		break;
+	}
+	case MSG_RESP_HISTORY:
+	{
+		if (payload)
+		{
+			pthread_mutex_lock(&app.state_lock);
+			if (app.chat_history)
+				free(app.chat_history);
+
+			app.chat_history = (char *)payload;
+			app.chat_history_len = strlen(app.chat_history); // NUL-terminated by recv_packet
+
+			payload = NULL; // Take ownership
 			pthread_mutex_unlock(&app.state_lock);
+
+			if (app.current_state == STATE_CHAT)
+				ui_draw_chat(app.current_conv_name, app.chat_history, app.chat_input_buffer);
+
 			app.needs_redraw = 1;
-			break;
 		}
-		case MSG_RESP_HISTORY:
+		break;
+	}
+	case MSG_RESP_CONTACTS:
+	{
+		if (payload)
 		{
-			if (payload)
-			{
-				pthread_mutex_lock(&app.state_lock);
-				if (app.chat_history)
-					free(app.chat_history);
+			pthread_mutex_lock(&app.state_lock);
+			if (app.contacts)
+				free(app.contacts);
 
-				app.chat_history = (char *)payload;
-				app.chat_history_len = len; // payload len for history string
+			app.contacts = (ContactSummary *)payload;
+			app.contacts_count = len / sizeof(ContactSummary);
 
-				payload = NULL; // Take ownership
-				pthread_mutex_unlock(&app.state_lock);
+			payload = NULL; // Take ownership
+			pthread_mutex_unlock(&app.state_lock);
+			app.needs_redraw = 1;
+		}
+		break;
+	}
+	case MSG_RESP_REQUESTS:
+	{
+		if (payload)
+		{
+			pthread_mutex_lock(&app.state_lock);
+			if (app.requests)
+				free(app.requests);
 
-				if (app.current_state == STATE_CHAT)
-					ui_draw_chat(app.current_conv_name, app.chat_history, app.chat_input_buffer);
+			app.requests = (ContactSummary *)payload;
+			app.requests_count = len / sizeof(ContactSummary);
 
-				app.needs_redraw = 1;
-			}
-			break;
+			payload = NULL; // Take ownership
+			pthread_mutex_unlock(&app.state_lock);
+			app.needs_redraw = 1;
 		}
-		case MSG_RESP_CONTACTS:
+		break;
+	}
+	case MSG_RESP_MEMBERS:
+	{
+		if (payload)
 		{
-			if (payload)
-			{
-				pthread_mutex_lock(&app.state_lock);
-				if (app.contacts)
-					free(app.contacts);
+			pthread_mutex_lock(&app.state_lock);
+			if (app.current_group_members)
+				free(app.current_group_members);
 
-				app.contacts = (ContactSummary *)payload;
-				app.contacts_count = len / sizeof(ContactSummary);
+			app.current_group_members = (GroupMemberSummary *)payload;
+			app.current_group_members_count = len / sizeof(GroupMemberSummary);
 
-				payload = NULL; // Take ownership
-				pthread_mutex_unlock(&app.state_lock);
-				app.needs_redraw = 1;
-			}
-			break;
+			payload = NULL; // Take ownership
+			pthread_mutex_unlock(&app.state_lock);
+			app.needs_redraw = 1;
 		}
-		case MSG_RESP_REQUESTS:
+		break;
+	}
+	case MSG_ADD_REQ_SENT:
+		log_print(LOG_INFO, "Friend request sent successfully");
+		app.needs_redraw = 1;
+		break;
+	case MSG_ADD_SUCCESS:
+		service_refresh_contacts();
+		break;
+	case MSG_BATCH_RESULT:
+	{
+		BatchResultEntry *results = (BatchResultEntry *)payload;
+		int count = len / sizeof(BatchResultEntry);
+		int applied = 0;
+		for (int i = 0; i < count; i++)
+		{
+			if (results[i].reply_type != 0)
+				applied++;
+		}
+		if (count == 0)
+			log_print(LOG_WARN, "Batch rejected by the server: nothing was applied");
+		else
+			log_print(LOG_INFO, "Batch result: %d/%d operations acknowledged", applied, count);
+		app.needs_redraw = 1;
+		break;
+	}
+	case MSG_PRESENCE_UPDATE:
+	{
+		if (payload && len >= sizeof(PresencePayload))
 		{
-			if (payload)
+			PresencePayload *p = (PresencePayload *)payload;
+			pthread_mutex_lock(&app.state_lock);
+			for (int i = 0; i < app.contacts_count; i++)
 			{
-				pthread_mutex_lock(&app.state_lock);
-				if (app.requests)
-					free(app.requests);
-
-				app.requests = (ContactSummary *)payload;
-				app.requests_count = len / sizeof(ContactSummary);
-
-				payload = NULL; // Take ownership
-				pthread_mutex_unlock(&app.state_lock);
-				app.needs_redraw = 1;
+				if (app.contacts[i].uid == p->uid)
+				{
+					app.contacts[i].is_online = p->is_online;
+					break;
+				}
 			}
-			break;
+			pthread_mutex_unlock(&app.state_lock);
+			app.needs_redraw = 1;
 		}
-		case MSG_RESP_MEMBERS:
+		break;
+	}
+	case MSG_UPDATE_SUCCESS:
+	{
+		// Tokens issued before the update are revoked: keep the saved one valid
+		SessionToken saved;
+		if (payload && len >= sizeof(SessionToken))
 		{
-			if (payload)
-			{
-				pthread_mutex_lock(&app.state_lock);
-				if (app.current_group_members)
-					free(app.current_group_members);
+			memcpy(&app.session_token, payload, sizeof(SessionToken));
+			if (load_session(&saved))
+				save_session(&app.session_token);
+		}
+		break;
+	}
+	case MSG_BOOTSTRAP:
+		apply_bootstrap(payload, len);
+		app.needs_redraw = 1;
+		break;
+	case MSG_OFFLINE_MESSAGES:
+	{
+		OfflineMessage *msgs = (OfflineMessage *)payload;
+		int count = len / sizeof(OfflineMessage);
+		uint32_t last_id = 0;
 
-				app.current_group_members = (GroupMemberSummary *)payload;
-				app.current_group_members_count = len / sizeof(GroupMemberSummary);
+		pthread_mutex_lock(&app.state_lock);
+		for (int i = 0; i < count; i++)
+		{
+			app_add_unread(msgs[i].conv_id, 1);
+			if (msgs[i].message_id > last_id)
+				last_id = msgs[i].message_id;
+		}
+		pthread_mutex_unlock(&app.state_lock);
 
-				payload = NULL; // Take ownership
-				pthread_mutex_unlock(&app.state_lock);
-				app.needs_redraw = 1;
-			}
-			break;
+		if (last_id)
+		{
+			log_print(LOG_INFO, "Received %d messages sent while offline", count);
+			service_ack_offline(last_id);
 		}
-		case MSG_ADD_REQ_SENT:
-			log_print(LOG_INFO, "Friend request sent successfully");
-			app.needs_redraw = 1;
-			break;
-		case MSG_ADD_SUCCESS:
-			service_refresh_contacts();
-			break;
-		default:
-			break;
+		app.needs_redraw = 1;
+		break;
+	}
+	case MSG_RETRY_AFTER:
+	{
+		if (payload && len >= sizeof(RetryAfterPayload))
+		{
+			RetryAfterPayload *r = (RetryAfterPayload *)payload;
+			log_print(LOG_WARN, "Server busy: request %u refused, retry in %u ms", r->request_type, r->retry_ms);
+		}
+		break;
+	}
+	case MSG_PING:
+		// Heartbeat: answering is enough to stay connected while idle
+		app_send(MSG_PONG, payload, len);
+		break;
+	case MSG_PONG:
+		if (payload && len >= sizeof(PingPayload))
+			service_health_on_pong((const PingPayload *)payload);
+		break;
+	case MSG_RECONNECT:
+		if (payload && len >= sizeof(ReconnectPayload))
+		{
+			// The server is being replaced; it keeps serving us until then
+			pthread_mutex_lock(&app.state_lock);
+			app.reconnect_delay_ms = ((ReconnectPayload *)payload)->delay_ms;
+			pthread_mutex_unlock(&app.state_lock);
+			log_print(LOG_INFO, "Server restarting, reconnecting in %u ms", app.reconnect_delay_ms);
 		}
+		break;
+	case MSG_STREAM_BEGIN:
+	case MSG_STREAM_CHUNK:
+	case MSG_STREAM_END:
+		handle_stream(type, payload, len);
+		break;
+	default:
+		break;
+	}
+	*payload_ref = payload;
+}
+
+void *network_thread(void *arg)
+{
+	(void)arg;
+	MessageType type;
+	void *payload;
+	uint32_t len;
+
+	while (recv_packet(app.ssl, &type, &payload, &len) > 0)
+	{
+		handle_packet(type, &payload, len);
 		if (payload)
 			free(payload);
 	}
+
+	pthread_mutex_lock(&app.state_lock);
+	app.link_down = 1;
+	pthread_mutex_unlock(&app.state_lock);
 	return NULL;
 }
 
+// Opens the connection and completes the TLS handshake (app.sock_fd, app.ssl).
+// With a token, the session resume is sent as 0-RTT early data when the saved
+// TLS session allows it.
+// @return -1 on failure, 1 if the resume went out as early data, 0 otherwise
+static int connect_server(const AppConfig *config, const SessionToken *token)
+{
+	struct addrinfo hints, *res, *p;
+	char port_str[6];
+	snprintf(port_str, sizeof(port_str), "%d", config->port);
+
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(config->server_host, port_str, &hints, &res) != 0)
+	{
+		log_print(LOG_ERROR, "DNS lookup failed for %s", config->server_host);
+		return -1;
+	}
+
+	app.sock_fd = -1;
+	for (p = res; p != NULL; p = p->ai_next)
+	{
+		if ((app.sock_fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1)
+		{
+			continue;
+		}
+		if (connect(app.sock_fd, p->ai_addr, p->ai_addrlen) == -1)
+		{
+			close(app.sock_fd);
+			app.sock_fd = -1;
+			continue;
+		}
+		break;
+	}
+
+	freeaddrinfo(res);
+
+	if (app.sock_fd == -1)
+	{
+		log_print(LOG_ERROR, "Failed to connect to %s", config->server_host);
+		return -1;
+	}
+
+	// Perform SSL Handshake
+	app.ssl = SSL_new(app.ctx);
+	SSL_set_fd(app.ssl, app.sock_fd);
+	int offered = tls_session_offer(app.ssl);
+
+	// Returning clients may resume in the very first flight (0-RTT)
+	int early_sent = (offered && token) ? service_resume_early(token) : 0;
+
+	if (SSL_connect(app.ssl) <= 0)
+	{
+		log_print(LOG_ERROR, "SSL Handshake failed");
+		ERR_print_errors_fp(stderr);
+		SSL_free(app.ssl);
+		app.ssl = NULL;
+		close(app.sock_fd);
+		app.sock_fd = -1;
+		return -1;
+	}
+
+	log_print(LOG_INFO, "Connected to server via SSL (%s)",
+			  SSL_session_reused(app.ssl) ? "resumed session" : offered ? "saved session refused" : "full handshake");
+	return early_sent;
+}
+
+// Logs in again on a new connection, with the token of the current session
+static int resume_session(int early_sent)
+{
+	if (early_sent && SSL_get_early_data_status(app.ssl) == SSL_EARLY_DATA_ACCEPTED)
+		return service_await_login();
+	return service_resume(&app.session_token);
+}
+
+static uint64_t monotonic_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Called from the UI loop. When the server asks for it (MSG_RECONNECT) or
+// the link breaks, waits the delay the server chose (or a jittered backoff),
+// reconnects and resumes the session, then restarts the network thread.
+// The user stays on the current screen meanwhile
+static void reconnect_if_due(const AppConfig *config, pthread_t *th)
+{
+	static uint64_t due_ms = 0;
+	static uint32_t backoff_ms = 0;
+
+	pthread_mutex_lock(&app.state_lock);
+	int down = app.link_down;
+	uint32_t asked_ms = app.reconnect_delay_ms;
+	pthread_mutex_unlock(&app.state_lock);
+	if (!down && asked_ms == 0)
+		return;
+
+	uint64_t now = monotonic_ms();
+	if (due_ms == 0)
+	{
+		uint32_t delay_ms = asked_ms > 0 ? asked_ms : 1000 + (uint32_t)(rand() % 2000);
+		due_ms = now + delay_ms;
+		if (down)
+			log_print(LOG_WARN, "Connection lost, reconnecting in %u ms", delay_ms);
+		return;
+	}
+	if (now < due_ms)
+		return;
+
+	// Stop the network thread (blocked reading) and drop the old connection
+	if (app.ssl)
+	{
+		if (!down)
+			shutdown(app.sock_fd, SHUT_RDWR);
+		pthread_join(*th, NULL);
+		SSL_free(app.ssl);
+		app.ssl = NULL;
+	}
+	if (app.sock_fd != -1)
+		close(app.sock_fd);
+	app.sock_fd = -1;
+
+	// Partial streams will not complete on another connection
+	while (streams)
+		drop_stream(streams, NULL);
+
+	// Online flags are not versioned and presence pushes sent while the link
+	// was down are lost: ask for the full snapshot, not "unchanged"
+	pthread_mutex_lock(&app.state_lock);
+	app.bootstrap_version = 0;
+	pthread_mutex_unlock(&app.state_lock);
+
+	int early_sent = connect_server(config, &app.session_token);
+	if (early_sent >= 0 && resume_session(early_sent))
+	{
+		SessionToken saved;
+		if (load_session(&saved))
+			save_session(&app.session_token); // Remembered: keep the refreshed token
+
+		due_ms = 0;
+		backoff_ms = 0;
+		pthread_mutex_lock(&app.state_lock);
+		app.link_down = 0;
+		app.reconnect_delay_ms = 0;
+		pthread_mutex_unlock(&app.state_lock);
+		pthread_create(th, NULL, network_thread, NULL);
+		service_subscribe_presence();
+		log_print(LOG_INFO, "Reconnected, session resumed");
+		app.needs_redraw = 1;
+		return;
+	}
+
+	if (early_sent >= 0)
+	{
+		// Reachable, but the session is gone (revoked or expired): only a
+		// new login helps, retrying would not. The UI loop shows the start
+		// menu on this connection, like a client started without a session
+		log_print(LOG_WARN, "Session refused on reconnect, back to the login screen");
+		clear_session();
+		memset(&app.session_token, 0, sizeof(app.session_token));
+		due_ms = 0;
+		backoff_ms = 0;
+		pthread_mutex_lock(&app.state_lock);
+		app.link_down = 0;
+		app.reconnect_delay_ms = 0;
+		pthread_mutex_unlock(&app.state_lock);
+		app.current_state = STATE_START;
+		return;
+	}
+
+	if (app.ssl)
+	{
+		SSL_free(app.ssl);
+		app.ssl = NULL;
+	}
+	if (app.sock_fd != -1)
+		close(app.sock_fd);
+	app.sock_fd = -1;
+
+	// Retry with a jittered exponential backoff, so a recovering server is
+	// not hit by every client at the same instants
+	backoff_ms = backoff_ms == 0 ? 2000 : (backoff_ms * 2 > 30000 ? 30000 : backoff_ms * 2);
+	uint32_t delay_ms = backoff_ms / 2 + (uint32_t)(rand() % (backoff_ms / 2 + 1));
+	due_ms = now + delay_ms;
+	log_print(LOG_WARN, "Reconnect failed, retrying in %u ms", delay_ms);
+}
+
+// Register / login menu, on the open connection (the network thread is not
+// running). @return 1 once logged in, 0 if the user quits
+static int start_menu(void)
+{
+	while (1)
+	{
+		int choice = ui_draw_start_menu();
+		if (choice == 3) // Quit
+			return 0;
+		if (choice == 2)
+		{ // Register
+			RegisterPayload reg = {0};
+			ui_draw_register(reg.email, reg.username, reg.password);
+			service_register(reg.email, reg.username, reg.password);
+		}
+		if (choice == 1)
+		{ // Login
+			LoginPayload log = {0};
+			int remember = 0;
+			ui_draw_login(log.email, log.password, &remember);
+
+			if (service_login(log.email, log.password))
+			{
+				if (remember)
+					save_session(&app.session_token);
+				else
+					clear_session();
+				return 1;
+			}
+		}
+	}
+}
+
+// Grows the group form's selection flags to the contact list, which the
+// network thread may replace while the form is open. New flags start clear.
+// @return Contacts the flags cover (fewer than `count` if out of memory)
+static int fit_selection(int **selected, int *cap, int count)
+{
+	if (count > *cap)
+	{
+		int *grown = realloc(*selected, count * sizeof(int));
+		if (grown)
+		{
+			memset(grown + *cap, 0, (count - *cap) * sizeof(int));
+			*selected = grown;
+			*cap = count;
+		}
+	}
+	return count < *cap ? count : *cap;
+}
+
 int main(int argc, char *argv[])
 {
 	log_init("client");
@@ -231,6 +812,7 @@ int main(int argc, char *argv[])
 	// 2. SSL INIT (Updated)
 	init_openssl();
 	app.ctx = create_context(0);
+	tls_session_enable_cache(app.ctx);
 
 	int cert_loaded = 0;
 
@@ -276,63 +858,14 @@ int main(int argc, char *argv[])
 
 	// 3. CONNECTION (Use config)
 	log_print(LOG_INFO, "Connecting to %s:%d...", config.server_host, config.port);
-
-	struct addrinfo hints, *res, *p;
-	char port_str[6];
-	snprintf(port_str, sizeof(port_str), "%d", config.port);
-
-	memset(&hints, 0, sizeof hints);
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
-
-	if (getaddrinfo(config.server_host, port_str, &hints, &res) != 0)
-	{
-		log_print(LOG_ERROR, "DNS lookup failed for %s", config.server_host);
-		printf("Error: Could not resolve hostname %s\n", config.server_host);
-		ui_cleanup();
-		cleanup_openssl();
-		return -1;
-	}
-
-	app.sock_fd = -1;
 	printf("Connecting to %s:%d...\n", config.server_host, config.port);
 
-	for (p = res; p != NULL; p = p->ai_next)
-	{
-		if ((app.sock_fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1)
-		{
-			continue;
-		}
-		if (connect(app.sock_fd, p->ai_addr, p->ai_addrlen) == -1)
-		{
-			close(app.sock_fd);
-			app.sock_fd = -1;
-			continue;
-		}
-		break;
-	}
-
-	freeaddrinfo(res);
-
-	if (app.sock_fd == -1)
+	SessionToken session;
+	int have_session = load_session(&session);
+	int early_sent = connect_server(&config, have_session ? &session : NULL);
+	if (early_sent < 0)
 	{
-		log_print(LOG_ERROR, "Failed to connect to %s", config.server_host);
 		printf("Connection failed.\n");
-		ui_cleanup();
-		cleanup_openssl();
-		return -1;
-	}
-
-	// 2. Perform SSL Handshake
-	app.ssl = SSL_new(app.ctx);
-	SSL_set_fd(app.ssl, app.sock_fd);
-
-	if (SSL_connect(app.ssl) <= 0)
-	{
-		printf("SSL Handshake failed.\n");
-		ERR_print_errors_fp(stderr);
-		close(app.sock_fd);
-		SSL_free(app.ssl);
 		SSL_CTX_free(app.ctx);
 		ui_cleanup();
 		cleanup_openssl();
@@ -340,17 +873,19 @@ int main(int argc, char *argv[])
 	}
 
 	printf("Connected to server securely.\n");
-	log_print(LOG_INFO, "Connected to server via SSL");
 
 	// --- AUTH ---
 	int authenticated = 0;
-	LoginPayload session;
 
-	if (load_session(&session))
+	if (have_session)
 	{
-		if (service_login(session.email, session.password))
+		int resumed = (early_sent && SSL_get_early_data_status(app.ssl) == SSL_EARLY_DATA_ACCEPTED)
+						  ? service_await_login()
+						  : service_resume(&session);
+		if (resumed)
 		{
 			authenticated = 1;
+			save_session(&app.session_token); // Refreshed expiry
 		}
 		else
 		{
@@ -358,42 +893,17 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	while (!authenticated)
-	{
-		int choice = ui_draw_start_menu();
-		if (choice == 3)
-		{ // Quit
-			ui_cleanup();
-			app_cleanup(); // CLEAN MEMORY
-			log_close();
-			SSL_shutdown(app.ssl);
-			SSL_free(app.ssl);
-			SSL_CTX_free(app.ctx);
-			close(app.sock_fd);
-			cleanup_openssl();
-			return 0;
-		}
-		if (choice == 2)
-		{ // Register
-			RegisterPayload reg = {0};
-			ui_draw_register(reg.email, reg.username, reg.password);
-			service_register(reg.email, reg.username, reg.password);
-		}
-		if (choice == 1)
-		{ // Login
-			LoginPayload log = {0};
-			int remember = 0;
-			ui_draw_login(log.email, log.password, &remember);
-
-			if (service_login(log.email, log.password))
-			{
-				authenticated = 1;
-				if (remember)
-					save_session(log.email, log.password);
-				else
-					clear_session();
-			}
-		}
+	if (!authenticated && !start_menu())
+	{ // Quit
+		ui_cleanup();
+		app_cleanup(); // CLEAN MEMORY
+		log_close();
+		SSL_shutdown(app.ssl);
+		SSL_free(app.ssl);
+		SSL_CTX_free(app.ctx);
+		close(app.sock_fd);
+		cleanup_openssl();
+		return 0;
 	}
 
 	// --- AFTER AUTHENTICATION ---
@@ -416,13 +926,14 @@ int main(int argc, char *argv[])
 	app.needs_redraw = 1;
 	app.current_state = STATE_HOME;
 
-	service_refresh_contacts();
-	service_refresh_requests();
-	service_req_conversations();
+	// Contacts, requests and conversations arrive in MSG_BOOTSTRAP,
+	// requested together with the login
+	service_subscribe_presence();
 
 	int selection = 0;
 	int group_selection_idx = 0;
-	int group_members_selected[100] = {0};
+	int *group_members_selected = NULL; // One flag per contact (see fit_selection)
+	int group_selected_cap = 0;
 	char group_name_buf[32] = "New Group";
 	char group_desc_buf[64] = "Description";
 
@@ -443,7 +954,10 @@ int main(int argc, char *argv[])
 			else if (app.current_state == STATE_REQUESTS)
 				ui_draw_requests(app.requests, app.requests_count, selection);
 			else if (app.current_state == STATE_CREATE_GROUP)
-				ui_draw_create_group_form(group_name_buf, group_desc_buf, app.contacts, app.contacts_count, group_members_selected, group_selection_idx);
+			{
+				int shown = fit_selection(&group_members_selected, &group_selected_cap, app.contacts_count);
+				ui_draw_create_group_form(group_name_buf, group_desc_buf, app.contacts, shown, group_members_selected, group_selection_idx);
+			}
 			else if (app.current_state == STATE_GROUP_SETTINGS)
 			{
 				ConversationSummary *c = NULL;
@@ -479,7 +993,21 @@ int main(int argc, char *argv[])
 			app.needs_redraw = 0;
 		}
 
-		// 2. INPUT
+		// 2. INPUT (getch() times out, so probes go out while idle too)
+		service_health_tick();
+		reconnect_if_due(&config, &th);
+		if (app.current_state == STATE_START)
+		{
+			// The session was refused on reconnect: log in again
+			if (!start_menu())
+				break;
+			pthread_create(&th, NULL, network_thread, NULL);
+			service_subscribe_presence();
+			app.current_state = STATE_HOME;
+			app.needs_redraw = 1;
+			selection = 0;
+			continue;
+		}
 		int ch = getch();
 		if (ch == ERR)
 			continue;
@@ -497,7 +1025,8 @@ int main(int argc, char *argv[])
 			{
 				app.current_state = STATE_CREATE_GROUP;
 				group_selection_idx = 0;
-				memset(group_members_selected, 0, sizeof(group_members_selected));
+				if (group_members_selected)
+					memset(group_members_selected, 0, group_selected_cap * sizeof(int));
 				strcpy(group_name_buf, "My Group");
 				strcpy(group_desc_buf, "");
 			}
@@ -510,8 +1039,8 @@ int main(int argc, char *argv[])
 			}
 			if (ch == 10 || ch == 13)
 			{
-				if (app.conv_count > 0 && app.conversations)
-				{ // Check NULL
+				if (selection < app.conv_count && app.conversations)
+				{ // The list may have shrunk under the selection
 					app.current_conv_id = app.conversations[selection].conv_id;
 					strncpy(app.current_conv_name, app.conversations[selection].name, 32);
 
@@ -586,13 +1115,14 @@ int main(int argc, char *argv[])
 		}
 		else if (app.current_state == STATE_CREATE_GROUP)
 		{
+			int shown = fit_selection(&group_members_selected, &group_selected_cap, app.contacts_count);
 			if (ch == 27)
 				app.current_state = STATE_HOME;
-			if (ch == KEY_DOWN && group_selection_idx < app.contacts_count - 1)
+			if (ch == KEY_DOWN && group_selection_idx < shown - 1)
 				group_selection_idx++;
 			if (ch == KEY_UP && group_selection_idx > 0)
 				group_selection_idx--;
-			if (ch == ' ')
+			if (ch == ' ' && group_selection_idx < shown)
 				group_members_selected[group_selection_idx] = !group_members_selected[group_selection_idx];
 			if (ch == 'n' || ch == 'N')
 				ui_input_string(3, 16, "Group Name: ", group_name_buf, 31);
@@ -600,15 +1130,16 @@ int main(int argc, char *argv[])
 				ui_input_string(4, 17, "Description: ", group_desc_buf, 63);
 			if (ch == 10 || ch == 13)
 			{
-				uint32_t selected_uids[MAX_PARTICIPANTS];
+				uint32_t *selected_uids = malloc((shown + 1) * sizeof(uint32_t));
 				int count = 0;
-				for (int i = 0; i < app.contacts_count; i++)
+				for (int i = 0; selected_uids && i < shown; i++)
 				{
 					if (group_members_selected[i])
 						selected_uids[count++] = app.contacts[i].uid;
 				}
-				if (service_create_group(group_name_buf, group_desc_buf, selected_uids, count))
+				if (selected_uids && service_create_group(group_name_buf, group_desc_buf, selected_uids, count))
 					app.current_state = STATE_HOME;
+				free(selected_uids);
 			}
 		}
 		else if (app.current_state == STATE_FRIENDS)
@@ -678,6 +1209,14 @@ int main(int argc, char *argv[])
 					app_remove_request(selection);
 				}
 			}
+			if (ch == 'a' || ch == 'A')
+			{
+				if (app.requests_count > 0 && app.requests)
+				{
+					service_accept_all_requests();
+					selection = 0;
+				}
+			}
 		}
 		else if (app.current_state == STATE_GROUP_SETTINGS)
 		{
@@ -740,7 +1279,9 @@ int main(int argc, char *argv[])
 	}
 
 	ui_cleanup();
+	free(group_members_selected);
 	app_cleanup(); // CLEAN MEMORY
+	service_health_report();
 	log_print(LOG_INFO, "Client shutting down");
 	log_close();
 
@@ -11,7 +11,7 @@ int service_register(const char *email, const char *username, const char *passwo
     strncpy(reg.username, username, MAX_NAME_LEN - 1);
     strncpy(reg.password, password, MAX_PASS_LEN - 1);
 
-    send_packet(app.ssl, MSG_REGISTER, &reg, sizeof(reg));
+    app_send(MSG_REGISTER, &reg, sizeof(reg));
 
     // Wait for response (Blocking)
     MessageType type;
@@ -27,21 +27,17 @@ int service_register(const char *email, const char *username, const char *passwo
     return 0;
 }
 
-int service_login(const char *email, const char *password)
+int service_await_login(void)
 {
-    LoginPayload log = {0};
-    strncpy(log.email, email, MAX_EMAIL_LEN - 1);
-    strncpy(log.password, password, MAX_PASS_LEN - 1);
-
-    send_packet(app.ssl, MSG_LOGIN, &log, sizeof(log));
-
     MessageType type;
     void *p = NULL;
     uint32_t len;
 
     if (recv_packet(app.ssl, &type, &p, &len) > 0) {
-        if (type == MSG_LOGIN_SUCCESS && p) {
-            memcpy(&app.my_info, p, sizeof(MyInfoPayload));
+        if (type == MSG_LOGIN_SUCCESS && p && len >= sizeof(LoginSuccessPayload)) {
+            LoginSuccessPayload *resp = (LoginSuccessPayload *)p;
+            memcpy(&app.my_info, &resp->me, sizeof(MyInfoPayload));
+            memcpy(&app.session_token, &resp->token, sizeof(SessionToken));
             free(p);
             return 1;
         }
@@ -50,6 +46,64 @@ int service_login(const char *email, const char *password)
     return 0;
 }
 
+// Sends the bootstrap request and waits for the answer to the login frame
+// sent just before it
+static int finish_login(void)
+{
+    // Pipelined: the home screen snapshot follows MSG_LOGIN_SUCCESS without
+    // another round trip. The server ignores it if the login fails.
+    BootstrapRequestPayload boot;
+    boot.known_version = app.bootstrap_version;
+    app_send(MSG_REQ_BOOTSTRAP, &boot, sizeof(boot));
+    return service_await_login();
+}
+
+int service_login(const char *email, const char *password)
+{
+    LoginPayload log = {0};
+    strncpy(log.email, email, MAX_EMAIL_LEN - 1);
+    strncpy(log.password, password, MAX_PASS_LEN - 1);
+
+    app_send(MSG_LOGIN, &log, sizeof(log));
+    return finish_login();
+}
+
+int service_resume(const SessionToken *token)
+{
+    app_send(MSG_RESUME, token, sizeof(SessionToken));
+    return finish_login();
+}
+
+int service_resume_early(const SessionToken *token)
+{
+    SSL_SESSION *sess = SSL_get_session(app.ssl);
+    if (!sess)
+        return 0;
+
+    uint8_t *frames = NULL;
+    uint32_t len = 0;
+    BootstrapRequestPayload boot;
+    boot.known_version = app.bootstrap_version;
+    if (frame_append(&frames, &len, MSG_RESUME, token, sizeof(SessionToken)) < 0 ||
+        frame_append(&frames, &len, MSG_REQ_BOOTSTRAP, &boot, sizeof(boot)) < 0) {
+        free(frames);
+        return 0;
+    }
+
+    // The server advertises its limit in the ticket; 0 means not enabled
+    if (SSL_SESSION_get_max_early_data(sess) < len) {
+        free(frames);
+        return 0;
+    }
+
+    size_t written = 0;
+    int ok = SSL_write_early_data(app.ssl, frames, len, &written) && written == len;
+    free(frames);
+    if (ok)
+        log_print(LOG_INFO, "Sent session resume as TLS early data");
+    return ok;
+}
+
 void service_logout(void)
 {
     clear_session();
@@ -62,5 +116,5 @@ void service_update_user(const char *username, const char *password)
     if (username) strncpy(up.new_username, username, MAX_NAME_LEN - 1);
     if (password) strncpy(up.new_password, password, MAX_PASS_LEN - 1);
     
-    send_packet(app.ssl, MSG_UPDATE_USER, &up, sizeof(up));
+    app_send(MSG_UPDATE_USER, &up, sizeof(up));
 }
\ No newline at end of file
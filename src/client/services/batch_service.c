@@ -0,0 +1,47 @@
+#include "services/batch_service.h"
+#include "infrastructure/client_context.h"
+#include "system/logger.h"
+#include <stdlib.h>
+
+void service_batch_init(BatchBuilder *b)
+{
+    b->buf = NULL;
+    b->len = 0;
+    b->count = 0;
+}
+
+int service_batch_add(BatchBuilder *b, MessageType type, const void *payload, uint32_t len)
+{
+    if (b->count >= MAX_BATCH_OPS) return 0;
+    if (frame_append(&b->buf, &b->len, type, payload, len) < 0) return 0;
+    b->count++;
+    return 1;
+}
+
+void service_batch_send(BatchBuilder *b)
+{
+    if (b->count > 0) {
+        app_send(MSG_BATCH_REQUEST, b->buf, b->len);
+        log_print(LOG_INFO, "Sent batch of %d requests", b->count);
+    }
+    free(b->buf);
+    service_batch_init(b);
+}
+
+void service_accept_all_requests(void)
+{
+    BatchBuilder b;
+    service_batch_init(&b);
+
+    pthread_mutex_lock(&app.state_lock);
+    for (int i = 0; i < app.requests_count; i++) {
+        DecideRequestPayload p;
+        p.target_uid = app.requests[i].uid;
+        p.accepted = 1;
+        if (!service_batch_add(&b, MSG_DECIDE_REQUEST, &p, sizeof(p)))
+            break;
+    }
+    pthread_mutex_unlock(&app.state_lock);
+
+    service_batch_send(&b);
+}
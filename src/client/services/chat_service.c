@@ -12,12 +12,19 @@ void service_send_text(uint32_t conv_id, const char *text)
     strncpy(msg.text, text, MAX_TEXT_LEN - 1);
     msg.text[MAX_TEXT_LEN - 1] = '\0';
     
-    send_packet(app.ssl, MSG_SEND_TEXT, &msg, sizeof(msg));
+    app_send(MSG_SEND_TEXT, &msg, sizeof(msg));
 }
 
 void service_req_history(uint32_t conv_id)
 {
     RequestHistoryPayload hp;
     hp.conv_id = conv_id;
-    send_packet(app.ssl, MSG_REQ_HISTORY, &hp, sizeof(hp));
-}
\ No newline at end of file
+    app_send(MSG_REQ_HISTORY, &hp, sizeof(hp));
+}
+
+void service_ack_offline(uint32_t last_message_id)
+{
+    OfflineAckPayload ack;
+    ack.last_message_id = last_message_id;
+    app_send(MSG_OFFLINE_ACK, &ack, sizeof(ack));
+}
@@ -0,0 +1,120 @@
+#include "services/health_service.h"
+#include "infrastructure/client_context.h"
+#include "system/logger.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Most recent samples, kept for the percentiles of the session summary
+#define HEALTH_SAMPLES 4096
+
+static pthread_mutex_t health_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t next_probe_us = 0;
+static uint64_t last_reply_us = 0; // Last pong (or the first probe)
+static uint64_t sent = 0;
+static uint64_t received = 0;
+
+// Smoothed like TCP (RFC 6298): srtt gains 1/8, rttvar (the jitter) 1/4
+static double srtt_us = 0;
+static double rttvar_us = 0;
+
+static uint32_t samples[HEALTH_SAMPLES];
+static char label[48] = "";
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Caller holds health_lock
+static void update_label(uint64_t now) {
+    char next[sizeof(label)] = "";
+    int stalled = sent > received && now - last_reply_us >= (uint64_t)HEALTH_STALL_PROBES * HEALTH_PROBE_MS * 1000;
+
+    if (stalled)
+        snprintf(next, sizeof(next), "no reply %llus", (unsigned long long)((now - last_reply_us) / 1000000));
+    else if (received > 0)
+        snprintf(next, sizeof(next), "RTT %.0f ms +/-%.0f", srtt_us / 1000.0, rttvar_us / 1000.0);
+
+    if (strcmp(next, label) != 0) {
+        strcpy(label, next);
+        ui_set_link_status(label, stalled);
+        if (app.current_state == STATE_CHAT)
+            app.needs_redraw = 1;
+    }
+}
+
+void service_health_tick(void) {
+    uint64_t now = now_us();
+
+    pthread_mutex_lock(&health_lock);
+    if (now < next_probe_us) {
+        update_label(now);
+        pthread_mutex_unlock(&health_lock);
+        return;
+    }
+    if (sent == 0)
+        last_reply_us = now;
+    next_probe_us = now + HEALTH_PROBE_MS * 1000;
+    sent++;
+    update_label(now);
+    pthread_mutex_unlock(&health_lock);
+
+    PingPayload ping = {now};
+    app_send(MSG_PING, &ping, sizeof(ping));
+}
+
+void service_health_on_pong(const PingPayload *pong) {
+    uint64_t now = now_us();
+    if (pong->stamp == 0 || pong->stamp > now)
+        return; // Not one of ours
+
+    double rtt = (double)(now - pong->stamp);
+
+    pthread_mutex_lock(&health_lock);
+    if (received == 0) {
+        srtt_us = rtt;
+        rttvar_us = rtt / 2;
+    } else {
+        double delta = rtt > srtt_us ? rtt - srtt_us : srtt_us - rtt;
+        rttvar_us += (delta - rttvar_us) / 4;
+        srtt_us += (rtt - srtt_us) / 8;
+    }
+    samples[received % HEALTH_SAMPLES] = (uint32_t)(rtt > UINT32_MAX ? UINT32_MAX : rtt);
+    received++;
+    last_reply_us = now;
+    update_label(now);
+    pthread_mutex_unlock(&health_lock);
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+void service_health_report(void) {
+    pthread_mutex_lock(&health_lock);
+    uint64_t lost = sent > received ? sent - received : 0;
+    size_t n = received < HEALTH_SAMPLES ? (size_t)received : HEALTH_SAMPLES;
+    uint32_t *sorted = n > 0 ? malloc(n * sizeof(uint32_t)) : NULL;
+    if (sorted)
+        memcpy(sorted, samples, n * sizeof(uint32_t));
+    double srtt = srtt_us, jitter = rttvar_us;
+    pthread_mutex_unlock(&health_lock);
+
+    if (!sorted) {
+        log_print(LOG_INFO, "Link health: %llu probes, no reply", (unsigned long long)sent);
+        return;
+    }
+
+    qsort(sorted, n, sizeof(uint32_t), compare_u32);
+    log_print(LOG_INFO, "Link health: %llu probes, %llu lost, RTT p50 %.1f / p90 %.1f / p99 %.1f / max %.1f ms, smoothed %.1f ms, jitter %.1f ms",
+              (unsigned long long)sent, (unsigned long long)lost,
+              sorted[n / 2] / 1000.0, sorted[n * 9 / 10] / 1000.0, sorted[n * 99 / 100] / 1000.0, sorted[n - 1] / 1000.0,
+              srtt / 1000.0, jitter / 1000.0);
+    free(sorted);
+}
@@ -1,31 +1,98 @@
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <openssl/pem.h>
 #include "system/protocol.h"
+#include "system/config_loader.h"
+#include "system/logger.h"
 
 #define SESSION_FILE "session.dat"
+#define TLS_SESSION_FILE "tls_session.pem"
 
-// Save credentials (In prod, use an OS keychain, not a file)
-void save_session(const char *email, const char *password) {
-    FILE *f = fopen(SESSION_FILE, "wb");
+// Older versions wrote the token in the working directory
+#define LEGACY_SESSION_FILE "session.dat"
+
+// Opens ~/.mot/<name> for writing, readable by the user only (even if it
+// existed with wider permissions)
+static FILE *open_private(const char *name) {
+    char path[512];
+    config_get_client_file(name, path, sizeof(path));
+
+    char *slash = strrchr(path, '/');
+    if (slash) {
+        *slash = '\0';
+        mkdir(path, 0700);
+        *slash = '/';
+    }
+
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return NULL;
+    fchmod(fd, 0600);
+    FILE *f = fdopen(fd, "wb");
+    if (!f) close(fd);
+    return f;
+}
+
+// Save the server-issued token; the password itself is never stored
+void save_session(const SessionToken *token) {
+    FILE *f = open_private(SESSION_FILE);
     if (f) {
-        LoginPayload p;
-        strncpy(p.email, email, MAX_EMAIL_LEN);
-        strncpy(p.password, password, MAX_PASS_LEN);
-        fwrite(&p, sizeof(LoginPayload), 1, f);
+        fwrite(token, sizeof(SessionToken), 1, f);
         fclose(f);
     }
+    remove(LEGACY_SESSION_FILE);
 }
 
-// Returns 1 if session found and loaded into payload
-int load_session(LoginPayload *p) {
-    FILE *f = fopen(SESSION_FILE, "rb");
+// Returns 1 if session found and loaded into token
+int load_session(SessionToken *token) {
+    char path[512];
+    config_get_client_file(SESSION_FILE, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
     if (!f) return 0;
     
-    size_t read = fread(p, sizeof(LoginPayload), 1, f);
+    size_t read = fread(token, sizeof(SessionToken), 1, f);
     fclose(f);
     return (read == 1);
 }
 
 void clear_session() {
-    remove(SESSION_FILE);
-}
\ No newline at end of file
+    char path[512];
+    config_get_client_file(SESSION_FILE, path, sizeof(path));
+    remove(path);
+    remove(LEGACY_SESSION_FILE);
+}
+
+// --- TLS session cache ---
+
+// Called by OpenSSL whenever the server hands out a new ticket
+static int on_new_tls_session(SSL *ssl, SSL_SESSION *sess) {
+    (void)ssl;
+    FILE *f = open_private(TLS_SESSION_FILE);
+    if (f) {
+        PEM_write_SSL_SESSION(f, sess);
+        fclose(f);
+    }
+    return 0; // We did not keep a reference
+}
+
+void tls_session_enable_cache(SSL_CTX *ctx) {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, on_new_tls_session);
+}
+
+int tls_session_offer(SSL *ssl) {
+    char path[512];
+    config_get_client_file(TLS_SESSION_FILE, path, sizeof(path));
+
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    SSL_SESSION *sess = PEM_read_SSL_SESSION(f, NULL, NULL, NULL);
+    fclose(f);
+    if (!sess) return 0;
+
+    int ok = SSL_set_session(ssl, sess);
+    SSL_SESSION_free(sess);
+    return ok;
+}
@@ -9,6 +9,10 @@ static WINDOW *win_main;
 static pthread_mutex_t ui_lock = PTHREAD_MUTEX_INITIALIZER;
 static int width, height;
 
+// Drawn in the chat header (see ui_set_link_status)
+static char link_status[48] = "";
+static int link_alarm = 0;
+
 void ui_init()
 {
 	initscr();
@@ -205,7 +209,8 @@ void ui_draw_home_conversations(ConversationSummary *convs, int count, int selec
 	for (int i = 0; i < count; i++)
 	{
 		char label[128];
-		char type_indicator = (convs[i].type == CONV_TYPE_GROUP) ? '#' : '@';
+		char type_indicator = (convs[i].type == CONV_TYPE_GROUP) ? '#' : (convs[i].type == CONV_TYPE_TELEMETRY) ? '~' :
+													(convs[i].type == CONV_TYPE_BROADCAST) ? '!' : '@';
 
 		if (convs[i].unread_count > 0)
 			snprintf(label, 128, "%c %s (%d)", type_indicator, convs[i].name, convs[i].unread_count);
@@ -296,21 +301,36 @@ void ui_draw_friends_list(ContactSummary *contacts, int count, int selection_idx
 
 	for (int i = 0; i < count; i++)
 	{
+		const char *status = contacts[i].is_online ? "(online)" : "";
 		if (i == selection_idx)
 		{
 			wattron(win_main, COLOR_PAIR(2));
-			mvwprintw(win_main, 3 + i, 4, "> %s ", contacts[i].username);
+			mvwprintw(win_main, 3 + i, 4, "> %s %s", contacts[i].username, status);
 			wattroff(win_main, COLOR_PAIR(2));
 		}
 		else
 		{
 			mvwprintw(win_main, 3 + i, 4, "  %s ", contacts[i].username);
+			if (contacts[i].is_online)
+			{
+				wattron(win_main, COLOR_PAIR(2));
+				wprintw(win_main, "%s", status);
+				wattroff(win_main, COLOR_PAIR(2));
+			}
 		}
 	}
 	wrefresh(win_main);
 	pthread_mutex_unlock(&ui_lock);
 }
 
+void ui_set_link_status(const char *status, int alarm)
+{
+	pthread_mutex_lock(&ui_lock);
+	strncpy(link_status, status, sizeof(link_status) - 1);
+	link_alarm = alarm;
+	pthread_mutex_unlock(&ui_lock);
+}
+
 void ui_draw_chat(const char *conv_name, const char *history, const char *current_input)
 {
 	pthread_mutex_lock(&ui_lock);
@@ -322,7 +342,10 @@ void ui_draw_chat(const char *conv_name, const char *history, const char *curren
 
 	const char *help_text = "[F1] Settings  [ESC] Back";
 	int help_len = strlen(help_text);
-	int max_title_len = width - help_len - 5;
+	int link_len = strlen(link_status);
+	if (width - help_len - link_len - 7 < 16)
+		link_len = 0; // Too narrow: the title comes first
+	int max_title_len = width - help_len - (link_len > 0 ? link_len + 2 : 0) - 5;
 
 	if ((int)strlen(title) > max_title_len)
 	{
@@ -338,6 +361,14 @@ void ui_draw_chat(const char *conv_name, const char *history, const char *curren
 
 	mvwprintw(win_main, 1, width - help_len - 2, "%s", help_text);
 
+	if (link_len > 0)
+	{
+		int attr = COLOR_PAIR(link_alarm ? 3 : 2);
+		wattron(win_main, attr);
+		mvwprintw(win_main, 1, width - help_len - link_len - 4, "%s", link_status);
+		wattroff(win_main, attr);
+	}
+
 	char temp_hist[16384];
 	strncpy(temp_hist, history, 16384);
 	temp_hist[16383] = '\0';
@@ -394,7 +425,7 @@ void ui_draw_requests(ContactSummary *requests, int count, int selection_idx)
 	wattron(win_main, COLOR_PAIR(1));
 	mvwprintw(win_main, 1, 2, " REQUESTS ");
 	wattroff(win_main, COLOR_PAIR(1));
-	mvwprintw(win_main, height - 2, 2, "[Enter] Accept  [Del] Deny  [Back] Return");
+	mvwprintw(win_main, height - 2, 2, "[Enter] Accept  [A] Accept All  [Del] Deny  [Back] Return");
 
 	if (count == 0)
 		mvwprintw(win_main, 3, 4, "(No pending requests)");
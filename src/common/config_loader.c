@@ -23,7 +23,7 @@ static char *trim_whitespace(char *str)
 	return str;
 }
 
-void config_get_client_path(char *buffer, size_t size)
+void config_get_client_file(const char *name, char *buffer, size_t size)
 {
 	const char *home = getenv("HOME");
 	if (!home)
@@ -35,7 +35,12 @@ void config_get_client_path(char *buffer, size_t size)
 	if (!home)
 		home = "."; // Fallback
 
-	snprintf(buffer, size, "%s/.mot/config.conf", home);
+	snprintf(buffer, size, "%s/.mot/%s", home, name);
+}
+
+void config_get_client_path(char *buffer, size_t size)
+{
+	config_get_client_file("config.conf", buffer, size);
 }
 
 void apply_defaults(AppConfig *config)
@@ -44,6 +49,52 @@ void apply_defaults(AppConfig *config)
 	strncpy(config->server_host, DEFAULT_HOST, sizeof(config->server_host) - 1);
 	config->ca_cert_path[0] = '\0';
 	config->db_encryption_key[0] = '\0';
+	config->session_key[0] = '\0';
+	config->session_ttl = DEFAULT_SESSION_TTL;
+	config->ticket_key[0] = '\0';
+	config->ticket_rotation = DEFAULT_TICKET_ROTATION;
+	config->early_data = 0;
+	config->early_data_max = 0;
+	config->ktls = 0;
+	config->plain_port = 0;
+	config->unix_socket[0] = '\0';
+	config->gateway = 0;
+	config->gateway_max_sessions = DEFAULT_GATEWAY_SESSIONS;
+	config->telemetry_rate = DEFAULT_TELEMETRY_RATE;
+	config->telemetry_retention = DEFAULT_TELEMETRY_RETENTION;
+	strncpy(config->topic_user_root, DEFAULT_TOPIC_USER_ROOT, sizeof(config->topic_user_root) - 1);
+	strncpy(config->topic_conv_root, DEFAULT_TOPIC_CONV_ROOT, sizeof(config->topic_conv_root) - 1);
+	config->topic_retained_max = DEFAULT_TOPIC_RETAINED_MAX;
+	config->topic_retained_kb = DEFAULT_TOPIC_RETAINED_KB;
+	config->fanout_workers = DEFAULT_FANOUT_WORKERS;
+	config->fanout_shard = DEFAULT_FANOUT_SHARD;
+	config->executor_threads = DEFAULT_EXECUTOR_THREADS;
+	config->rate_messages = DEFAULT_RATE_MESSAGES;
+	config->burst_messages = DEFAULT_BURST_MESSAGES;
+	config->rate_queries = DEFAULT_RATE_QUERIES;
+	config->burst_queries = DEFAULT_BURST_QUERIES;
+	config->rate_auth = DEFAULT_RATE_AUTH;
+	config->burst_auth = DEFAULT_BURST_AUTH;
+	config->rate_telemetry = DEFAULT_RATE_TELEMETRY;
+	config->burst_telemetry = DEFAULT_BURST_TELEMETRY;
+	config->overload_lag_ms = DEFAULT_OVERLOAD_LAG_MS;
+	config->overload_backlog = DEFAULT_OVERLOAD_BACKLOG;
+	config->handshake_timeout = DEFAULT_HANDSHAKE_TIMEOUT;
+	config->heartbeat_interval = DEFAULT_HEARTBEAT_INTERVAL;
+	config->idle_timeout = DEFAULT_IDLE_TIMEOUT;
+	config->listen_backlog = DEFAULT_LISTEN_BACKLOG;
+	config->max_connections = DEFAULT_MAX_CONNECTIONS;
+	config->max_connections_per_ip = DEFAULT_MAX_CONNECTIONS_PER_IP;
+	config->tcp_keepalive = DEFAULT_TCP_KEEPALIVE;
+	config->handoff_socket[0] = '\0';
+	config->drain_timeout = DEFAULT_DRAIN_TIMEOUT;
+	config->reconnect_spread = DEFAULT_RECONNECT_SPREAD;
+	strncpy(config->log_level, DEFAULT_LOG_LEVEL, sizeof(config->log_level) - 1);
+	config->db_wal = 1;
+	strncpy(config->db_synchronous, DEFAULT_DB_SYNCHRONOUS, sizeof(config->db_synchronous) - 1);
+	config->db_cache_kb = DEFAULT_DB_CACHE_KB;
+	config->db_mmap_mb = 0;
+	config->db_maintenance = DEFAULT_DB_MAINTENANCE;
 
 	strncpy(config->db_path, DEFAULT_DB_PATH, sizeof(config->db_path) - 1);
 	strncpy(config->server_cert_path, "server.crt", sizeof(config->server_cert_path) - 1);
@@ -104,6 +155,194 @@ int config_load(const char *path, AppConfig *config)
 			{
 				strncpy(config->db_encryption_key, val, sizeof(config->db_encryption_key) - 1);
 			}
+			else if (strcmp(key, "session_key") == 0)
+			{
+				strncpy(config->session_key, val, sizeof(config->session_key) - 1);
+			}
+			else if (strcmp(key, "session_ttl") == 0)
+			{
+				config->session_ttl = atoi(val);
+			}
+			else if (strcmp(key, "ticket_key") == 0)
+			{
+				strncpy(config->ticket_key, val, sizeof(config->ticket_key) - 1);
+			}
+			else if (strcmp(key, "ticket_rotation") == 0)
+			{
+				config->ticket_rotation = atoi(val);
+			}
+			else if (strcmp(key, "early_data") == 0)
+			{
+				config->early_data = atoi(val);
+			}
+			else if (strcmp(key, "early_data_max") == 0)
+			{
+				config->early_data_max = atoi(val);
+			}
+			else if (strcmp(key, "ktls") == 0)
+			{
+				config->ktls = atoi(val);
+			}
+			else if (strcmp(key, "plain_port") == 0)
+			{
+				config->plain_port = atoi(val);
+			}
+			else if (strcmp(key, "unix_socket") == 0)
+			{
+				strncpy(config->unix_socket, val, sizeof(config->unix_socket) - 1);
+			}
+			else if (strcmp(key, "gateway") == 0)
+			{
+				config->gateway = atoi(val);
+			}
+			else if (strcmp(key, "gateway_max_sessions") == 0)
+			{
+				config->gateway_max_sessions = atoi(val);
+			}
+			else if (strcmp(key, "telemetry_rate") == 0)
+			{
+				config->telemetry_rate = atoi(val);
+			}
+			else if (strcmp(key, "telemetry_retention") == 0)
+			{
+				config->telemetry_retention = atoi(val);
+			}
+			else if (strcmp(key, "topic_user_root") == 0)
+			{
+				strncpy(config->topic_user_root, val, sizeof(config->topic_user_root) - 1);
+			}
+			else if (strcmp(key, "topic_conv_root") == 0)
+			{
+				strncpy(config->topic_conv_root, val, sizeof(config->topic_conv_root) - 1);
+			}
+			else if (strcmp(key, "topic_public_root") == 0)
+			{
+				strncpy(config->topic_public_root, val, sizeof(config->topic_public_root) - 1);
+			}
+			else if (strcmp(key, "topic_retained_max") == 0)
+			{
+				config->topic_retained_max = atoi(val);
+			}
+			else if (strcmp(key, "topic_retained_kb") == 0)
+			{
+				config->topic_retained_kb = atoi(val);
+			}
+			else if (strcmp(key, "fanout_workers") == 0)
+			{
+				config->fanout_workers = atoi(val);
+			}
+			else if (strcmp(key, "fanout_shard") == 0)
+			{
+				config->fanout_shard = atoi(val);
+			}
+			else if (strcmp(key, "executor_threads") == 0)
+			{
+				config->executor_threads = atoi(val);
+			}
+			else if (strcmp(key, "rate_messages") == 0)
+			{
+				config->rate_messages = atoi(val);
+			}
+			else if (strcmp(key, "burst_messages") == 0)
+			{
+				config->burst_messages = atoi(val);
+			}
+			else if (strcmp(key, "rate_queries") == 0)
+			{
+				config->rate_queries = atoi(val);
+			}
+			else if (strcmp(key, "burst_queries") == 0)
+			{
+				config->burst_queries = atoi(val);
+			}
+			else if (strcmp(key, "rate_auth") == 0)
+			{
+				config->rate_auth = atoi(val);
+			}
+			else if (strcmp(key, "burst_auth") == 0)
+			{
+				config->burst_auth = atoi(val);
+			}
+			else if (strcmp(key, "rate_telemetry") == 0)
+			{
+				config->rate_telemetry = atoi(val);
+			}
+			else if (strcmp(key, "burst_telemetry") == 0)
+			{
+				config->burst_telemetry = atoi(val);
+			}
+			else if (strcmp(key, "overload_lag_ms") == 0)
+			{
+				config->overload_lag_ms = atoi(val);
+			}
+			else if (strcmp(key, "overload_backlog") == 0)
+			{
+				config->overload_backlog = atoi(val);
+			}
+			else if (strcmp(key, "handshake_timeout") == 0)
+			{
+				config->handshake_timeout = atoi(val);
+			}
+			else if (strcmp(key, "heartbeat_interval") == 0)
+			{
+				config->heartbeat_interval = atoi(val);
+			}
+			else if (strcmp(key, "idle_timeout") == 0)
+			{
+				config->idle_timeout = atoi(val);
+			}
+			else if (strcmp(key, "listen_backlog") == 0)
+			{
+				config->listen_backlog = atoi(val);
+			}
+			else if (strcmp(key, "max_connections") == 0)
+			{
+				config->max_connections = atoi(val);
+			}
+			else if (strcmp(key, "max_connections_per_ip") == 0)
+			{
+				config->max_connections_per_ip = atoi(val);
+			}
+			else if (strcmp(key, "tcp_keepalive") == 0)
+			{
+				config->tcp_keepalive = atoi(val);
+			}
+			else if (strcmp(key, "handoff_socket") == 0)
+			{
+				strncpy(config->handoff_socket, val, sizeof(config->handoff_socket) - 1);
+			}
+			else if (strcmp(key, "drain_timeout") == 0)
+			{
+				config->drain_timeout = atoi(val);
+			}
+			else if (strcmp(key, "reconnect_spread") == 0)
+			{
+				config->reconnect_spread = atoi(val);
+			}
+			else if (strcmp(key, "log_level") == 0)
+			{
+				strncpy(config->log_level, val, sizeof(config->log_level) - 1);
+			}
+			else if (strcmp(key, "db_wal") == 0)
+			{
+				config->db_wal = atoi(val);
+			}
+			else if (strcmp(key, "db_synchronous") == 0)
+			{
+				strncpy(config->db_synchronous, val, sizeof(config->db_synchronous) - 1);
+			}
+			else if (strcmp(key, "db_cache_kb") == 0)
+			{
+				config->db_cache_kb = atoi(val);
+			}
+			else if (strcmp(key, "db_mmap_mb") == 0)
+			{
+				config->db_mmap_mb = atoi(val);
+			}
+			else if (strcmp(key, "db_maintenance") == 0)
+			{
+				config->db_maintenance = atoi(val);
+			}
 		}
 	}
 	fclose(f);
@@ -12,6 +12,12 @@ static FILE *log_file = NULL;
 static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
 static char log_basename[64];
 static char current_log_date[16]; // Stores "YYYY-MM-DD"
+static LogLevel min_level = LOG_DEBUG;
+
+// Severity order (the enum puts DEBUG last)
+static int severity(LogLevel level) {
+    return level == LOG_DEBUG ? 0 : (int)level + 1;
+}
 
 // Helper to get current date string
 static void get_date_str(char *buffer, size_t size) {
@@ -114,8 +120,30 @@ void log_close(void) {
     pthread_mutex_unlock(&log_mutex);
 }
 
+void log_set_level(LogLevel min) {
+    pthread_mutex_lock(&log_mutex);
+    min_level = min;
+    pthread_mutex_unlock(&log_mutex);
+}
+
+int log_level_from_name(const char *name, LogLevel *out) {
+    static const struct { const char *name; LogLevel level; } names[] = {
+        {"debug", LOG_DEBUG}, {"info", LOG_INFO}, {"warn", LOG_WARN}, {"error", LOG_ERROR}};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(name, names[i].name) == 0) {
+            *out = names[i].level;
+            return 1;
+        }
+    }
+    return 0;
+}
+
 void log_message_internal(LogLevel level, const char *file, int line, const char *fmt, ...) {
     pthread_mutex_lock(&log_mutex);
+    if (severity(level) < severity(min_level)) {
+        pthread_mutex_unlock(&log_mutex);
+        return;
+    }
 
     // Check for rotation before writing
     open_log_file();
@@ -4,6 +4,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <openssl/core_names.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
 #include "system/protocol.h"
 
 // --- SSL HELPERS ---
@@ -36,25 +44,34 @@ SSL_CTX *create_context(int is_server) {
 }
 
 void configure_context(SSL_CTX *ctx, const char *cert_file, const char *key_file) {
-    if (SSL_CTX_use_certificate_file(ctx, cert_file, SSL_FILETYPE_PEM) <= 0) {
-        ERR_print_errors_fp(stderr);
+    if (!load_certificate(ctx, cert_file, key_file))
         exit(EXIT_FAILURE);
-    }
-    if (SSL_CTX_use_PrivateKey_file(ctx, key_file, SSL_FILETYPE_PEM) <= 0) {
+}
+
+int load_certificate(SSL_CTX *ctx, const char *cert_file, const char *key_file) {
+    if (SSL_CTX_use_certificate_file(ctx, cert_file, SSL_FILETYPE_PEM) <= 0 ||
+        SSL_CTX_use_PrivateKey_file(ctx, key_file, SSL_FILETYPE_PEM) <= 0 ||
+        SSL_CTX_check_private_key(ctx) <= 0) {
         ERR_print_errors_fp(stderr);
-        exit(EXIT_FAILURE);
+        return 0;
     }
+    return 1;
 }
 
 // --- NETWORK OPS ---
 
-int send_all(SSL *ssl, const void *data, size_t len) {
+int send_all(const Transport *t, const void *data, size_t len) {
     const char *ptr = (const char *)data;
     size_t total_sent = 0;
     
     while (total_sent < len) {
-        int sent = SSL_write(ssl, ptr + total_sent, len - total_sent);
+        ssize_t sent;
+        if (t->ssl)
+            sent = SSL_write(t->ssl, ptr + total_sent, len - total_sent);
+        else
+            sent = send(t->fd, ptr + total_sent, len - total_sent, MSG_NOSIGNAL);
         if (sent <= 0) {
+            if (!t->ssl && sent < 0 && errno == EINTR) continue;
             // Handle error (check SSL_get_error if robust, for now assume fail)
             return -1; 
         }
@@ -63,21 +80,191 @@ int send_all(SSL *ssl, const void *data, size_t len) {
     return 0; // Success
 }
 
-int recv_all(SSL *ssl, void *data, size_t len) {
+int recv_all(const Transport *t, void *data, size_t len) {
     char *ptr = (char *)data;
     size_t total_received = 0;
     
     while (total_received < len) {
-        int received = SSL_read(ssl, ptr + total_received, len - total_received);
+        ssize_t received;
+        if (t->ssl)
+            received = SSL_read(t->ssl, ptr + total_received, len - total_received);
+        else
+            received = recv(t->fd, ptr + total_received, len - total_received, 0);
         if (received <= 0) {
+             if (!t->ssl && received < 0 && errno == EINTR) continue;
              // 0 usually means clean shutdown, < 0 error
-             return received;
+             return (int)received;
         }
         total_received += received;
     }
     return 1; // Success
 }
 
+int transport_read_some(const Transport *t, void *data, size_t len) {
+    if (t->ssl) {
+        ERR_clear_error();
+        int n = SSL_read(t->ssl, data, (int)len);
+        if (n > 0) return n;
+        int err = SSL_get_error(t->ssl, n);
+        return (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) ? 0 : -1;
+    }
+    while (1) {
+        ssize_t n = recv(t->fd, data, len, 0);
+        if (n > 0) return (int)n;
+        if (n < 0 && errno == EINTR) continue;
+        return (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+}
+
+int transport_write_some(const Transport *t, const void *data, size_t len) {
+    if (t->ssl) {
+        ERR_clear_error();
+        int n = SSL_write(t->ssl, data, (int)len);
+        if (n > 0) return n;
+        int err = SSL_get_error(t->ssl, n);
+        return (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) ? 0 : -1;
+    }
+    while (1) {
+        ssize_t n = send(t->fd, data, len, MSG_NOSIGNAL);
+        if (n > 0) return (int)n;
+        if (n < 0 && errno == EINTR) continue;
+        return (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+}
+
+// --- SESSION TICKETS ---
+
+// Per context, so a reloaded context never changes the keys of the one
+// still serving older connections
+typedef struct {
+    unsigned char secret[32];
+    int rotation;
+} TicketSecret;
+
+static int ticket_index = -1; // SSL_CTX ex_data slot of the TicketSecret
+
+typedef struct {
+    unsigned char name[16];
+    unsigned char aes_key[32];
+    unsigned char mac_key[32];
+} TicketKey;
+
+// Stateless: every key is recomputed from the secret and the period number
+static void derive_ticket_key(const TicketSecret *ts, long long period, TicketKey *out) {
+    unsigned char input[9];
+    unsigned char digest[32];
+    unsigned int len = sizeof(digest);
+
+    for (int i = 0; i < 8; i++)
+        input[1 + i] = (unsigned char)(period >> (8 * i));
+
+    input[0] = 'n';
+    HMAC(EVP_sha256(), ts->secret, sizeof(ts->secret), input, sizeof(input), digest, &len);
+    memcpy(out->name, digest, sizeof(out->name));
+    input[0] = 'e';
+    HMAC(EVP_sha256(), ts->secret, sizeof(ts->secret), input, sizeof(input), out->aes_key, &len);
+    input[0] = 'm';
+    HMAC(EVP_sha256(), ts->secret, sizeof(ts->secret), input, sizeof(input), out->mac_key, &len);
+}
+
+static void free_ticket_secret(void *parent, void *ptr, CRYPTO_EX_DATA *ad, int idx, long argl, void *argp) {
+    (void)parent; (void)ad; (void)idx; (void)argl; (void)argp;
+    if (ptr) OPENSSL_clear_free(ptr, sizeof(TicketSecret));
+}
+
+static int set_ticket_mac_key(EVP_MAC_CTX *hctx, unsigned char *mac_key) {
+    OSSL_PARAM params[3];
+    params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, mac_key, 32);
+    params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0);
+    params[2] = OSSL_PARAM_construct_end();
+    return EVP_MAC_CTX_set_params(hctx, params);
+}
+
+static int ticket_key_cb(SSL *s, unsigned char key_name[16], unsigned char *iv,
+                         EVP_CIPHER_CTX *ectx, EVP_MAC_CTX *hctx, int enc) {
+    const TicketSecret *ts = SSL_CTX_get_ex_data(SSL_get_SSL_CTX(s), ticket_index);
+    if (!ts) return -1;
+    long long period = time(NULL) / ts->rotation;
+    TicketKey key;
+
+    if (enc) {
+        derive_ticket_key(ts, period, &key);
+        if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) <= 0)
+            return -1;
+        memcpy(key_name, key.name, sizeof(key.name));
+        if (!EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key.aes_key, iv) ||
+            !set_ticket_mac_key(hctx, key.mac_key))
+            return -1;
+        return 1;
+    }
+
+    // Accept the current and the previous period; 2 asks OpenSSL to re-issue
+    for (int age = 0; age < 2; age++) {
+        derive_ticket_key(ts, period - age, &key);
+        if (memcmp(key_name, key.name, sizeof(key.name)) != 0)
+            continue;
+        if (!EVP_DecryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key.aes_key, iv) ||
+            !set_ticket_mac_key(hctx, key.mac_key))
+            return -1;
+        return age == 0 ? 1 : 2;
+    }
+    return 0; // Unknown or expired key: full handshake
+}
+
+int configure_session_tickets(SSL_CTX *ctx, const char *secret, int rotation_seconds, SSL_CTX *previous) {
+    SSL_CTX_set_session_id_context(ctx, (const unsigned char *)"MoT", 3);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+
+    if (!secret || strlen(secret) == 0) {
+        // OpenSSL picked random keys for ctx: take the running ones instead,
+        // or every reload would void the tickets (and 0-RTT) clients hold
+        unsigned char keys[80];
+        if (!previous || SSL_CTX_get_tlsext_ticket_keys(previous, keys, sizeof(keys)) != 1)
+            return 0;
+        int copied = SSL_CTX_set_tlsext_ticket_keys(ctx, keys, sizeof(keys)) == 1;
+        OPENSSL_cleanse(keys, sizeof(keys));
+        return copied ? 2 : 0;
+    }
+
+    if (ticket_index < 0 &&
+        (ticket_index = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, free_ticket_secret)) < 0)
+        return 0;
+    TicketSecret *ts = OPENSSL_zalloc(sizeof(TicketSecret));
+    if (!ts) return 0;
+    ts->rotation = rotation_seconds > 0 ? rotation_seconds : 3600;
+    SHA256((const unsigned char *)secret, strlen(secret), ts->secret);
+    if (!SSL_CTX_set_ex_data(ctx, ticket_index, ts)) {
+        OPENSSL_clear_free(ts, sizeof(TicketSecret));
+        return 0;
+    }
+
+    // A ticket must not outlive the keys able to decrypt it
+    SSL_CTX_set_timeout(ctx, 2 * ts->rotation);
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticket_key_cb);
+    return 1;
+}
+
+// --- KERNEL TLS ---
+
+int configure_ktls(SSL_CTX *ctx) {
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    return 1;
+#else
+    (void)ctx;
+    return 0;
+#endif
+}
+
+int ssl_ktls_status(SSL *ssl) {
+    int status = 0;
+    if (BIO_get_ktls_send(SSL_get_wbio(ssl)))
+        status |= KTLS_SEND;
+    if (BIO_get_ktls_recv(SSL_get_rbio(ssl)))
+        status |= KTLS_RECV;
+    return status;
+}
+
 int load_cert_from_memory(SSL_CTX *ctx, const char *cert_pem) {
     if (!cert_pem || strlen(cert_pem) == 0) return 0;
 
@@ -102,35 +289,38 @@ int load_cert_from_memory(SSL_CTX *ctx, const char *cert_pem) {
     return ret; // 1 Success, 0 Fail
 }
 
-int send_packet(SSL *ssl, MessageType type, const void *payload, uint32_t payload_len) {
-    if (!ssl) return -1;
+int transport_send_packet(const Transport *t, MessageType type, const void *payload, uint32_t payload_len) {
+    if (!t || (!t->ssl && t->fd < 0)) return -1;
     MessageHeader header;
     header.type = htonl(type);
     header.payload_len = htonl(payload_len);
 
-    if (send_all(ssl, &header, sizeof(header)) == -1) return -1;
+    if (send_all(t, &header, sizeof(header)) == -1) return -1;
 
     if (payload_len > 0 && payload != NULL) {
-        if (send_all(ssl, payload, payload_len) == -1) return -1;
+        if (send_all(t, payload, payload_len) == -1) return -1;
     }
     return 1;
 }
 
-int recv_packet(SSL *ssl, MessageType *type, void **payload_out, uint32_t *payload_len_out) {
-    if (!ssl) return -1;
+int transport_recv_packet(const Transport *t, MessageType *type, void **payload_out, uint32_t *payload_len_out) {
+    if (!t || (!t->ssl && t->fd < 0)) return -1;
     MessageHeader header;
 
-    int status = recv_all(ssl, &header, sizeof(header));
+    int status = recv_all(t, &header, sizeof(header));
     if (status <= 0) return status;
 
     *type = ntohl(header.type);
     *payload_len_out = ntohl(header.payload_len);
 
+    // Checked before allocating: the peer picks the length
+    if (*payload_len_out > MAX_FRAME_LEN) return -1;
+
     if (*payload_len_out > 0) {
         *payload_out = malloc(*payload_len_out + 1);
         if (!*payload_out) return -1;
 
-        if (recv_all(ssl, *payload_out, *payload_len_out) <= 0) {
+        if (recv_all(t, *payload_out, *payload_len_out) <= 0) {
             free(*payload_out);
             return -1;
         }
@@ -139,4 +329,53 @@ int recv_packet(SSL *ssl, MessageType *type, void **payload_out, uint32_t *paylo
         *payload_out = NULL;
     }
     return 1;
-}
\ No newline at end of file
+}
+
+int send_packet(SSL *ssl, MessageType type, const void *payload, uint32_t payload_len) {
+    if (!ssl) return -1;
+    Transport t = {ssl, -1};
+    return transport_send_packet(&t, type, payload, payload_len);
+}
+
+int recv_packet(SSL *ssl, MessageType *type, void **payload_out, uint32_t *payload_len_out) {
+    if (!ssl) return -1;
+    Transport t = {ssl, -1};
+    return transport_recv_packet(&t, type, payload_out, payload_len_out);
+}
+
+// --- FRAME BUFFERS ---
+
+int frame_append(uint8_t **buf, uint32_t *len, MessageType type, const void *payload, uint32_t payload_len) {
+    uint32_t needed = *len + sizeof(MessageHeader) + payload_len;
+    uint8_t *grown = realloc(*buf, needed);
+    if (!grown) return -1;
+
+    MessageHeader header;
+    header.type = htonl(type);
+    header.payload_len = htonl(payload_len);
+
+    memcpy(grown + *len, &header, sizeof(header));
+    if (payload_len > 0 && payload != NULL)
+        memcpy(grown + *len + sizeof(header), payload, payload_len);
+
+    *buf = grown;
+    *len = needed;
+    return 1;
+}
+
+int frame_next(const uint8_t *buf, uint32_t len, uint32_t *offset, MessageType *type_out, const void **payload_out, uint32_t *payload_len_out) {
+    if (*offset >= len) return 0;
+    if (len - *offset < sizeof(MessageHeader)) return -1;
+
+    MessageHeader header;
+    memcpy(&header, buf + *offset, sizeof(header));
+    uint32_t payload_len = ntohl(header.payload_len);
+
+    if (payload_len > len - *offset - sizeof(MessageHeader)) return -1;
+
+    *type_out = ntohl(header.type);
+    *payload_len_out = payload_len;
+    *payload_out = payload_len > 0 ? buf + *offset + sizeof(MessageHeader) : NULL;
+    *offset += sizeof(MessageHeader) + payload_len;
+    return 1;
+}
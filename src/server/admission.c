@@ -0,0 +1,139 @@
+#include "infrastructure/admission.h"
+#include "infrastructure/executor.h"
+#include "system/logger.h"
+#include <time.h>
+
+// What a shed request is told to wait
+#define OVERLOAD_RETRY_MS 1000
+
+// A wait this long means the loop had nothing to do
+#define IDLE_US 1000
+
+typedef struct
+{
+	uint32_t rate;  /**< Requests per second (0 = unlimited) */
+	uint32_t burst; /**< Bucket size */
+} Limit;
+
+static Limit limits[ADMIT_CLASSES];
+
+static uint32_t lag_limit_us = 0;
+static int backlog_limit = 0;
+
+// Controller state (event loop only)
+static int64_t wake_us = 0;
+static int64_t sleep_us = 0;
+static double busy_us = 0; // Moving average of iteration durations
+static int level = 0;      // 0: normal, 1: shedding queries, 2: queries and logins
+
+static int64_t now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static Limit make_limit(int rate, int burst)
+{
+	Limit l = {0, 0};
+	if (rate > 0)
+	{
+		l.rate = (uint32_t)rate;
+		l.burst = burst > 0 ? (uint32_t)burst : 1;
+	}
+	return l;
+}
+
+void admission_init(const AppConfig *config)
+{
+	limits[ADMIT_MESSAGE] = make_limit(config->rate_messages, config->burst_messages);
+	limits[ADMIT_QUERY] = make_limit(config->rate_queries, config->burst_queries);
+	limits[ADMIT_AUTH] = make_limit(config->rate_auth, config->burst_auth);
+	limits[ADMIT_TELEMETRY] = make_limit(config->rate_telemetry, config->burst_telemetry);
+	lag_limit_us = config->overload_lag_ms > 0 ? (uint32_t)config->overload_lag_ms * 1000 : 0;
+	backlog_limit = config->overload_backlog > 0 ? config->overload_backlog : 0;
+}
+
+static void update_level(void)
+{
+	// Pressure 1.0 means one of the limits is reached
+	double pressure = 0;
+	if (lag_limit_us > 0)
+		pressure = busy_us / lag_limit_us;
+	int backlog = executor_backlog();
+	if (backlog_limit > 0 && (double)backlog / backlog_limit > pressure)
+		pressure = (double)backlog / backlog_limit;
+
+	int target = pressure >= 2.0 ? 2 : pressure >= 1.0 ? 1 : 0;
+	int previous = level;
+	if (target > level)
+	{
+		level = target;
+	}
+	else
+	{
+		// Leave a level only well below its threshold, so shedding does not flap
+		while (level > target && pressure < 0.5 * level)
+			level--;
+	}
+
+	if (level > previous)
+		log_print(LOG_WARN, "Overload (loop busy %.1f ms, executor backlog %d): shedding %s",
+							busy_us / 1000.0, backlog, level == 1 ? "queries" : "queries and logins");
+	else if (level < previous)
+		log_print(LOG_INFO, "Overload easing (loop busy %.1f ms, executor backlog %d): shedding %s",
+							busy_us / 1000.0, backlog, level == 1 ? "queries" : "nothing");
+}
+
+void admission_loop_wake(void)
+{
+	wake_us = now_us();
+
+	// The loop was waiting for events, so the ones that woke it did not
+	// queue behind anything: that counts as an iteration with no lag
+	if (sleep_us > 0 && wake_us - sleep_us > IDLE_US)
+	{
+		busy_us -= busy_us / 8;
+		update_level();
+	}
+}
+
+void admission_loop_sleep(void)
+{
+	sleep_us = now_us();
+	if (wake_us == 0)
+		return;
+	busy_us += ((double)(sleep_us - wake_us) - busy_us) / 8;
+	update_level();
+}
+
+uint32_t admission_check(Client *cli, AdmissionClass cls)
+{
+	if (cls <= ADMIT_NONE || cls >= ADMIT_CLASSES)
+		return 0;
+
+	if ((cls == ADMIT_QUERY && level >= 1) || (cls == ADMIT_AUTH && level >= 2))
+		return OVERLOAD_RETRY_MS;
+
+	const Limit *l = &limits[cls];
+	if (l->rate == 0)
+		return 0;
+
+	int64_t now = now_us() / 1000;
+	TokenBucket *b = &cli->buckets[cls];
+	if (b->refill_ms == 0)
+	{
+		b->tokens = l->burst;
+		b->refill_ms = now;
+	}
+
+	b->tokens += (double)(now - b->refill_ms) * l->rate / 1000.0;
+	if (b->tokens > l->burst)
+		b->tokens = l->burst;
+	b->refill_ms = now;
+
+	if (b->tokens < 1.0)
+		return (uint32_t)((1.0 - b->tokens) * 1000.0 / l->rate) + 1;
+	b->tokens -= 1.0;
+	return 0;
+}
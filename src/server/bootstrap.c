@@ -0,0 +1,223 @@
+#include "infrastructure/bootstrap.h"
+#include "infrastructure/client_manager.h"
+#include "infrastructure/presence.h"
+#include "infrastructure/stream.h"
+#include "infrastructure/membership.h"
+#include "system/storage.h"
+#include "system/logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Per-user snapshot, kept in a uid hash like the client manager's index
+typedef struct BootstrapEntry
+{
+	uint32_t uid;
+	uint32_t counter;  /**< Bumped on every invalidation */
+	int fresh;         /**< 1 while snapshot matches the current version */
+	uint8_t *snapshot; /**< Lists that follow the header */
+	uint32_t snapshot_len;
+	uint32_t contacts_count;
+	uint32_t requests_count;
+	uint32_t conv_count;
+	struct BootstrapEntry *next;
+} BootstrapEntry;
+
+#define BOOTSTRAP_BUCKETS 4096
+static BootstrapEntry *entries[BOOTSTRAP_BUCKETS];
+
+// High half of every version. Seeded from the clock so versions handed out
+// before a restart never match, bumped by bootstrap_invalidate_all().
+static uint32_t epoch = 0;
+
+static uint64_t entry_version(const BootstrapEntry *e)
+{
+	return ((uint64_t)epoch << 32) | e->counter;
+}
+
+static BootstrapEntry *find_entry(uint32_t uid, int create)
+{
+	if (epoch == 0)
+		epoch = (uint32_t)time(NULL);
+
+	BootstrapEntry **bucket = &entries[uid % BOOTSTRAP_BUCKETS];
+	for (BootstrapEntry *e = *bucket; e; e = e->next)
+	{
+		if (e->uid == uid)
+			return e;
+	}
+	if (!create)
+		return NULL;
+
+	BootstrapEntry *e = calloc(1, sizeof(BootstrapEntry));
+	if (!e)
+		return NULL;
+	e->uid = uid;
+	e->counter = 1;
+	e->next = *bucket;
+	*bucket = e;
+	return e;
+}
+
+static void drop_snapshot(BootstrapEntry *e)
+{
+	free(e->snapshot);
+	e->snapshot = NULL;
+	e->snapshot_len = 0;
+	e->fresh = 0;
+}
+
+// --- Snapshot building ---
+
+typedef struct
+{
+	uint8_t *data;
+	uint32_t len;
+	uint32_t cap;
+	int failed;
+} SnapshotBuffer;
+
+static int append_row(SnapshotBuffer *b, const void *row, uint32_t size)
+{
+	if (b->len + size > b->cap)
+	{
+		uint32_t cap = b->cap ? b->cap * 2 : 4096;
+		while (cap < b->len + size)
+			cap *= 2;
+		uint8_t *ptr = realloc(b->data, cap);
+		if (!ptr)
+		{
+			b->failed = 1;
+			return 0;
+		}
+		b->data = ptr;
+		b->cap = cap;
+	}
+	memcpy(b->data + b->len, row, size);
+	b->len += size;
+	return 1;
+}
+
+static int append_contact(const void *row, void *ctx)
+{
+	return append_row(ctx, row, sizeof(ContactSummary));
+}
+
+static int append_conversation(const void *row, void *ctx)
+{
+	return append_row(ctx, row, sizeof(ConversationSummary));
+}
+
+static int build_snapshot(BootstrapEntry *e)
+{
+	SnapshotBuffer b = {0};
+	int in_txn = storage_begin(); // One consistent read across the three lists
+
+	e->contacts_count = storage_each_contact(e->uid, append_contact, &b);
+	e->requests_count = storage_each_request(e->uid, append_contact, &b);
+	e->conv_count = storage_each_user_conversation(e->uid, append_conversation, &b);
+
+	if (in_txn)
+		storage_commit();
+
+	if (b.failed)
+	{
+		free(b.data);
+		return 0;
+	}
+	e->snapshot = b.data;
+	e->snapshot_len = b.len;
+	e->fresh = 1;
+	return 1;
+}
+
+// --- Public API ---
+
+void bootstrap_send(Client *cli, uint64_t known_version)
+{
+	BootstrapEntry *e = find_entry(cli->uid, 1);
+	if (!e)
+		return;
+
+	BootstrapHeader header;
+	memset(&header, 0, sizeof(header));
+	header.version = entry_version(e);
+
+	User u;
+	if (storage_get_user_by_uid(cli->uid, &u))
+	{
+		header.me.uid = u.uid;
+		strncpy(header.me.username, u.username, MAX_NAME_LEN);
+		strncpy(header.me.email, u.email, MAX_EMAIL_LEN);
+		strncpy(header.me.friend_code, u.friend_code, FRIEND_CODE_LEN);
+	}
+
+	if (known_version == header.version)
+	{
+		header.unchanged = 1;
+		client_send(cli, MSG_BOOTSTRAP, &header, sizeof(header));
+		return;
+	}
+
+	if (!e->fresh && !build_snapshot(e))
+	{
+		log_print(LOG_ERROR, "Bootstrap snapshot failed for UID %d", cli->uid);
+		return;
+	}
+
+	header.contacts_count = e->contacts_count;
+	header.requests_count = e->requests_count;
+	header.conv_count = e->conv_count;
+
+	ResponseStream s;
+	stream_begin(&s, cli, MSG_BOOTSTRAP);
+	stream_write(&s, &header, sizeof(header));
+
+	// Online flags are not part of the version; fill them at send time
+	for (uint32_t i = 0; i < e->contacts_count; i++)
+	{
+		ContactSummary contact;
+		memcpy(&contact, e->snapshot + i * sizeof(ContactSummary), sizeof(contact));
+		presence_fill(&contact, 1);
+		stream_write(&s, &contact, sizeof(contact));
+	}
+	uint32_t offset = e->contacts_count * sizeof(ContactSummary);
+	if (e->snapshot_len > offset)
+		stream_write(&s, e->snapshot + offset, e->snapshot_len - offset);
+	stream_end(&s);
+
+	log_print(LOG_DEBUG, "Bootstrap v%llu sent to UID %d", (unsigned long long)header.version, cli->uid);
+}
+
+void bootstrap_invalidate(uint32_t uid)
+{
+	BootstrapEntry *e = find_entry(uid, 0);
+	if (!e)
+		return; // Never bootstrapped: first request builds from scratch
+	e->counter++;
+	drop_snapshot(e);
+}
+
+void bootstrap_invalidate_conv(uint32_t conv_id)
+{
+	const MemberList *members = membership_get(conv_id);
+	for (uint32_t i = 0; members && i < members->count; i++)
+		bootstrap_invalidate(members->uids[i]);
+}
+
+void bootstrap_invalidate_all(void)
+{
+	epoch++;
+	for (int i = 0; i < BOOTSTRAP_BUCKETS; i++)
+	{
+		for (BootstrapEntry *e = entries[i]; e; e = e->next)
+			drop_snapshot(e);
+	}
+}
+
+void bootstrap_release(uint32_t uid)
+{
+	BootstrapEntry *e = find_entry(uid, 0);
+	if (e)
+		drop_snapshot(e);
+}
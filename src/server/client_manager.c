@@ -1,20 +1,138 @@
 #include "infrastructure/client_manager.h"
+#include "infrastructure/outqueue.h"
 #include <openssl/ssl.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
 
 // Internal Linked List Node
 typedef struct ClientNode
 {
 	Client data;
 	struct ClientNode *next;
+	struct ClientNode *prev;
+	struct ClientNode *fd_next;   // Chain in the fd index
+	struct ClientNode *uid_next;  // Chain in the uid index
+	struct ClientNode *gw_next;   // Chain in the gateway session index
+	struct ClientNode *sess_head; // Gateway link: its open sessions
+	struct ClientNode *sess_next; // Gateway session: siblings on the same link
+	struct ClientNode *sess_prev;
 } ClientNode;
 
 static ClientNode *head = NULL;
 
+// Every client hashed by fd (negative for gateway sessions), so lookups and removal stay O(1)
+#define FD_BUCKETS 4096
+static ClientNode *fd_index[FD_BUCKETS];
+
+// Authenticated clients hashed by uid, so routing and presence lookups stay O(1)
+#define UID_BUCKETS 4096
+static ClientNode *uid_index[UID_BUCKETS];
+
+// Gateway sessions hashed by session id, so inbound frames find their client in O(1)
+#define GW_BUCKETS 4096
+static ClientNode *gw_index[GW_BUCKETS];
+
+// Gateway sessions have no socket; they get unique negative FDs (-1 stays "invalid")
+static int next_session_fd = -2;
+
+static uint64_t next_conn_id = 1;
+
+// Outbound coalescing state (see client_coalesce_begin)
+typedef struct PendingFrame
+{
+	ClientRef to;
+	MessageType type;
+	void *payload;
+	uint32_t len;
+	struct PendingFrame *next;
+} PendingFrame;
+
+static int coalescing = 0;
+static Client *coalesce_origin = NULL;
+static MessageType coalesce_reply = 0;
+static PendingFrame *pending_head = NULL;
+
+static ClientNode **fd_bucket(int fd)
+{
+	return &fd_index[(unsigned int)fd % FD_BUCKETS];
+}
+
+// Adds a fresh node to the client list and the fd index
+static void link_node(ClientNode *node)
+{
+	node->prev = NULL;
+	node->next = head;
+	if (head)
+		head->prev = node;
+	head = node;
+
+	ClientNode **bucket = fd_bucket(node->data.fd);
+	node->fd_next = *bucket;
+	*bucket = node;
+}
+
+static ClientNode *find_node(int fd)
+{
+	ClientNode *current = *fd_bucket(fd);
+	while (current != NULL && current->data.fd != fd)
+		current = current->fd_next;
+	return current;
+}
+
+static void fd_index_unlink(ClientNode *node)
+{
+	ClientNode **link = fd_bucket(node->data.fd);
+	while (*link && *link != node)
+		link = &(*link)->fd_next;
+	if (*link)
+		*link = node->fd_next;
+	node->fd_next = NULL;
+}
+
+static void uid_index_unlink(ClientNode *node)
+{
+	if (node->data.uid == 0)
+		return;
+
+	ClientNode **link = &uid_index[node->data.uid % UID_BUCKETS];
+	while (*link && *link != node)
+		link = &(*link)->uid_next;
+	if (*link)
+		*link = node->uid_next;
+	node->uid_next = NULL;
+}
+
+static void gw_index_unlink(ClientNode *node)
+{
+	if (node->data.gw_session == 0)
+		return;
+
+	ClientNode **link = &gw_index[node->data.gw_session % GW_BUCKETS];
+	while (*link && *link != node)
+		link = &(*link)->gw_next;
+	if (*link)
+		*link = node->gw_next;
+	node->gw_next = NULL;
+
+	// Detach from the owning link's session list (the link outlives its sessions)
+	ClientNode *owner = (ClientNode *)node->data.gateway; // data is the first member
+	if (node->sess_prev)
+		node->sess_prev->sess_next = node->sess_next;
+	else if (owner && owner->sess_head == node)
+		owner->sess_head = node->sess_next;
+	if (node->sess_next)
+		node->sess_next->sess_prev = node->sess_prev;
+	node->sess_next = node->sess_prev = NULL;
+}
+
 void init_clients(void)
 {
 	head = NULL;
+	memset(fd_index, 0, sizeof(fd_index));
+	memset(uid_index, 0, sizeof(uid_index));
+	memset(gw_index, 0, sizeof(gw_index));
 }
 
 void free_clients(void)
@@ -23,89 +141,364 @@ void free_clients(void)
 	while (current != NULL)
 	{
 		ClientNode *next = current->next;
-		// Cleanup SSL if it wasn't already
-		if (current->data.ssl)
+		if (current->data.out)
 		{
-			SSL_shutdown(current->data.ssl);
-			SSL_free(current->data.ssl);
+			outqueue_close(current->data.out);
+			outqueue_release(current->data.out);
 		}
+		free(current->data.rx);
 		free(current);
 		current = next;
 	}
 	head = NULL;
+	memset(fd_index, 0, sizeof(fd_index));
+	memset(uid_index, 0, sizeof(uid_index));
+	memset(gw_index, 0, sizeof(gw_index));
 }
 
-void add_client(int fd, SSL *ssl)
+Client *add_client(int fd, SSL *ssl)
 {
+	Transport t = {ssl, fd};
 	ClientNode *node = malloc(sizeof(ClientNode));
-	if (!node)
-		return;
+	OutQueue *out = node ? outqueue_new(t) : NULL;
+	if (!out)
+	{
+		free(node);
+		if (ssl)
+			SSL_free(ssl);
+		close(fd);
+		return NULL;
+	}
 
-	memset(&node->data, 0, sizeof(Client));
+	memset(node, 0, sizeof(ClientNode));
 	node->data.fd = fd;
-	node->data.ssl = ssl;
+	node->data.transport = t;
+	node->data.out = out;
+	node->data.conn_id = next_conn_id++;
 	node->data.uid = 0;
 	node->data.is_online = 0;
 
-	node->next = head;
-	head = node;
+	link_node(node);
+	return &node->data;
 }
 
-void remove_client(int fd)
+Client *add_gateway_session(Client *gateway, uint32_t session_id)
 {
-	ClientNode *current = head;
-	ClientNode *prev = NULL;
+	if (!gateway || session_id == 0)
+		return NULL;
+
+	ClientNode *node = malloc(sizeof(ClientNode));
+	if (!node)
+		return NULL;
+
+	memset(node, 0, sizeof(ClientNode));
+	node->data.fd = next_session_fd--;
+	node->data.transport.fd = -1;
+	node->data.gw_session = session_id;
+	node->data.gateway = gateway;
+	node->data.conn_id = next_conn_id++;
+
+	ClientNode **bucket = &gw_index[session_id % GW_BUCKETS];
+	node->gw_next = *bucket;
+	*bucket = node;
+
+	ClientNode *link = (ClientNode *)gateway;
+	node->sess_next = link->sess_head;
+	if (link->sess_head)
+		link->sess_head->sess_prev = node;
+	link->sess_head = node;
+
+	link_node(node);
+	return &node->data;
+}
 
+Client *get_gateway_session(const Client *gateway, uint32_t session_id)
+{
+	if (session_id == 0)
+		return NULL;
+
+	ClientNode *current = gw_index[session_id % GW_BUCKETS];
 	while (current != NULL)
 	{
-		if (current->data.fd == fd)
-		{
-			if (prev == NULL)
-			{
-				head = current->next;
-			}
-			else
-			{
-				prev->next = current->next;
-			}
-
-			if (current->data.ssl)
-			{
-				SSL_shutdown(current->data.ssl);
-				SSL_free(current->data.ssl);
-			}
-			free(current);
-			return;
-		}
-		prev = current;
-		current = current->next;
+		if (current->data.gw_session == session_id && current->data.gateway == gateway)
+			return &current->data;
+		current = current->gw_next;
+	}
+	return NULL;
+}
+
+Client *client_next_gateway_session(const Client *gateway)
+{
+	const ClientNode *link = (const ClientNode *)gateway;
+	return link->sess_head ? &link->sess_head->data : NULL;
+}
+
+void remove_client(int fd)
+{
+	ClientNode *current = find_node(fd);
+	if (current == NULL)
+		return;
+
+	if (current->prev)
+		current->prev->next = current->next;
+	else
+		head = current->next;
+	if (current->next)
+		current->next->prev = current->prev;
+
+	fd_index_unlink(current);
+	uid_index_unlink(current);
+	gw_index_unlink(current);
+
+	timer_cancel(&current->data.heartbeat);
+
+	// A coroutine still waiting notices the client is gone when it resumes
+	DeferredPacket *d = current->data.deferred;
+	while (d)
+	{
+		DeferredPacket *next = d->next;
+		free(d);
+		d = next;
+	}
+
+	// The connection closes once no fan-out is still writing to it
+	if (current->data.out)
+	{
+		outqueue_close(current->data.out);
+		outqueue_release(current->data.out);
+	}
+	free(current->data.rx);
+	free(current);
+}
+
+void client_bind_uid(Client *cli, uint32_t uid)
+{
+	ClientNode *node = (ClientNode *)cli; // data is the first member
+	uid_index_unlink(node);
+
+	cli->uid = uid;
+	cli->is_online = (uid != 0);
+
+	if (uid != 0)
+	{
+		ClientNode **bucket = &uid_index[uid % UID_BUCKETS];
+		node->uid_next = *bucket;
+		*bucket = node;
 	}
 }
 
 Client *get_client_by_uid(uint32_t uid)
 {
-	ClientNode *current = head;
+	if (uid == 0)
+		return NULL;
+
+	ClientNode *current = uid_index[uid % UID_BUCKETS];
 	while (current != NULL)
 	{
 		if (current->data.uid == uid && current->data.is_online)
 		{
 			return &current->data;
 		}
-		current = current->next;
+		current = current->uid_next;
 	}
 	return NULL;
 }
 
-Client *get_client_by_fd(int fd)
+void client_foreach(void (*fn)(Client *cli, void *arg), void *arg)
 {
-	ClientNode *current = head;
+	for (ClientNode *current = head; current != NULL; current = current->next)
+		fn(&current->data, arg);
+}
+
+int client_count_by_uid(uint32_t uid)
+{
+	int count = 0;
+	ClientNode *current = uid_index[uid % UID_BUCKETS];
 	while (current != NULL)
 	{
-		if (current->data.fd == fd)
+		if (current->data.uid == uid && current->data.is_online)
+			count++;
+		current = current->uid_next;
+	}
+	return count;
+}
+
+Client *get_client_by_fd(int fd)
+{
+	ClientNode *current = find_node(fd);
+	return current ? &current->data : NULL;
+}
+
+ClientRef client_ref(const Client *cli)
+{
+	ClientRef ref = {cli->fd, cli->conn_id};
+	return ref;
+}
+
+Client *client_resolve(ClientRef ref)
+{
+	Client *cli = get_client_by_fd(ref.fd);
+	return cli && cli->conn_id == ref.conn_id ? cli : NULL;
+}
+
+// --- OUTBOUND ---
+
+OutQueue *client_enqueue(Client *cli, OutFrame *frame)
+{
+	if (cli->gw_session == 0)
+		return cli->out && outqueue_push(cli->out, frame) > 0 ? cli->out : NULL;
+
+	// Sessions share the gateway's queue, each frame tagged with its session id
+	OutQueue *q = cli->gateway->out;
+	uint32_t payload_len;
+	const void *payload = outframe_payload(frame, &payload_len);
+	uint32_t total = sizeof(GatewayFrameHeader) + payload_len;
+	uint8_t *wrapped = malloc(total);
+	if (!q || !wrapped)
+	{
+		free(wrapped);
+		return NULL;
+	}
+
+	GatewayFrameHeader gh = {cli->gw_session, outframe_type(frame)};
+	memcpy(wrapped, &gh, sizeof(gh));
+	if (payload_len > 0)
+		memcpy(wrapped + sizeof(gh), payload, payload_len);
+
+	OutFrame *gw_frame = outframe_new(MSG_GW_FRAME, wrapped, total);
+	free(wrapped);
+	int rc = gw_frame ? outqueue_push(q, gw_frame) : -1;
+	outframe_release(gw_frame);
+	return rc > 0 ? q : NULL;
+}
+
+// Queues one packet on the client's connection and writes it out
+static int client_write(Client *cli, MessageType type, const void *payload, uint32_t payload_len)
+{
+	OutFrame *frame = outframe_new(type, payload, payload_len);
+	if (!frame)
+		return -1;
+
+	OutQueue *q = client_enqueue(cli, frame);
+	outframe_release(frame);
+	return q ? outqueue_flush(q) : -1;
+}
+
+static int is_list_refresh(MessageType type)
+{
+	return type == MSG_RESP_CONTACTS || type == MSG_RESP_REQUESTS ||
+				 type == MSG_RESP_CONVERSATIONS || type == MSG_RESP_MEMBERS;
+}
+
+// Unsolicited updates reach the batch origin too, after the batch
+static int is_update(MessageType type)
+{
+	return is_list_refresh(type) || type == MSG_CONV_UPDATED;
+}
+
+// Holds a frame until the batch is over. Refreshes keep only the latest of
+// each type per client; other frames are all kept, in order
+static int coalesce_store(Client *cli, MessageType type, const void *payload, uint32_t payload_len)
+{
+	PendingFrame *f = NULL;
+	if (is_list_refresh(type))
+	{
+		f = pending_head;
+		while (f && !(f->to.fd == cli->fd && f->to.conn_id == cli->conn_id && f->type == type))
+			f = f->next;
+	}
+
+	void *copy = NULL;
+	if (payload_len > 0)
+	{
+		copy = malloc(payload_len);
+		if (!copy)
+			return -1;
+		memcpy(copy, payload, payload_len);
+	}
+
+	if (!f)
+	{
+		f = malloc(sizeof(PendingFrame));
+		if (!f)
 		{
-			return &current->data;
+			free(copy);
+			return -1;
 		}
-		current = current->next;
+		f->to = client_ref(cli);
+		f->type = type;
+		f->payload = NULL;
+		f->next = pending_head;
+		pending_head = f;
 	}
-	return NULL;
-}
\ No newline at end of file
+
+	free(f->payload);
+	f->payload = copy;
+	f->len = payload_len;
+	return 1;
+}
+
+int client_send(Client *cli, MessageType type, const void *payload, uint32_t payload_len)
+{
+	if (!cli)
+		return -1;
+
+	if (coalescing)
+	{
+		if (cli == coalesce_origin && !is_update(type))
+		{
+			if (coalesce_reply == 0)
+				coalesce_reply = type;
+			return 1;
+		}
+		return coalesce_store(cli, type, payload, payload_len);
+	}
+	return client_write(cli, type, payload, payload_len);
+}
+
+void client_coalesce_begin(Client *origin)
+{
+	coalescing = 1;
+	coalesce_origin = origin;
+	coalesce_reply = 0;
+}
+
+MessageType client_coalesce_take_reply(void)
+{
+	MessageType reply = coalesce_reply;
+	coalesce_reply = 0;
+	return reply;
+}
+
+int client_coalescing(void)
+{
+	return coalescing;
+}
+
+void client_coalesce_end(int deliver)
+{
+	coalescing = 0;
+	coalesce_origin = NULL;
+
+	// Frames were pushed at the head; reverse to send in arrival order
+	PendingFrame *ordered = NULL;
+	while (pending_head)
+	{
+		PendingFrame *next = pending_head->next;
+		pending_head->next = ordered;
+		ordered = pending_head;
+		pending_head = next;
+	}
+
+	while (ordered)
+	{
+		PendingFrame *next = ordered->next;
+		// The client may have been dropped by a failed write in the meantime
+		Client *c = deliver ? client_resolve(ordered->to) : NULL;
+		if (c)
+			client_write(c, ordered->type, ordered->payload, ordered->len);
+		free(ordered->payload);
+		free(ordered);
+		ordered = next;
+	}
+}
@@ -0,0 +1,138 @@
+#include "infrastructure/conn_limits.h"
+#include "system/logger.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#define PEER_BUCKETS 4096
+
+typedef struct PeerCount
+{
+	uint32_t ip; // IPv4, network order
+	int count;
+	struct PeerCount *next;
+} PeerCount;
+
+static int max_total = 0;  // 0 = unlimited
+static int max_per_ip = 0; // 0 = unlimited
+static int total = 0;
+
+static PeerCount *peers[PEER_BUCKETS];
+
+// Indexed by fd: the counted peer address, 0 if the fd is not counted
+// (INADDR_ANY is never a peer). Local peers use LOCAL_PEER
+#define LOCAL_PEER UINT32_MAX
+static uint32_t *fd_peer = NULL;
+static int fd_slots = 0;
+
+// Refusals are logged once per second at most: a reconnect storm would
+// otherwise flood the log
+static time_t refused_at = 0;
+static int refused = 0;
+
+static PeerCount **find_peer(uint32_t ip)
+{
+	PeerCount **p = &peers[(ip ^ (ip >> 12)) % PEER_BUCKETS];
+	while (*p && (*p)->ip != ip)
+		p = &(*p)->next;
+	return p;
+}
+
+static void log_refusal(const char *reason)
+{
+	refused++;
+	time_t now = time(NULL);
+	if (now == refused_at)
+		return;
+	log_print(LOG_WARN, "Refused %d connection(s): %s (%d open)", refused, reason, total);
+	refused_at = now;
+	refused = 0;
+}
+
+void conn_limits_init(const AppConfig *config)
+{
+	max_total = config->max_connections > 0 ? config->max_connections : 0;
+	max_per_ip = config->max_connections_per_ip > 0 ? config->max_connections_per_ip : 0;
+}
+
+int conn_admit(int fd, const struct sockaddr *peer)
+{
+	if (fd < 0)
+		return 0;
+	if (max_total > 0 && total >= max_total)
+	{
+		log_refusal("server full");
+		return 0;
+	}
+
+	if (fd >= fd_slots)
+	{
+		int slots = fd_slots ? fd_slots : 1024;
+		while (slots <= fd)
+			slots *= 2;
+		uint32_t *grown = realloc(fd_peer, slots * sizeof(uint32_t));
+		if (!grown)
+			return 0;
+		memset(grown + fd_slots, 0, (slots - fd_slots) * sizeof(uint32_t));
+		fd_peer = grown;
+		fd_slots = slots;
+	}
+
+	uint32_t ip = LOCAL_PEER;
+	if (peer && peer->sa_family == AF_INET)
+	{
+		uint32_t addr = ((const struct sockaddr_in *)peer)->sin_addr.s_addr;
+		if ((ntohl(addr) >> 24) != 127)
+			ip = addr;
+	}
+
+	if (ip != LOCAL_PEER)
+	{
+		PeerCount **p = find_peer(ip);
+		if (*p && max_per_ip > 0 && (*p)->count >= max_per_ip)
+		{
+			log_refusal("too many from one address");
+			return 0;
+		}
+		if (!*p)
+		{
+			PeerCount *n = calloc(1, sizeof(PeerCount));
+			if (!n)
+				return 0;
+			n->ip = ip;
+			*p = n;
+		}
+		(*p)->count++;
+	}
+
+	fd_peer[fd] = ip;
+	total++;
+	return 1;
+}
+
+void conn_release(int fd)
+{
+	if (fd < 0 || fd >= fd_slots || fd_peer[fd] == 0)
+		return;
+
+	uint32_t ip = fd_peer[fd];
+	fd_peer[fd] = 0;
+	total--;
+	if (ip == LOCAL_PEER)
+		return;
+
+	PeerCount **p = find_peer(ip);
+	if (*p && --(*p)->count <= 0)
+	{
+		PeerCount *gone = *p;
+		*p = gone->next;
+		free(gone);
+	}
+}
+
+int conn_count(void)
+{
+	return total;
+}
@@ -0,0 +1,72 @@
+#include "infrastructure/coroutine.h"
+#include "infrastructure/client_manager.h"
+#include "infrastructure/dispatcher.h"
+#include <stdlib.h>
+
+static void coroutine_free(Coroutine *co)
+{
+	if (co->free_frame)
+		co->free_frame(co->frame);
+	else
+		free(co->frame);
+	if (!co->inline_only)
+		free(co);
+}
+
+// Runs the handler until it waits again or finishes
+static void step(Coroutine *co, Client *cli)
+{
+	cli->co = co;
+	if (co->fn(co, cli) == CO_WAITING)
+		return;
+
+	cli->co = NULL;
+	coroutine_free(co);
+	dispatch_resume(cli); // Requests held back while it ran
+}
+
+static void run_job(void *arg)
+{
+	Coroutine *co = arg;
+	co->job(co->frame);
+}
+
+// Event loop, once the awaited job is done
+static void resume(void *arg)
+{
+	Coroutine *co = arg;
+	Client *cli = client_resolve(co->owner);
+	if (!cli)
+	{
+		coroutine_free(co); // Disconnected while waiting
+		return;
+	}
+	step(co, cli);
+}
+
+void coroutine_start(Client *cli, CoroutineFn fn, void *frame, void (*free_frame)(void *frame))
+{
+	Coroutine *co = calloc(1, sizeof(Coroutine));
+	Coroutine fallback = {0};
+	if (!co)
+	{
+		// Still answer the request, synchronously
+		co = &fallback;
+		co->inline_only = 1;
+	}
+	co->owner = client_ref(cli);
+	co->fn = fn;
+	co->frame = frame;
+	co->free_frame = free_frame;
+	step(co, cli);
+}
+
+int coroutine_await(Coroutine *co, uint32_t key, ExecutorFn job)
+{
+	co->job = job;
+	if (!co->inline_only && executor_threads() > 0 && executor_submit(key, run_job, resume, co))
+		return 1;
+
+	job(co->frame);
+	return 0;
+}
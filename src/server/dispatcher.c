@@ -0,0 +1,295 @@
+#include "infrastructure/dispatcher.h"
+#include "infrastructure/admission.h"
+#include "infrastructure/client_manager.h"
+#include "system/logger.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Handlers
+#include "handlers/auth_handler.h"
+#include "handlers/chat_handler.h"
+#include "handlers/group_handler.h"
+#include "handlers/contact_handler.h"
+#include "handlers/batch_handler.h"
+#include "handlers/gateway_handler.h"
+#include "handlers/telemetry_handler.h"
+#include "handlers/topic_handler.h"
+#include "handlers/heartbeat_handler.h"
+
+// Requests a client may queue behind a waiting coroutine
+#define MAX_DEFERRED 256
+
+// Opcode flags
+#define OP_AUTH 0x1        /**< Requires a logged-in client */
+#define OP_REPLAY_SAFE 0x2 /**< May run from TLS early data */
+#define OP_BATCHABLE 0x4   /**< May appear in a MSG_BATCH_REQUEST */
+
+// Upper bounds of the variable-length requests (their handlers walk them)
+#define CREATE_CONV_MAX (offsetof(CreateConvPayload, participant_uids) + MAX_CREATE_PARTICIPANTS * sizeof(uint32_t))
+#define BATCH_MAX (MAX_BATCH_OPS * (sizeof(MessageHeader) + sizeof(SendMessagePayload))) // Largest batchable op
+#define GW_FRAME_MAX MAX_FRAME_LEN // The inner frame is checked again against its own entry
+
+typedef void (*OpcodeHandler)(Client *cli, const void *payload, uint32_t len);
+
+typedef struct
+{
+	const char *name;
+	OpcodeHandler handler;
+	uint32_t min_len;
+	uint32_t max_len;
+	int flags;
+	AdmissionClass admit;
+	MessageType reject_reply; /**< Sent when the frame is rejected, 0 for none */
+
+	// Counters (event loop only)
+	uint64_t calls;
+	uint64_t bytes;
+	uint64_t errors;
+	uint64_t throttled; /**< Refused with MSG_RETRY_AFTER */
+	uint64_t total_ns;
+} Opcode;
+
+// Adapters giving every handler the table's signature. Payload lengths are
+// checked against the table before they run, so the casts are safe
+#define EMPTY_ADAPTER(fn)                                                \
+	static void fn##_op(Client *cli, const void *payload, uint32_t len) \
+	{                                                                    \
+		(void)payload;                                                     \
+		(void)len;                                                         \
+		fn(cli);                                                           \
+	}
+
+#define FIXED_ADAPTER(fn, T)                                             \
+	static void fn##_op(Client *cli, const void *payload, uint32_t len) \
+	{                                                                    \
+		(void)len;                                                         \
+		fn(cli, (const T *)payload);                                       \
+	}
+
+FIXED_ADAPTER(handle_register, RegisterPayload)
+FIXED_ADAPTER(handle_login, LoginPayload)
+FIXED_ADAPTER(handle_resume, SessionToken)
+FIXED_ADAPTER(handle_update_user, UpdateUserPayload)
+FIXED_ADAPTER(handle_req_bootstrap, BootstrapRequestPayload)
+FIXED_ADAPTER(handle_send_text, SendMessagePayload)
+FIXED_ADAPTER(handle_req_history, RequestHistoryPayload)
+FIXED_ADAPTER(handle_update_group, UpdateGroupPayload)
+FIXED_ADAPTER(handle_add_member, AddMemberPayload)
+FIXED_ADAPTER(handle_kick_member, KickMemberPayload)
+FIXED_ADAPTER(handle_delete_group, DeleteGroupPayload)
+FIXED_ADAPTER(handle_add_by_code, AddContactPayload)
+FIXED_ADAPTER(handle_decide_request, DecideRequestPayload)
+FIXED_ADAPTER(handle_offline_ack, OfflineAckPayload)
+FIXED_ADAPTER(handle_telemetry_config, TelemetryConfigPayload)
+FIXED_ADAPTER(handle_req_telemetry, TelemetryQueryPayload)
+FIXED_ADAPTER(handle_subscribe, TopicFilterPayload)
+FIXED_ADAPTER(handle_unsubscribe, TopicFilterPayload)
+FIXED_ADAPTER(handle_ping, PingPayload)
+FIXED_ADAPTER(handle_pong, PingPayload)
+EMPTY_ADAPTER(handle_req_conversations)
+EMPTY_ADAPTER(handle_req_contacts)
+EMPTY_ADAPTER(handle_get_requests)
+EMPTY_ADAPTER(handle_presence_subscribe)
+
+#define OP(type, fn, min, max, flags, admit, reject) \
+	[type] = {#type, fn, min, max, flags, admit, reject, 0, 0, 0, 0, 0}
+
+#define EMPTY(type, fn, flags, admit) OP(type, fn##_op, 0, 0, flags, admit, 0)
+#define FIXED(type, fn, T, flags, admit, reject) OP(type, fn##_op, sizeof(T), sizeof(T), flags, admit, reject)
+
+static Opcode opcodes[MSG_DISCONNECT] = {
+		// Auth
+		FIXED(MSG_REGISTER, handle_register, RegisterPayload, 0, ADMIT_AUTH, MSG_REGISTER_FAIL),
+		FIXED(MSG_LOGIN, handle_login, LoginPayload, 0, ADMIT_AUTH, MSG_LOGIN_FAIL),
+		FIXED(MSG_RESUME, handle_resume, SessionToken, OP_REPLAY_SAFE, ADMIT_AUTH, MSG_LOGIN_FAIL),
+		FIXED(MSG_UPDATE_USER, handle_update_user, UpdateUserPayload, OP_AUTH, ADMIT_AUTH, MSG_UPDATE_FAIL),
+		// Pipelined behind MSG_LOGIN: dropped if that login failed
+		FIXED(MSG_REQ_BOOTSTRAP, handle_req_bootstrap, BootstrapRequestPayload, OP_AUTH | OP_REPLAY_SAFE, ADMIT_QUERY, 0),
+
+		// Chat
+		FIXED(MSG_SEND_TEXT, handle_send_text, SendMessagePayload, OP_AUTH | OP_BATCHABLE, ADMIT_MESSAGE, 0),
+		FIXED(MSG_REQ_HISTORY, handle_req_history, RequestHistoryPayload, OP_AUTH | OP_REPLAY_SAFE, ADMIT_QUERY, 0),
+		FIXED(MSG_OFFLINE_ACK, handle_offline_ack, OfflineAckPayload, OP_AUTH, ADMIT_MESSAGE, 0),
+
+		// Groups / Conversations (participant_uids runs to the end of the payload)
+		OP(MSG_CREATE_CONV, handle_create_conv, offsetof(CreateConvPayload, participant_uids), CREATE_CONV_MAX, OP_AUTH, ADMIT_MESSAGE, 0),
+		EMPTY(MSG_REQ_CONVERSATIONS, handle_req_conversations, OP_AUTH | OP_REPLAY_SAFE, ADMIT_QUERY),
+		FIXED(MSG_UPDATE_GROUP, handle_update_group, UpdateGroupPayload, OP_AUTH | OP_BATCHABLE, ADMIT_MESSAGE, 0),
+		FIXED(MSG_ADD_MEMBER, handle_add_member, AddMemberPayload, OP_AUTH | OP_BATCHABLE, ADMIT_MESSAGE, 0),
+		// Older clients send only conv_id
+		OP(MSG_REQ_MEMBERS, handle_req_members, sizeof(uint32_t), sizeof(ReqMembersPayload), OP_AUTH | OP_REPLAY_SAFE, ADMIT_QUERY, 0),
+		FIXED(MSG_KICK_MEMBER, handle_kick_member, KickMemberPayload, OP_AUTH | OP_BATCHABLE, ADMIT_MESSAGE, 0),
+		FIXED(MSG_DELETE_GROUP, handle_delete_group, DeleteGroupPayload, OP_AUTH | OP_BATCHABLE, ADMIT_MESSAGE, 0),
+
+		// Contacts
+		EMPTY(MSG_REQ_CONTACTS, handle_req_contacts, OP_AUTH | OP_REPLAY_SAFE, ADMIT_QUERY),
+		FIXED(MSG_ADD_BY_CODE, handle_add_by_code, AddContactPayload, OP_AUTH | OP_BATCHABLE, ADMIT_MESSAGE, MSG_ADD_FAIL),
+		EMPTY(MSG_GET_REQUESTS, handle_get_requests, OP_AUTH | OP_REPLAY_SAFE, ADMIT_QUERY),
+		FIXED(MSG_DECIDE_REQUEST, handle_decide_request, DecideRequestPayload, OP_AUTH | OP_BATCHABLE, ADMIT_MESSAGE, 0),
+		EMPTY(MSG_PRESENCE_SUBSCRIBE, handle_presence_subscribe, OP_AUTH | OP_REPLAY_SAFE, ADMIT_MESSAGE),
+
+		// Batching (an empty result tells the client nothing ran). Sub-frames
+		// are admitted one by one
+		OP(MSG_BATCH_REQUEST, handle_batch, 0, BATCH_MAX, OP_AUTH, ADMIT_NONE, MSG_BATCH_RESULT),
+
+		// Gateway Multiplexing (inner frames are admitted per session)
+		OP(MSG_GW_FRAME, handle_gw_frame, sizeof(GatewayFrameHeader), GW_FRAME_MAX, OP_AUTH, ADMIT_NONE, 0),
+		OP(MSG_GW_CLOSE, handle_gw_close, sizeof(GatewayFrameHeader), sizeof(GatewayFrameHeader), OP_AUTH, ADMIT_NONE, 0),
+
+		// Telemetry Channels (samples are rate limited per channel)
+		OP(MSG_TELEMETRY_PUSH, handle_telemetry_push, offsetof(TelemetryPushPayload, data), sizeof(TelemetryPushPayload), OP_AUTH, ADMIT_TELEMETRY, 0),
+		FIXED(MSG_TELEMETRY_CONFIG, handle_telemetry_config, TelemetryConfigPayload, OP_AUTH, ADMIT_MESSAGE, 0),
+		FIXED(MSG_REQ_TELEMETRY, handle_req_telemetry, TelemetryQueryPayload, OP_AUTH | OP_REPLAY_SAFE, ADMIT_QUERY, 0),
+
+		// Topics
+		FIXED(MSG_SUBSCRIBE, handle_subscribe, TopicFilterPayload, OP_AUTH, ADMIT_MESSAGE, 0),
+		FIXED(MSG_UNSUBSCRIBE, handle_unsubscribe, TopicFilterPayload, OP_AUTH, ADMIT_MESSAGE, 0),
+		OP(MSG_PUBLISH, handle_publish, offsetof(PublishPayload, data), sizeof(PublishPayload), OP_AUTH, ADMIT_MESSAGE, 0),
+
+		// Heartbeat (also before login)
+		FIXED(MSG_PING, handle_ping, PingPayload, 0, ADMIT_MESSAGE, 0),
+		FIXED(MSG_PONG, handle_pong, PingPayload, 0, ADMIT_NONE, 0),
+};
+
+static Opcode *lookup(MessageType type)
+{
+	if ((uint32_t)type >= MSG_DISCONNECT || !opcodes[type].handler)
+		return NULL;
+	return &opcodes[type];
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void reject(Client *cli, Opcode *op, const char *reason, uint32_t len)
+{
+	op->errors++;
+	log_print(LOG_WARN, "Rejected %s from FD %d (%s, %u bytes)", op->name, cli->fd, reason, len);
+	if (op->reject_reply)
+		client_send(cli, op->reject_reply, NULL, 0);
+}
+
+static void defer_packet(Client *cli, MessageType type, const void *payload, uint32_t len)
+{
+	DeferredPacket *d = cli->deferred_count < MAX_DEFERRED ? malloc(sizeof(DeferredPacket) + len + 1) : NULL;
+	if (!d)
+	{
+		log_print(LOG_WARN, "Dropped packet type %d from FD %d (too many pending)", type, cli->fd);
+		return;
+	}
+	d->type = type;
+	d->len = len;
+	d->next = NULL;
+	if (len > 0)
+		memcpy(d->payload, payload, len);
+	d->payload[len] = '\0';
+
+	if (cli->deferred_tail)
+		cli->deferred_tail->next = d;
+	else
+		cli->deferred = d;
+	cli->deferred_tail = d;
+	cli->deferred_count++;
+}
+
+static void run_packet(Client *cli, MessageType type, Opcode *op, void *payload, uint32_t len)
+{
+	// Over the client's rate, or shed under overload: the client retries later
+	uint32_t retry_ms = admission_check(cli, op->admit);
+	if (retry_ms > 0)
+	{
+		op->throttled++;
+		RetryAfterPayload retry = {type, retry_ms};
+		client_send(cli, MSG_RETRY_AFTER, &retry, sizeof(retry));
+		return;
+	}
+
+	// Checked only now: a deferred request may follow the login it waited for
+	if ((op->flags & OP_AUTH) && cli->uid == 0)
+	{
+		reject(cli, op, "not logged in", len);
+		return;
+	}
+
+	// Nested dispatches (batches, gateway frames) count in their envelope too
+	uint64_t start = now_ns();
+	op->handler(cli, payload, len);
+	op->total_ns += now_ns() - start;
+	op->calls++;
+	op->bytes += len;
+}
+
+void dispatch_resume(Client *cli)
+{
+	while (!cli->co && cli->deferred)
+	{
+		DeferredPacket *d = cli->deferred;
+		cli->deferred = d->next;
+		if (!cli->deferred)
+			cli->deferred_tail = NULL;
+		cli->deferred_count--;
+
+		// Length checked on arrival
+		run_packet(cli, d->type, &opcodes[d->type], d->len > 0 ? d->payload : NULL, d->len);
+		free(d);
+	}
+}
+
+void dispatch_packet(Client *cli, MessageType type, void *payload, uint32_t len)
+{
+	Opcode *op = lookup(type);
+	if (!op)
+	{
+		log_print(LOG_WARN, "Unknown packet type %d from FD %d", type, cli->fd);
+		return;
+	}
+
+	// Malformed frames never reach a handler (or the deferred list)
+	if (len < op->min_len || len > op->max_len)
+	{
+		reject(cli, op, "bad length", len);
+		return;
+	}
+
+	// A handler of this client is waiting on an executor: keep request order
+	if (cli->co)
+	{
+		defer_packet(cli, type, payload, len);
+		return;
+	}
+
+	run_packet(cli, type, op, payload, len);
+}
+
+int dispatch_is_replay_safe(MessageType type)
+{
+	const Opcode *op = lookup(type);
+	return op && (op->flags & OP_REPLAY_SAFE);
+}
+
+int dispatch_is_batchable(MessageType type)
+{
+	const Opcode *op = lookup(type);
+	return op && (op->flags & OP_BATCHABLE);
+}
+
+void dispatch_log_stats(void)
+{
+	log_print(LOG_INFO, "Opcode stats (calls, bytes in, rejected, throttled, avg/total handler time):");
+	for (int t = 0; t < MSG_DISCONNECT; t++)
+	{
+		const Opcode *op = &opcodes[t];
+		if (!op->handler || (op->calls == 0 && op->errors == 0 && op->throttled == 0))
+			continue;
+		log_print(LOG_INFO, "  %-24s %10llu %12llu %8llu %8llu %10.1f us %10.1f ms", op->name,
+							(unsigned long long)op->calls, (unsigned long long)op->bytes, (unsigned long long)op->errors,
+							(unsigned long long)op->throttled,
+							op->calls ? op->total_ns / 1000.0 / op->calls : 0.0, op->total_ns / 1000000.0);
+	}
+}
@@ -0,0 +1,132 @@
+#include "infrastructure/early_data.h"
+#include "infrastructure/dispatcher.h"
+#include "system/logger.h"
+#include <openssl/sha.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Anti-replay: fingerprints of ClientHellos that carried accepted early data.
+// Open addressing with a short probe; entries older than the window are free.
+#define REPLAY_SLOTS 8192
+#define REPLAY_PROBES 8
+
+typedef struct
+{
+	uint64_t fingerprint;
+	time_t seen;
+} ReplayEntry;
+
+static ReplayEntry replay_table[REPLAY_SLOTS];
+static uint32_t early_max = 0;
+
+// Returns 1 if this ClientHello is new (and records it), 0 if seen or full
+static int replay_check_and_record(SSL *ssl)
+{
+	unsigned char random[SSL3_RANDOM_SIZE];
+	if (SSL_get_client_random(ssl, random, sizeof(random)) != sizeof(random))
+		return 0;
+
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	SHA256(random, sizeof(random), digest);
+	uint64_t fp;
+	memcpy(&fp, digest, sizeof(fp));
+
+	time_t now = time(NULL);
+	int free_slot = -1;
+	for (int i = 0; i < REPLAY_PROBES; i++)
+	{
+		int slot = (int)((fp + i) % REPLAY_SLOTS);
+		ReplayEntry *e = &replay_table[slot];
+		int live = e->seen != 0 && now - e->seen <= EARLY_DATA_REPLAY_WINDOW;
+		if (live && e->fingerprint == fp)
+			return 0; // Replay
+		if (!live && free_slot < 0)
+			free_slot = slot;
+	}
+	if (free_slot < 0)
+		return 0; // Table saturated: fall back to a full round trip
+
+	replay_table[free_slot].fingerprint = fp;
+	replay_table[free_slot].seen = now;
+	return 1;
+}
+
+static int allow_early_data_cb(SSL *ssl, void *arg)
+{
+	(void)arg;
+	return replay_check_and_record(ssl);
+}
+
+void early_data_init(SSL_CTX *ctx, uint32_t max_bytes)
+{
+	early_max = max_bytes > 0 ? max_bytes : EARLY_DATA_DEFAULT_MAX;
+	SSL_CTX_set_max_early_data(ctx, early_max);
+	SSL_CTX_set_recv_max_early_data(ctx, early_max);
+	SSL_CTX_set_allow_early_data_cb(ctx, allow_early_data_cb, NULL);
+}
+
+int early_data_read(SSL *ssl, uint8_t **buf, uint32_t *len)
+{
+	if (early_max == 0)
+		return 1; // Disabled: nothing to read
+
+	if (!*buf && !(*buf = malloc(early_max)))
+		return -1;
+
+	for (;;)
+	{
+		size_t n = 0;
+		int rc = SSL_read_early_data(ssl, *buf + *len, early_max - *len, &n);
+		*len += n;
+		if (rc == SSL_READ_EARLY_DATA_ERROR)
+		{
+			int err = SSL_get_error(ssl, rc);
+			if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+				return 0;
+			free(*buf);
+			*buf = NULL;
+			*len = 0;
+			return -1;
+		}
+		if (rc == SSL_READ_EARLY_DATA_FINISH || *len == early_max)
+			break;
+	}
+
+	if (*len == 0)
+	{
+		free(*buf);
+		*buf = NULL;
+	}
+	return 1;
+}
+
+void early_data_dispatch(Client *cli, const uint8_t *buf, uint32_t len)
+{
+	uint32_t offset = 0;
+	MessageType type;
+	const void *payload;
+	uint32_t payload_len;
+	int rc;
+
+	while ((rc = frame_next(buf, len, &offset, &type, &payload, &payload_len)) > 0)
+	{
+		if (!dispatch_is_replay_safe(type))
+		{
+			log_print(LOG_WARN, "Dropped opcode %d sent as early data (FD %d)", type, cli->fd);
+			continue;
+		}
+
+		// Handlers expect a NUL-terminated private copy, like recv_packet() gives them
+		char *copy = malloc(payload_len + 1);
+		if (!copy)
+			return;
+		if (payload_len > 0)
+			memcpy(copy, payload, payload_len);
+		copy[payload_len] = '\0';
+		dispatch_packet(cli, type, payload_len > 0 ? copy : NULL, payload_len);
+		free(copy);
+	}
+	if (rc < 0)
+		log_print(LOG_WARN, "Malformed early data from FD %d", cli->fd);
+}
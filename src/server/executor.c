@@ -0,0 +1,221 @@
+#include "infrastructure/executor.h"
+#include "system/logger.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+typedef struct Task
+{
+	_Atomic(struct Task *) next;
+	ExecutorFn run;
+	ExecutorFn done;
+	void *arg;
+} Task;
+
+// Intrusive multi-producer, single-consumer queue (Vyukov): pushing is one
+// atomic exchange, popping needs no atomic read-modify-write at all
+typedef struct
+{
+	_Atomic(Task *) head; // Producers
+	Task *tail;           // Consumer
+	Task stub;
+} Inbox;
+
+typedef struct
+{
+	pthread_t thread;
+	Inbox inbox;
+	sem_t ready; // One post per task, plus one to stop
+} Executor;
+
+static Executor *executors = NULL;
+static int executor_count = 0;
+static atomic_int stopping = 0;
+static atomic_int backlog = 0;
+
+// Finished tasks waiting for the event loop
+static Inbox completions;
+static int completion_fd = -1;
+
+static void inbox_init(Inbox *q)
+{
+	atomic_init(&q->stub.next, NULL);
+	atomic_init(&q->head, &q->stub);
+	q->tail = &q->stub;
+}
+
+static void inbox_push(Inbox *q, Task *t)
+{
+	atomic_store_explicit(&t->next, NULL, memory_order_relaxed);
+	Task *prev = atomic_exchange_explicit(&q->head, t, memory_order_acq_rel);
+	atomic_store_explicit(&prev->next, t, memory_order_release);
+}
+
+// NULL when empty, or while a push is half done (its producer is between
+// the exchange and the link; the item shows up on the next call)
+static Task *inbox_pop(Inbox *q)
+{
+	Task *tail = q->tail;
+	Task *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+	if (tail == &q->stub)
+	{
+		if (!next)
+			return NULL;
+		q->tail = next;
+		tail = next;
+		next = atomic_load_explicit(&next->next, memory_order_acquire);
+	}
+	if (next)
+	{
+		q->tail = next;
+		return tail;
+	}
+	if (tail != atomic_load_explicit(&q->head, memory_order_acquire))
+		return NULL;
+
+	inbox_push(q, &q->stub);
+	next = atomic_load_explicit(&tail->next, memory_order_acquire);
+	if (next)
+	{
+		q->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+static void *executor_main(void *arg)
+{
+	Executor *ex = arg;
+	while (1)
+	{
+		sem_wait(&ex->ready);
+		Task *t;
+		while (!(t = inbox_pop(&ex->inbox)))
+		{
+			if (atomic_load(&stopping))
+				return NULL; // The stop post: the inbox is drained
+			sched_yield(); // A push is mid-way
+		}
+
+		atomic_fetch_sub_explicit(&backlog, 1, memory_order_relaxed);
+		if (t->run)
+			t->run(t->arg);
+
+		if (t->done)
+		{
+			inbox_push(&completions, t);
+			uint64_t one = 1;
+			if (write(completion_fd, &one, sizeof(one)) < 0)
+				log_print(LOG_ERROR, "Executor cannot wake the event loop");
+		}
+		else
+		{
+			free(t);
+		}
+	}
+}
+
+int executor_init(int threads)
+{
+	inbox_init(&completions);
+	if (threads <= 0)
+		return -1;
+
+	completion_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	executors = calloc(threads, sizeof(Executor));
+	if (completion_fd < 0 || !executors)
+	{
+		log_print(LOG_ERROR, "Cannot start executors, running tasks inline");
+		return -1;
+	}
+
+	for (int i = 0; i < threads; i++)
+	{
+		Executor *ex = &executors[i];
+		inbox_init(&ex->inbox);
+		sem_init(&ex->ready, 0, 0);
+		if (pthread_create(&ex->thread, NULL, executor_main, ex) != 0)
+		{
+			log_print(LOG_ERROR, "Cannot start executor %d", i);
+			sem_destroy(&ex->ready);
+			break;
+		}
+		executor_count++;
+	}
+	return executor_count > 0 ? completion_fd : -1;
+}
+
+void executor_shutdown(void)
+{
+	atomic_store(&stopping, 1);
+	for (int i = 0; i < executor_count; i++)
+		sem_post(&executors[i].ready);
+	for (int i = 0; i < executor_count; i++)
+	{
+		pthread_join(executors[i].thread, NULL);
+		sem_destroy(&executors[i].ready);
+	}
+	executor_complete();
+
+	free(executors);
+	executors = NULL;
+	executor_count = 0;
+	if (completion_fd >= 0)
+		close(completion_fd);
+	completion_fd = -1;
+}
+
+int executor_threads(void)
+{
+	return executor_count;
+}
+
+int executor_backlog(void)
+{
+	return atomic_load_explicit(&backlog, memory_order_relaxed);
+}
+
+int executor_submit(uint32_t key, ExecutorFn run, ExecutorFn done, void *arg)
+{
+	if (executor_count == 0)
+	{
+		if (run)
+			run(arg);
+		if (done)
+			done(arg);
+		return 1;
+	}
+
+	Task *t = malloc(sizeof(Task));
+	if (!t)
+		return 0;
+	t->run = run;
+	t->done = done;
+	t->arg = arg;
+
+	// Fibonacci hashing spreads sequential ids across executors
+	Executor *ex = &executors[((uint32_t)(key * 2654435761u) >> 16) % (uint32_t)executor_count];
+	atomic_fetch_add_explicit(&backlog, 1, memory_order_relaxed);
+	inbox_push(&ex->inbox, t);
+	sem_post(&ex->ready);
+	return 1;
+}
+
+void executor_complete(void)
+{
+	uint64_t count;
+	if (completion_fd >= 0 && read(completion_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		log_print(LOG_WARN, "Executor completion read failed");
+
+	Task *t;
+	while ((t = inbox_pop(&completions)))
+	{
+		t->done(t->arg);
+		free(t);
+	}
+}
@@ -0,0 +1,263 @@
+#include "infrastructure/fanout.h"
+#include "infrastructure/client_manager.h"
+#include "infrastructure/outqueue.h"
+#include "system/logger.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define STATS_BUCKETS 1024
+
+struct FanoutJob
+{
+	uint32_t conv_id;
+	OutFrame *frame;
+	OutQueue **queues; // One reference each
+	uint32_t count;
+	uint32_t cap;
+	int64_t start_us;
+	atomic_uint shards_left;
+};
+
+typedef struct Shard
+{
+	FanoutJob *job;
+	uint32_t begin;
+	uint32_t end;
+	struct Shard *next;
+} Shard;
+
+// Per-conversation fan-out metrics
+typedef struct ChannelStats
+{
+	uint32_t conv_id;
+	uint64_t fanouts;
+	uint64_t connections;
+	uint64_t total_us;
+	uint32_t last_us;
+	uint32_t max_us;
+	struct ChannelStats *next;
+} ChannelStats;
+
+static pthread_t *workers = NULL;
+static int worker_count = 0;
+static uint32_t shard_size = 1;
+
+static pthread_mutex_t work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static Shard *work_head = NULL;
+static Shard *work_tail = NULL;
+static int stopping = 0;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static ChannelStats *stats[STATS_BUCKETS];
+
+static int64_t now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Called by whichever thread finishes the last shard
+static void finish(FanoutJob *job, int sharded)
+{
+	uint32_t us = (uint32_t)(now_us() - job->start_us);
+
+	pthread_mutex_lock(&stats_lock);
+	ChannelStats *st = stats[job->conv_id % STATS_BUCKETS];
+	while (st && st->conv_id != job->conv_id)
+		st = st->next;
+	if (!st && (st = calloc(1, sizeof(ChannelStats))))
+	{
+		st->conv_id = job->conv_id;
+		st->next = stats[job->conv_id % STATS_BUCKETS];
+		stats[job->conv_id % STATS_BUCKETS] = st;
+	}
+	if (st)
+	{
+		st->fanouts++;
+		st->connections += job->count;
+		st->total_us += us;
+		st->last_us = us;
+		if (us > st->max_us)
+			st->max_us = us;
+		if (sharded)
+			log_print(LOG_INFO, "Fan-out conv %u: %u connections in %.2f ms (avg %.2f ms, max %.2f ms over %llu)",
+								job->conv_id, job->count, us / 1000.0, st->total_us / 1000.0 / st->fanouts,
+								st->max_us / 1000.0, (unsigned long long)st->fanouts);
+	}
+	pthread_mutex_unlock(&stats_lock);
+
+	outframe_release(job->frame);
+	free(job->queues);
+	free(job);
+}
+
+static void flush_range(FanoutJob *job, uint32_t begin, uint32_t end)
+{
+	for (uint32_t i = begin; i < end; i++)
+	{
+		outqueue_flush(job->queues[i]);
+		outqueue_release(job->queues[i]);
+	}
+}
+
+static void *worker_main(void *arg)
+{
+	(void)arg;
+	while (1)
+	{
+		pthread_mutex_lock(&work_lock);
+		while (!work_head && !stopping)
+			pthread_cond_wait(&work_ready, &work_lock);
+		Shard *s = work_head;
+		if (s)
+		{
+			work_head = s->next;
+			if (!work_head)
+				work_tail = NULL;
+		}
+		pthread_mutex_unlock(&work_lock);
+		if (!s)
+			return NULL; // Stopping, and nothing left
+
+		flush_range(s->job, s->begin, s->end);
+		if (atomic_fetch_sub(&s->job->shards_left, 1) == 1)
+			finish(s->job, 1);
+		free(s);
+	}
+}
+
+void fanout_init(int count, int size)
+{
+	shard_size = size > 0 ? (uint32_t)size : 1;
+	if (count <= 0)
+		return;
+
+	workers = calloc(count, sizeof(pthread_t));
+	if (!workers)
+		return;
+	for (int i = 0; i < count; i++)
+	{
+		if (pthread_create(&workers[i], NULL, worker_main, NULL) != 0)
+		{
+			log_print(LOG_ERROR, "Cannot start fan-out worker %d", i);
+			break;
+		}
+		worker_count++;
+	}
+}
+
+void fanout_set_shard(int size)
+{
+	shard_size = size > 0 ? (uint32_t)size : 1;
+}
+
+void fanout_shutdown(void)
+{
+	pthread_mutex_lock(&work_lock);
+	stopping = 1;
+	pthread_cond_broadcast(&work_ready);
+	pthread_mutex_unlock(&work_lock);
+
+	for (int i = 0; i < worker_count; i++)
+		pthread_join(workers[i], NULL);
+	free(workers);
+	workers = NULL;
+	worker_count = 0;
+}
+
+FanoutJob *fanout_begin(uint32_t conv_id, MessageType type, const void *payload, uint32_t payload_len)
+{
+	// Queued frames go out with the next flush: inside a batch they must
+	// wait for its commit, which only client_send() knows how to do
+	if (client_coalescing())
+		return NULL;
+
+	FanoutJob *job = calloc(1, sizeof(FanoutJob));
+	if (!job)
+		return NULL;
+
+	job->frame = outframe_new(type, payload, payload_len);
+	if (!job->frame)
+	{
+		free(job);
+		return NULL;
+	}
+	job->conv_id = conv_id;
+	job->start_us = now_us();
+	return job;
+}
+
+int fanout_add(FanoutJob *job, Client *target)
+{
+	if (job->count == job->cap)
+	{
+		uint32_t cap = job->cap ? job->cap * 2 : 64;
+		OutQueue **grown = realloc(job->queues, cap * sizeof(OutQueue *));
+		if (!grown)
+			return 0;
+		job->queues = grown;
+		job->cap = cap;
+	}
+
+	OutQueue *q = client_enqueue(target, job->frame);
+	if (!q)
+		return 0;
+	outqueue_retain(q);
+	job->queues[job->count++] = q;
+	return 1;
+}
+
+void fanout_commit(FanoutJob *job)
+{
+	uint32_t shards = (job->count + shard_size - 1) / shard_size;
+	if (worker_count == 0 || shards <= 1)
+	{
+		flush_range(job, 0, job->count);
+		finish(job, 0);
+		return;
+	}
+
+	Shard *first = NULL, *last = NULL;
+	for (uint32_t begin = 0; begin < job->count; begin += shard_size)
+	{
+		Shard *s = malloc(sizeof(Shard));
+		if (!s)
+		{
+			// Out of memory: write the rest here
+			flush_range(job, begin, job->count);
+			break;
+		}
+		s->job = job;
+		s->begin = begin;
+		s->end = begin + shard_size < job->count ? begin + shard_size : job->count;
+		s->next = NULL;
+		if (last)
+			last->next = s;
+		else
+			first = s;
+		last = s;
+	}
+
+	uint32_t queued = 0;
+	for (Shard *s = first; s; s = s->next)
+		queued++;
+	if (queued == 0)
+	{
+		finish(job, 0);
+		return;
+	}
+	atomic_init(&job->shards_left, queued);
+
+	pthread_mutex_lock(&work_lock);
+	if (work_tail)
+		work_tail->next = first;
+	else
+		work_head = first;
+	work_tail = last;
+	pthread_cond_broadcast(&work_ready);
+	pthread_mutex_unlock(&work_lock);
+}
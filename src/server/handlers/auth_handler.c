@@ -1,50 +1,186 @@
 #include "handlers/auth_handler.h"
+#include "handlers/chat_handler.h"
+#include "infrastructure/bootstrap.h"
+#include "infrastructure/client_manager.h"
+#include "infrastructure/presence.h"
+#include "infrastructure/session.h"
+#include "infrastructure/coroutine.h"
 #include "system/storage.h"
 #include "system/logger.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+
+// Password hashing (crypt, 5000 SHA-512 rounds) runs on an executor:
+// these handlers are coroutines that await it (see coroutine.h)
+
+typedef struct {
+    RegisterPayload req;
+    char hash[128];
+    int hashed;
+} RegisterFrame;
+
+typedef struct {
+    LoginPayload req;
+    User user;
+    int found;
+    int verified;
+} LoginFrame;
+
+typedef struct {
+    UpdateUserPayload req;
+    char hash[128];
+    int hashed;
+} UpdateFrame;
+
+static void hash_new_password(void *arg) {
+    RegisterFrame *f = arg;
+    f->hashed = storage_hash_password(f->req.password, NULL, f->hash, sizeof(f->hash));
+}
+
+static CoStatus register_co(Coroutine *co, Client *cli) {
+    RegisterFrame *f = co->frame;
+    CO_BEGIN(co);
+    CO_AWAIT(co, (uint32_t)cli->conn_id, hash_new_password);
 
-void handle_register(Client *cli, const RegisterPayload *p) {
     char code[FRIEND_CODE_LEN];
     // storage_register_user generates the friend code and returns 1 on success
-    if (storage_register_user(p->email, p->username, p->password, code)) {
-        log_print(LOG_INFO, "Registered new user: %s (%s)", p->username, p->email);
-        send_packet(cli->ssl, MSG_REGISTER_SUCCESS, NULL, 0);
+    if (f->hashed && storage_register_user(f->req.email, f->req.username, f->hash, code)) {
+        log_print(LOG_INFO, "Registered new user: %s (%s)", f->req.username, f->req.email);
+        client_send(cli, MSG_REGISTER_SUCCESS, NULL, 0);
+    } else {
+        log_print(LOG_WARN, "Registration failed for: %s", f->req.email);
+        client_send(cli, MSG_REGISTER_FAIL, NULL, 0);
+    }
+    CO_END(co);
+}
+
+void handle_register(Client *cli, const RegisterPayload *p) {
+    RegisterFrame *f = calloc(1, sizeof(RegisterFrame));
+    if (!f) {
+        client_send(cli, MSG_REGISTER_FAIL, NULL, 0);
+        return;
+    }
+    f->req = *p;
+    coroutine_start(cli, register_co, f, NULL);
+}
+
+// Shared tail of MSG_LOGIN and MSG_RESUME
+static void complete_login(Client *cli, const MyInfoPayload *info)
+{
+    // Update the Client state (in memory)
+    strncpy(cli->username, info->username, MAX_NAME_LEN);
+    client_bind_uid(cli, info->uid);
+
+    LoginSuccessPayload resp;
+    resp.me = *info;
+    session_issue(info, &resp.token);
+
+    client_send(cli, MSG_LOGIN_SUCCESS, &resp, sizeof(resp));
+
+    presence_on_login(cli);
+    push_offline_messages(cli);
+}
+
+static void verify_password(void *arg) {
+    LoginFrame *f = arg;
+    f->verified = storage_verify_password(f->req.password, f->user.password_hash);
+}
+
+static CoStatus login_co(Coroutine *co, Client *cli) {
+    LoginFrame *f = co->frame;
+    CO_BEGIN(co);
+    if (f->found)
+        CO_AWAIT(co, f->user.uid, verify_password);
+
+    if (f->verified) {
+        // Prepare response payload
+        MyInfoPayload info = {0};
+        info.uid = f->user.uid;
+        strncpy(info.username, f->user.username, MAX_NAME_LEN);
+        strncpy(info.email, f->user.email, MAX_EMAIL_LEN);
+        strncpy(info.friend_code, f->user.friend_code, FRIEND_CODE_LEN);
+
+        log_print(LOG_INFO, "User %s (UID: %d) logged in", f->user.username, f->user.uid);
+        complete_login(cli, &info);
     } else {
-        log_print(LOG_WARN, "Registration failed for: %s", p->email);
-        send_packet(cli->ssl, MSG_REGISTER_FAIL, NULL, 0);
+        log_print(LOG_WARN, "Login failed from FD %d", cli->fd);
+        client_send(cli, MSG_LOGIN_FAIL, NULL, 0);
     }
+    CO_END(co);
 }
 
 void handle_login(Client *cli, const LoginPayload *p) {
-    User u;
     log_print(LOG_INFO, "Login attempt from FD %d", cli->fd);
-    
-    if (storage_check_credentials(p->email, p->password, &u)) {
-        // Update the Client state (in memory)
-        strncpy(cli->username, u.username, MAX_NAME_LEN);
-        cli->uid = u.uid;
-        cli->is_online = 1;
 
-        // Prepare response payload
-        MyInfoPayload info;
+    LoginFrame *f = calloc(1, sizeof(LoginFrame));
+    if (!f) {
+        client_send(cli, MSG_LOGIN_FAIL, NULL, 0);
+        return;
+    }
+    f->req = *p;
+    f->found = storage_get_user_by_email(p->email, &f->user);
+    coroutine_start(cli, login_co, f, NULL);
+}
+
+void handle_resume(Client *cli, const SessionToken *token) {
+    MyInfoPayload info;
+    if (session_verify(token, &info)) {
+        log_print(LOG_INFO, "User %s (UID: %d) resumed session", info.username, info.uid);
+        complete_login(cli, &info);
+    } else {
+        log_print(LOG_WARN, "Session resume refused from FD %d", cli->fd);
+        client_send(cli, MSG_LOGIN_FAIL, NULL, 0);
+    }
+}
+
+static void hash_updated_password(void *arg) {
+    UpdateFrame *f = arg;
+    f->hashed = storage_hash_password(f->req.new_password, NULL, f->hash, sizeof(f->hash));
+}
+
+static CoStatus update_user_co(Coroutine *co, Client *cli)
+{
+    UpdateFrame *f = co->frame;
+    CO_BEGIN(co);
+    if (strlen(f->req.new_password) > 0)
+        CO_AWAIT(co, cli->uid, hash_updated_password);
+
+    const UpdateUserPayload *p = &f->req;
+    storage_update_user(cli->uid, p->new_username, f->hashed ? f->hash : NULL);
+    if (strlen(p->new_username) > 0) {
+        strncpy(cli->username, p->new_username, MAX_NAME_LEN);
+        // Usernames appear in other users' contacts, requests and chat names
+        bootstrap_invalidate_all();
+    }
+
+    // Older tokens carry the old identity (or predate a password change)
+    session_revoke_user(cli->uid);
+
+    SessionToken token = {0};
+    User u;
+    if (storage_get_user_by_uid(cli->uid, &u)) {
+        MyInfoPayload info = {0};
         info.uid = u.uid;
         strncpy(info.username, u.username, MAX_NAME_LEN);
         strncpy(info.email, u.email, MAX_EMAIL_LEN);
         strncpy(info.friend_code, u.friend_code, FRIEND_CODE_LEN);
-        
-        send_packet(cli->ssl, MSG_LOGIN_SUCCESS, &info, sizeof(info));
-        log_print(LOG_INFO, "User %s (UID: %d) logged in", u.username, u.uid);
-    } else {
-        log_print(LOG_WARN, "Login failed from FD %d", cli->fd);
-        send_packet(cli->ssl, MSG_LOGIN_FAIL, NULL, 0);
+        session_issue(&info, &token);
     }
+    client_send(cli, MSG_UPDATE_SUCCESS, &token, sizeof(token));
+    CO_END(co);
 }
 
 void handle_update_user(Client *cli, const UpdateUserPayload *p)
 {
-    storage_update_user(cli->uid, p->new_username, p->new_password);
-    if (strlen(p->new_username) > 0)
-        strncpy(cli->username, p->new_username, MAX_NAME_LEN);
-    send_packet(cli->ssl, MSG_UPDATE_SUCCESS, NULL, 0);
+    UpdateFrame *f = calloc(1, sizeof(UpdateFrame));
+    if (!f)
+        return;
+    f->req = *p;
+    coroutine_start(cli, update_user_co, f, NULL);
+}
+
+void handle_req_bootstrap(Client *cli, const BootstrapRequestPayload *p)
+{
+    bootstrap_send(cli, p->known_version);
 }
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "handlers/batch_handler.h"
+#include "handlers/group_handler.h"
+#include "infrastructure/client_manager.h"
+#include "infrastructure/dispatcher.h"
+#include "system/storage.h"
+#include "system/logger.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Checks the whole envelope before anything runs
+static int count_ops(const void *payload, uint32_t len)
+{
+	uint32_t offset = 0;
+	MessageType sub_type;
+	const void *sub_payload;
+	uint32_t sub_len;
+	int count = 0, rc;
+
+	while ((rc = frame_next(payload, len, &offset, &sub_type, &sub_payload, &sub_len)) > 0)
+	{
+		if (++count > MAX_BATCH_OPS)
+			return -1;
+	}
+	return rc < 0 ? -1 : count;
+}
+
+void handle_batch(Client *cli, const void *payload, uint32_t len)
+{
+	BatchResultEntry results[MAX_BATCH_OPS];
+	int count = 0;
+
+	// An empty result tells the client nothing ran
+	int total = count_ops(payload, len);
+	if (total < 0)
+	{
+		log_print(LOG_WARN, "Rejected batch from %s (malformed or over %d ops)", cli->username, MAX_BATCH_OPS);
+		client_send(cli, MSG_BATCH_RESULT, NULL, 0);
+		return;
+	}
+	if (!storage_begin())
+	{
+		log_print(LOG_ERROR, "Rejected batch from %s (cannot open a transaction)", cli->username);
+		client_send(cli, MSG_BATCH_RESULT, NULL, 0);
+		return;
+	}
+
+	// Nothing reaches other clients before the commit
+	client_coalesce_begin(cli);
+	group_defer_notifications();
+
+	uint32_t offset = 0;
+	MessageType sub_type;
+	const void *sub_payload;
+	uint32_t sub_len;
+	while (count < total && frame_next(payload, len, &offset, &sub_type, &sub_payload, &sub_len) > 0)
+	{
+		results[count].request_type = sub_type;
+		results[count].reply_type = 0;
+
+		if (dispatch_is_batchable(sub_type))
+		{
+			// Handlers expect a NUL-terminated private copy, like recv_packet() gives them
+			char *copy = malloc(sub_len + 1);
+			if (copy)
+			{
+				if (sub_len > 0)
+					memcpy(copy, sub_payload, sub_len);
+				copy[sub_len] = '\0';
+				dispatch_packet(cli, sub_type, sub_len > 0 ? copy : NULL, sub_len);
+				results[count].reply_type = client_coalesce_take_reply();
+				free(copy);
+			}
+		}
+		else
+		{
+			log_print(LOG_WARN, "Rejected non-batchable type %d in batch from %s", sub_type, cli->username);
+		}
+		count++;
+	}
+
+	int applied = storage_commit();
+	if (!applied)
+	{
+		log_print(LOG_ERROR, "Batch commit failed for %s, rolling back", cli->username);
+		storage_rollback();
+		count = 0;
+	}
+
+	group_flush_notifications(applied);
+
+	// Refreshes go out first so the result marks the batch as fully applied
+	client_coalesce_end(applied);
+	client_send(cli, MSG_BATCH_RESULT, results, count * sizeof(BatchResultEntry));
+
+	log_print(LOG_INFO, "User %s executed batch of %d ops", cli->username, count);
+}
@@ -1,51 +1,117 @@
 #include "handlers/chat_handler.h"
 #include "infrastructure/client_manager.h"
+#include "infrastructure/stream.h"
+#include "infrastructure/membership.h"
+#include "infrastructure/fanout.h"
 #include "system/storage.h"
 #include "system/logger.h"
 #include <stdlib.h>
 #include <string.h>
 
+// Offline messages per stream; the client's ack pulls the next page
+#define OFFLINE_PAGE 256
+
 void handle_send_text(Client *cli, const SendMessagePayload *p)
 {
 	log_print(LOG_INFO, "User %s sent message to conv %d", cli->username, p->conv_id);
 
+	const MemberList *members = membership_get(p->conv_id);
+	int broadcast = members && members->type == CONV_TYPE_BROADCAST;
+
+	// Broadcast channels are announcements: only admins post
+	if (broadcast && !storage_is_admin(p->conv_id, cli->uid))
+		return;
+
+	// Message and its pending deliveries are committed together
+	int in_txn = storage_begin();
+
 	// 1. Log to DB
-	storage_log_message(p->conv_id, cli->uid, p->text);
+	uint32_t msg_id = storage_log_message(p->conv_id, cli->uid, p->text);
+	if (msg_id == 0)
+	{
+		if (in_txn)
+			storage_rollback();
+		return;
+	}
+
+	// 2. Queue the message for offline participants (broadcast members
+	// catch up through the history instead)
+	uint32_t count = members ? members->count : 0;
+	for (uint32_t i = 0; i < count && !broadcast; i++)
+	{
+		uint32_t target_uid = members->uids[i];
+		if (target_uid == cli->uid)
+			continue;
+
+		Client *target_cli = get_client_by_uid(target_uid);
+		if (!target_cli || !target_cli->is_online)
+			storage_add_pending_delivery(target_uid, msg_id);
+	}
+
+	// Nobody hears of a message that was not stored
+	if (in_txn && !storage_commit())
+	{
+		storage_rollback();
+		return;
+	}
 
-	// 2. Notify Participants
-	uint32_t members[MAX_PARTICIPANTS];
-	int count = storage_get_conv_participants(p->conv_id, members, MAX_PARTICIPANTS);
+	// 3. Notify the online participants. Nothing ran on the loop since the
+	// loop above, so they are the ones it skipped. The routed frame is
+	// serialized once for every recipient
+	RoutedMessagePayload rp;
+	rp.conv_id = p->conv_id;
+	rp.sender_uid = cli->uid;
+	strncpy(rp.sender_username, cli->username, MAX_NAME_LEN);
+	strncpy(rp.text, p->text, MAX_TEXT_LEN);
+	FanoutJob *job = fanout_begin(p->conv_id, MSG_RTE_TEXT, &rp, sizeof(rp));
 
-	for (int i = 0; i < count; i++)
+	for (uint32_t i = 0; i < count; i++)
 	{
-		uint32_t target_uid = members[i];
+		uint32_t target_uid = members->uids[i];
 		if (target_uid == cli->uid)
 			continue;
 
 		Client *target_cli = get_client_by_uid(target_uid);
 		if (target_cli && target_cli->is_online)
 		{
-			RoutedMessagePayload rp;
-			rp.conv_id = p->conv_id;
-			rp.sender_uid = cli->uid;
-			strncpy(rp.sender_username, cli->username, MAX_NAME_LEN);
-			strncpy(rp.text, p->text, MAX_TEXT_LEN);
-			send_packet(target_cli->ssl, MSG_RTE_TEXT, &rp, sizeof(rp));
+			if (!job || !fanout_add(job, target_cli))
+				client_send(target_cli, MSG_RTE_TEXT, &rp, sizeof(rp));
 		}
 	}
+
+	if (job)
+		fanout_commit(job);
+}
+
+void push_offline_messages(Client *cli)
+{
+	if (!storage_has_pending_deliveries(cli->uid))
+		return;
+
+	// Sent a page at a time, the next one once the client acks this one;
+	// entries stay queued until then so a dropped connection loses nothing
+	ResponseStream s;
+	StreamRowSink sink = {&s, sizeof(OfflineMessage)};
+	stream_begin(&s, cli, MSG_OFFLINE_MESSAGES);
+	int count = storage_each_pending_message(cli->uid, OFFLINE_PAGE, stream_row, &sink);
+	stream_end(&s);
+	log_print(LOG_INFO, "Delivered %d offline messages to %s", count, cli->username);
+}
+
+void handle_offline_ack(Client *cli, const OfflineAckPayload *p)
+{
+	int cleared = storage_clear_pending_deliveries(cli->uid, p->last_message_id);
+	log_print(LOG_DEBUG, "User %s acked %d offline messages", cli->username, cleared);
+	if (cleared > 0)
+		push_offline_messages(cli);
 }
 
 void handle_req_history(Client *cli, const RequestHistoryPayload *p)
 {
-	char *hist = storage_get_history(p->conv_id);
-	if (hist)
-	{
-		send_packet(cli->ssl, MSG_RESP_HISTORY, hist, strlen(hist));
-		free(hist);
-	}
-	else
-	{
-		// Send empty history if null
-		send_packet(cli->ssl, MSG_RESP_HISTORY, "", 0);
-	}
+	// Streamed line by line so the client can render while rows arrive
+	ResponseStream s;
+	StreamRowSink sink = {&s, 0};
+	stream_begin(&s, cli, MSG_RESP_HISTORY);
+	storage_each_history_line(p->conv_id, stream_row, &sink);
+	stream_end(&s);
 }
\ No newline at end of file
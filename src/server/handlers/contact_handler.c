@@ -1,13 +1,50 @@
 #include "handlers/contact_handler.h"
+#include "handlers/group_handler.h"
+#include "infrastructure/bootstrap.h"
 #include "infrastructure/client_manager.h"
+#include "infrastructure/stream.h"
+#include "infrastructure/presence.h"
 #include "system/storage.h"
 #include "system/logger.h"
 
+// Unsolicited refreshes stay single-frame so batches can coalesce them
+static void push_contacts(Client *c)
+{
+    RowBuffer rows = {NULL, 0, 0, sizeof(ContactSummary)};
+    storage_each_contact(c->uid, row_buffer_add, &rows);
+    presence_fill((ContactSummary *)rows.data, rows.used / sizeof(ContactSummary));
+    client_send(c, MSG_RESP_CONTACTS, rows.data, rows.used);
+    row_buffer_free(&rows);
+}
+
+static void push_requests(Client *c)
+{
+    RowBuffer rows = {NULL, 0, 0, sizeof(ContactSummary)};
+    storage_each_request(c->uid, row_buffer_add, &rows);
+    client_send(c, MSG_RESP_REQUESTS, rows.data, rows.used);
+    row_buffer_free(&rows);
+}
+
+// Fills is_online from the live registry before streaming the row
+static int stream_contact_row(const void *row, void *ctx)
+{
+    ContactSummary contact = *(const ContactSummary *)row;
+    presence_fill(&contact, 1);
+    return stream_row(&contact, ctx);
+}
+
 void handle_req_contacts(Client *cli)
 {
-    ContactSummary contacts[50];
-    int count = storage_get_contacts_data(cli->uid, contacts, 50);
-    send_packet(cli->ssl, MSG_RESP_CONTACTS, contacts, count * sizeof(ContactSummary));
+    ResponseStream s;
+    StreamRowSink sink = {&s, sizeof(ContactSummary)};
+    stream_begin(&s, cli, MSG_RESP_CONTACTS);
+    storage_each_contact(cli->uid, stream_contact_row, &sink);
+    stream_end(&s);
+}
+
+void handle_presence_subscribe(Client *cli)
+{
+    cli->presence_subscribed = 1;
 }
 
 void handle_add_by_code(Client *cli, const AddContactPayload *p)
@@ -15,27 +52,27 @@ void handle_add_by_code(Client *cli, const AddContactPayload *p)
     uint32_t target_uid;
     if (storage_get_uid_by_code(p->friend_code, &target_uid)) {
         if (storage_add_request(cli->uid, target_uid)) {
-            send_packet(cli->ssl, MSG_ADD_REQ_SENT, NULL, 0);
+            bootstrap_invalidate(target_uid);
+            client_send(cli, MSG_ADD_REQ_SENT, NULL, 0);
             
             Client *tc = get_client_by_uid(target_uid);
-            if (tc && tc->is_online) {
-                ContactSummary reqs[50];
-                int count = storage_get_requests_data(target_uid, reqs, 50);
-                send_packet(tc->ssl, MSG_RESP_REQUESTS, reqs, count * sizeof(ContactSummary));
-            }
+            if (tc && tc->is_online)
+                push_requests(tc);
         } else {
-            send_packet(cli->ssl, MSG_ADD_FAIL, NULL, 0);
+            client_send(cli, MSG_ADD_FAIL, NULL, 0);
         }
     } else {
-        send_packet(cli->ssl, MSG_ADD_FAIL, NULL, 0);
+        client_send(cli, MSG_ADD_FAIL, NULL, 0);
     }
 }
 
 void handle_get_requests(Client *cli)
 {
-    ContactSummary reqs[50];
-    int count = storage_get_requests_data(cli->uid, reqs, 50);
-    send_packet(cli->ssl, MSG_RESP_REQUESTS, reqs, count * sizeof(ContactSummary));
+    ResponseStream s;
+    StreamRowSink sink = {&s, sizeof(ContactSummary)};
+    stream_begin(&s, cli, MSG_RESP_REQUESTS);
+    storage_each_request(cli->uid, stream_row, &sink);
+    stream_end(&s);
 }
 
 void handle_decide_request(Client *cli, const DecideRequestPayload *p)
@@ -47,41 +84,27 @@ void handle_decide_request(Client *cli, const DecideRequestPayload *p)
         uint32_t uids[2] = {cli->uid, p->target_uid};
         uint32_t conv_id = storage_find_private_conversation(cli->uid, p->target_uid);
         
-        int new_conv = 0;
         if (conv_id == 0) {
-            storage_create_conversation(CONV_TYPE_PRIVATE, "Private Chat", "", uids, 2);
-            new_conv = 1;
-        }
-
-        if (new_conv) {
-            // Refresh Me
-            ConversationSummary my_convs[50];
-            int c1 = storage_get_user_conversations(cli->uid, my_convs, 50);
-            send_packet(cli->ssl, MSG_RESP_CONVERSATIONS, my_convs, c1 * sizeof(ConversationSummary));
+            conv_id = storage_create_conversation(CONV_TYPE_PRIVATE, "Private Chat", "", uids, 2);
 
-            // Refresh Them
-            Client *orig = get_client_by_uid(p->target_uid);
-            if (orig && orig->is_online) {
-                ConversationSummary their_convs[50];
-                int c2 = storage_get_user_conversations(p->target_uid, their_convs, 50);
-                send_packet(orig->ssl, MSG_RESP_CONVERSATIONS, their_convs, c2 * sizeof(ConversationSummary));
-            }
+            // Both sides get the new chat
+            if (conv_id > 0)
+                group_push_conversation(conv_id);
         }
     }
     
     storage_remove_request(p->target_uid, cli->uid);
+    bootstrap_invalidate(cli->uid);
+    bootstrap_invalidate(p->target_uid);
 
     // Refresh lists
-    handle_req_contacts(cli); // Send contacts
-    handle_get_requests(cli); // Send requests remaining
+    push_contacts(cli); // Send contacts
+    push_requests(cli); // Send requests remaining
 
     // Refresh Sender if accepted
     if (p->accepted) {
         Client *orig = get_client_by_uid(p->target_uid);
-        if (orig && orig->is_online) {
-            ContactSummary sender_contacts[50];
-            int s_count = storage_get_contacts_data(p->target_uid, sender_contacts, 50);
-            send_packet(orig->ssl, MSG_RESP_CONTACTS, sender_contacts, s_count * sizeof(ContactSummary));
-        }
+        if (orig && orig->is_online)
+            push_contacts(orig);
     }
 }
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include "handlers/gateway_handler.h"
+#include "infrastructure/client_manager.h"
+#include "infrastructure/dispatcher.h"
+#include "infrastructure/presence.h"
+#include "infrastructure/bootstrap.h"
+#include "infrastructure/topics.h"
+#include "system/logger.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int max_sessions = 0;
+
+void gateway_init(int max)
+{
+	max_sessions = max > 0 ? max : 0;
+}
+
+// Same cleanup as a dropped socket, minus the socket
+static void close_session(Client *link, Client *session)
+{
+	uint32_t uid = session->uid;
+	topics_release(session);
+	remove_client(session->fd);
+	link->gw_sessions--;
+
+	presence_on_disconnect(uid);
+	if (uid > 0 && client_count_by_uid(uid) == 0)
+		bootstrap_release(uid);
+}
+
+static int read_header(const void *payload, uint32_t len, GatewayFrameHeader *gh)
+{
+	if (!payload || len < sizeof(GatewayFrameHeader))
+		return 0;
+	memcpy(gh, payload, sizeof(*gh));
+	return gh->session_id != 0;
+}
+
+void handle_gw_frame(Client *link, const void *payload, uint32_t len)
+{
+	GatewayFrameHeader gh;
+
+	// Only an authenticated, direct connection may act as a gateway
+	if (max_sessions == 0 || link->uid == 0 || link->gw_session != 0 || !read_header(payload, len, &gh))
+	{
+		log_print(LOG_WARN, "Rejected gateway frame from FD %d", link->fd);
+		return;
+	}
+	if (gh.inner_type == MSG_GW_FRAME || gh.inner_type == MSG_GW_CLOSE)
+		return;
+
+	Client *session = get_gateway_session(link, gh.session_id);
+	if (!session)
+	{
+		if (link->gw_sessions >= max_sessions ||
+				!(session = add_gateway_session(link, gh.session_id)))
+		{
+			log_print(LOG_WARN, "Gateway %s: refused session %u", link->username, gh.session_id);
+			GatewayFrameHeader refused = {gh.session_id, 0};
+			client_send(link, MSG_GW_CLOSE, &refused, sizeof(refused));
+			return;
+		}
+		link->gw_sessions++;
+	}
+
+	// Handlers expect a NUL-terminated private copy, like recv_packet() gives them
+	uint32_t inner_len = len - sizeof(GatewayFrameHeader);
+	char *copy = malloc(inner_len + 1);
+	if (!copy)
+		return;
+	if (inner_len > 0)
+		memcpy(copy, (const uint8_t *)payload + sizeof(GatewayFrameHeader), inner_len);
+	copy[inner_len] = '\0';
+
+	dispatch_packet(session, (MessageType)gh.inner_type, inner_len > 0 ? copy : NULL, inner_len);
+	free(copy);
+}
+
+void handle_gw_close(Client *link, const void *payload, uint32_t len)
+{
+	GatewayFrameHeader gh;
+	if (!read_header(payload, len, &gh))
+		return;
+
+	Client *session = get_gateway_session(link, gh.session_id);
+	if (session)
+		close_session(link, session);
+}
+
+void gateway_release(Client *link)
+{
+	if (link->gw_sessions == 0)
+		return;
+
+	log_print(LOG_INFO, "Gateway %s closed, ending %d sessions", link->username, link->gw_sessions);
+	Client *session;
+	while ((session = client_next_gateway_session(link)) != NULL)
+		close_session(link, session);
+}
@@ -1,37 +1,162 @@
 #include "handlers/group_handler.h"
+#include "infrastructure/bootstrap.h"
 #include "infrastructure/client_manager.h"
+#include "infrastructure/stream.h"
+#include "infrastructure/telemetry.h"
+#include "infrastructure/membership.h"
+#include "infrastructure/executor.h"
+#include "infrastructure/fanout.h"
 #include "system/storage.h"
 #include "system/logger.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
-// Helper logic specific to groups
-static void notify_group_update(uint32_t conv_id, uint32_t exclude_uid)
+// Deferred fan-out (see group_defer_notifications)
+static int defer_notifications = 0;
+static uint32_t deferred_convs[MAX_BATCH_OPS];
+static int deferred_count = 0;
+static uint32_t deferred_drops[MAX_BATCH_OPS]; // Deleted convs whose rings go if the batch commits
+static int deferred_drop_count = 0;
+
+// Rings belong to their channel's executor (see telemetry.h)
+static void drop_telemetry(void *arg)
+{
+	telemetry_drop((uint32_t)(uintptr_t)arg);
+}
+
+static void submit_drop_telemetry(uint32_t conv_id)
 {
-	uint32_t members[MAX_PARTICIPANTS];
-	int count = storage_get_conv_participants(conv_id, members, MAX_PARTICIPANTS);
+	executor_submit(conv_id, drop_telemetry, NULL, (void *)(uintptr_t)conv_id);
+}
 
-	for (int i = 0; i < count; i++)
+// Sends `update` to the online users in `uids`, as one shared frame when
+// possible. `admin_uid` (0 = none) gets its own copy with ROLE_ADMIN.
+static void send_conv_update(uint32_t conv_id, const uint32_t *uids, uint32_t count, uint32_t exclude_uid,
+														 uint32_t admin_uid, ConvUpdatePayload *update)
+{
+	FanoutJob *job = fanout_begin(conv_id, MSG_CONV_UPDATED, update, sizeof(*update));
+	for (uint32_t i = 0; i < count; i++)
 	{
-		if (members[i] == exclude_uid)
+		if (uids[i] == exclude_uid)
+			continue;
+
+		Client *c = get_client_by_uid(uids[i]);
+		if (!c || !c->is_online)
 			continue;
 
-		Client *c = get_client_by_uid(members[i]);
-		if (c && c->is_online)
+		if (uids[i] == admin_uid)
+		{
+			ConvUpdatePayload own = *update;
+			own.conv.my_role = ROLE_ADMIN;
+			client_send(c, MSG_CONV_UPDATED, &own, sizeof(own));
+		}
+		else if (!job || !fanout_add(job, c))
+		{
+			client_send(c, MSG_CONV_UPDATED, update, sizeof(*update));
+		}
+	}
+	if (job)
+		fanout_commit(job);
+}
+
+// Pushes the conversation's current summary to its members
+static void send_group_update(uint32_t conv_id, uint32_t exclude_uid, uint32_t admin_uid)
+{
+	const MemberList *members = membership_get(conv_id);
+	if (!members)
+		return;
+
+	ConvUpdatePayload update = {CONV_EVENT_CHANGED, {0}};
+	if (members->type == CONV_TYPE_PRIVATE)
+	{
+		// Each side sees the other's name
+		for (uint32_t i = 0; i < members->count; i++)
 		{
-			ConversationSummary summaries[50];
-			int n = storage_get_user_conversations(members[i], summaries, 50);
-			send_packet(c->ssl, MSG_RESP_CONVERSATIONS, summaries, n * sizeof(ConversationSummary));
+			Client *c = members->uids[i] == exclude_uid ? NULL : get_client_by_uid(members->uids[i]);
+			if (c && c->is_online && storage_get_conversation(conv_id, c->uid, &update.conv))
+				client_send(c, MSG_CONV_UPDATED, &update, sizeof(update));
 		}
+		return;
 	}
+
+	if (!storage_get_conversation(conv_id, 0, &update.conv))
+		return;
+	send_conv_update(conv_id, members->uids, members->count, exclude_uid, admin_uid, &update);
+}
+
+static void send_conv_removed(uint32_t conv_id, const uint32_t *uids, uint32_t count)
+{
+	ConvUpdatePayload update = {CONV_EVENT_REMOVED, {0}};
+	update.conv.conv_id = conv_id;
+	send_conv_update(conv_id, uids, count, 0, 0, &update);
+}
+
+void group_push_conversation(uint32_t conv_id)
+{
+	send_group_update(conv_id, 0, 0);
 }
 
-void handle_create_conv(Client *cli, const CreateConvPayload *p)
+static void notify_group_update(uint32_t conv_id, uint32_t exclude_uid)
 {
-	uint32_t uids[MAX_PARTICIPANTS];
-	int count = p->participants_count;
-	if (count > MAX_PARTICIPANTS)
-		count = MAX_PARTICIPANTS;
-	memcpy(uids, p->participant_uids, count * sizeof(uint32_t));
+	bootstrap_invalidate_conv(conv_id);
+
+	if (defer_notifications && exclude_uid == 0)
+	{
+		for (int i = 0; i < deferred_count; i++)
+		{
+			if (deferred_convs[i] == conv_id)
+				return;
+		}
+		if (deferred_count < MAX_BATCH_OPS)
+		{
+			deferred_convs[deferred_count++] = conv_id;
+			return;
+		}
+	}
+	send_group_update(conv_id, exclude_uid, 0);
+}
+
+void group_defer_notifications(void)
+{
+	defer_notifications = 1;
+	deferred_count = 0;
+	deferred_drop_count = 0;
+}
+
+void group_flush_notifications(int applied)
+{
+	defer_notifications = 0;
+	for (int i = 0; i < deferred_count; i++)
+	{
+		if (applied)
+			send_group_update(deferred_convs[i], 0, 0);
+		else
+			membership_drop(deferred_convs[i]);
+	}
+	deferred_count = 0;
+
+	// The ring files can't be rolled back: they go only with a committed delete
+	for (int i = 0; i < deferred_drop_count && applied; i++)
+		submit_drop_telemetry(deferred_drops[i]);
+	deferred_drop_count = 0;
+}
+
+void handle_create_conv(Client *cli, const void *payload, uint32_t len)
+{
+	// participant_uids may run past MAX_PARTICIPANTS, up to the payload length
+	const size_t fixed = offsetof(CreateConvPayload, participant_uids);
+
+	const CreateConvPayload *p = payload;
+	uint32_t count = p->participants_count;
+	if (count > (len - fixed) / sizeof(uint32_t))
+		count = (len - fixed) / sizeof(uint32_t);
+
+	uint32_t *uids = malloc((count > 0 ? count : 1) * sizeof(uint32_t));
+	if (!uids)
+		return;
+	memcpy(uids, (const uint8_t *)payload + fixed, count * sizeof(uint32_t));
 
 	uint32_t new_id = 0;
 	int created = 0;
@@ -44,37 +169,36 @@ void handle_create_conv(Client *cli, const CreateConvPayload *p)
 
 	if (new_id == 0)
 	{
-		new_id = storage_create_conversation(p->type, p->name, p->description, uids, count);
+		// One transaction for all participant rows
+		int in_txn = storage_begin();
+		new_id = storage_create_conversation(p->type, p->name, p->description, uids, (int)count);
+		if (in_txn && !storage_commit())
+		{
+			storage_rollback();
+			new_id = 0;
+		}
 		created = 1;
 	}
 
-	send_packet(cli->ssl, MSG_CONV_CREATED, &new_id, sizeof(new_id));
+	client_send(cli, MSG_CONV_CREATED, &new_id, sizeof(new_id));
 
 	if (created && new_id > 0)
 	{
-		// Notify others
-		for (int i = 0; i < count; i++)
-		{
-			uint32_t uid = uids[i];
-			if (uid == cli->uid)
-				continue;
+		bootstrap_invalidate_conv(new_id);
 
-			Client *target = get_client_by_uid(uid);
-			if (target && target->is_online)
-			{
-				ConversationSummary summaries[50];
-				int c = storage_get_user_conversations(uid, summaries, 50);
-				send_packet(target->ssl, MSG_RESP_CONVERSATIONS, summaries, c * sizeof(ConversationSummary));
-			}
-		}
+		// Notify others; the first participant of a group is its admin
+		send_group_update(new_id, cli->uid, (count > 0 && p->type != CONV_TYPE_PRIVATE) ? uids[0] : 0);
 	}
+	free(uids);
 }
 
 void handle_req_conversations(Client *cli)
 {
-	ConversationSummary summaries[50];
-	int count = storage_get_user_conversations(cli->uid, summaries, 50);
-	send_packet(cli->ssl, MSG_RESP_CONVERSATIONS, summaries, count * sizeof(ConversationSummary));
+	ResponseStream s;
+	StreamRowSink sink = {&s, sizeof(ConversationSummary)};
+	stream_begin(&s, cli, MSG_RESP_CONVERSATIONS);
+	storage_each_user_conversation(cli->uid, stream_row, &sink);
+	stream_end(&s);
 }
 
 void handle_update_group(Client *cli, const UpdateGroupPayload *p)
@@ -95,18 +219,26 @@ void handle_add_member(Client *cli, const AddMemberPayload *p)
 		{
 			if (storage_add_participant(p->conv_id, target_uid, 0))
 			{
-				send_packet(cli->ssl, MSG_MEMBER_ADDED, NULL, 0);
+				membership_add(p->conv_id, target_uid);
+				client_send(cli, MSG_MEMBER_ADDED, NULL, 0);
 				notify_group_update(p->conv_id, 0);
 			}
 		}
 	}
 }
 
-void handle_req_members(Client *cli, const ReqMembersPayload *p)
+void handle_req_members(Client *cli, const void *payload, uint32_t len)
 {
-	GroupMemberSummary mems[MAX_MEMBERS];
-	int count = storage_get_group_members(p->conv_id, mems, MAX_MEMBERS);
-	send_packet(cli->ssl, MSG_RESP_MEMBERS, mems, count * sizeof(GroupMemberSummary));
+	// Older clients send only conv_id: first page, no limit
+	ReqMembersPayload p = {0};
+	if (payload)
+		memcpy(&p, payload, len < sizeof(p) ? len : sizeof(p));
+
+	ResponseStream s;
+	StreamRowSink sink = {&s, sizeof(GroupMemberSummary)};
+	stream_begin(&s, cli, MSG_RESP_MEMBERS);
+	storage_each_group_member(p.conv_id, p.after_uid, p.limit, stream_row, &sink);
+	stream_end(&s);
 }
 
 void handle_kick_member(Client *cli, const KickMemberPayload *p)
@@ -114,16 +246,13 @@ void handle_kick_member(Client *cli, const KickMemberPayload *p)
 	if (storage_is_admin(p->conv_id, cli->uid) && p->target_uid != cli->uid)
 	{
 		storage_remove_participant(p->conv_id, p->target_uid);
+		membership_remove(p->conv_id, p->target_uid);
+		bootstrap_invalidate(p->target_uid);
 		notify_group_update(p->conv_id, 0);
 
-		// Explicitly refresh the kicked user so group disappears
-		Client *kicked = get_client_by_uid(p->target_uid);
-		if (kicked && kicked->is_online)
-		{
-			ConversationSummary summaries[50];
-			int n = storage_get_user_conversations(p->target_uid, summaries, 50);
-			send_packet(kicked->ssl, MSG_RESP_CONVERSATIONS, summaries, n * sizeof(ConversationSummary));
-		}
+		// The kicked user is no longer a member: tell them separately
+		uint32_t kicked = p->target_uid;
+		send_conv_removed(p->conv_id, &kicked, 1);
 	}
 }
 
@@ -131,21 +260,31 @@ void handle_delete_group(Client *cli, const DeleteGroupPayload *p)
 {
 	if (storage_is_admin(p->conv_id, cli->uid))
 	{
-		uint32_t members[MAX_PARTICIPANTS];
-		int count = storage_get_conv_participants(p->conv_id, members, MAX_PARTICIPANTS);
-
-		storage_delete_conversation(p->conv_id);
+		// The cached list goes away with the conversation; keep a copy to notify
+		const MemberList *list = membership_get(p->conv_id);
+		uint32_t count = list ? list->count : 0;
+		uint32_t *members = malloc((count > 0 ? count : 1) * sizeof(uint32_t));
+		if (!members)
+			return;
+		if (count > 0)
+			memcpy(members, list->uids, count * sizeof(uint32_t));
 
-		// Notify former members
-		for (int i = 0; i < count; i++)
+		if (!storage_delete_conversation(p->conv_id))
 		{
-			Client *c = get_client_by_uid(members[i]);
-			if (c && c->is_online)
-			{
-				ConversationSummary summaries[50];
-				int n = storage_get_user_conversations(members[i], summaries, 50);
-				send_packet(c->ssl, MSG_RESP_CONVERSATIONS, summaries, n * sizeof(ConversationSummary));
-			}
+			log_print(LOG_ERROR, "Cannot delete conv %u", p->conv_id);
+			free(members);
+			return;
 		}
+		membership_drop(p->conv_id);
+		if (!defer_notifications)
+			submit_drop_telemetry(p->conv_id);
+		else if (deferred_drop_count < MAX_BATCH_OPS)
+			deferred_drops[deferred_drop_count++] = p->conv_id;
+		for (uint32_t i = 0; i < count; i++)
+			bootstrap_invalidate(members[i]);
+
+		// Notify former members
+		send_conv_removed(p->conv_id, members, count);
+		free(members);
 	}
 }
\ No newline at end of file
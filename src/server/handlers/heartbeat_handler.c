@@ -0,0 +1,13 @@
+#include "handlers/heartbeat_handler.h"
+#include "infrastructure/client_manager.h"
+
+void handle_ping(Client *cli, const PingPayload *p)
+{
+	client_send(cli, MSG_PONG, p, sizeof(*p));
+}
+
+void handle_pong(Client *cli, const PingPayload *p)
+{
+	(void)cli;
+	(void)p;
+}
@@ -0,0 +1,185 @@
+#include "handlers/telemetry_handler.h"
+#include "infrastructure/telemetry.h"
+#include "infrastructure/stream.h"
+#include "infrastructure/executor.h"
+#include "infrastructure/client_manager.h"
+#include "infrastructure/coroutine.h"
+#include "system/storage.h"
+#include "system/logger.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PUSH_HEADER_LEN offsetof(TelemetryPushPayload, data)
+
+// Channels are executor-owned (see telemetry.h): everything below runs
+// there, keyed by conv_id, so one channel's samples keep their order
+
+typedef struct
+{
+	uint32_t conv_id;
+	uint32_t sender_uid;
+	uint16_t len;
+	uint8_t data[TELEMETRY_SAMPLE_MAX];
+} PushTask;
+
+typedef struct
+{
+	TelemetryConfigPayload config;
+} ConfigTask;
+
+// A query reads QUERY_PAGE rows per executor job and streams them before
+// asking for the next page, so memory per query stays one page
+#define QUERY_PAGE 1024
+#define QUERY_MAX_ROWS 65536 // Rows per query at most (max_count 0 asks for this many)
+
+typedef struct
+{
+	TelemetryQueryPayload query; // from_ms moves forward as pages are sent
+	uint32_t remaining;          // Rows still allowed by max_count
+	uint32_t skip;               // Rows at from_ms already sent
+	uint32_t to_skip;            // Countdown of skip during a page read
+	RowBuffer rows;              // Current page
+	ResponseStream stream;
+} QueryFrame;
+
+static void run_push(void *arg)
+{
+	PushTask *t = arg;
+	telemetry_append(t->conv_id, t->sender_uid, t->data, t->len);
+	free(t);
+}
+
+void handle_telemetry_push(Client *cli, const void *payload, uint32_t len)
+{
+	TelemetryPushPayload p;
+	memcpy(&p, payload, PUSH_HEADER_LEN);
+	if (p.len > TELEMETRY_SAMPLE_MAX || PUSH_HEADER_LEN + p.len > len)
+		return;
+
+	if (!telemetry_can_access(p.conv_id, cli->uid))
+	{
+		log_print(LOG_WARN, "User %s cannot write telemetry channel %u", cli->username, p.conv_id);
+		return;
+	}
+
+	// Hot path: no per-sample log line
+	PushTask *t = malloc(sizeof(PushTask));
+	if (!t)
+		return;
+	t->conv_id = p.conv_id;
+	t->sender_uid = cli->uid;
+	t->len = p.len;
+	memcpy(t->data, (const uint8_t *)payload + PUSH_HEADER_LEN, p.len);
+	if (!executor_submit(p.conv_id, run_push, NULL, t))
+		free(t);
+}
+
+static void run_config(void *arg)
+{
+	ConfigTask *t = arg;
+	if (!telemetry_configure(t->config.conv_id, t->config.max_rate, t->config.retention))
+		log_print(LOG_ERROR, "Cannot apply telemetry limits to channel %u", t->config.conv_id);
+	free(t);
+}
+
+void handle_telemetry_config(Client *cli, const TelemetryConfigPayload *p)
+{
+	if (!telemetry_can_access(p->conv_id, cli->uid) || !storage_is_admin(p->conv_id, cli->uid))
+		return;
+
+	// Stored here, on the loop's side of the database; the ring follows on its executor
+	if (!storage_set_telemetry_limits(p->conv_id, p->max_rate, p->retention))
+		return;
+
+	ConfigTask *t = malloc(sizeof(ConfigTask));
+	if (!t)
+		return;
+	t->config = *p;
+	if (!executor_submit(p->conv_id, run_config, NULL, t))
+	{
+		free(t);
+		return;
+	}
+	log_print(LOG_INFO, "User %s set telemetry channel %u to %u/s, %u samples",
+						cli->username, p->conv_id, p->max_rate, p->retention);
+}
+
+static int page_row(const void *row, void *ctx)
+{
+	QueryFrame *f = ctx;
+	if (f->to_skip > 0)
+	{
+		f->to_skip--;
+		return 1;
+	}
+	return row_buffer_add(row, &f->rows);
+}
+
+static void run_query(void *arg)
+{
+	QueryFrame *f = arg;
+	uint32_t want = f->remaining < QUERY_PAGE ? f->remaining : QUERY_PAGE;
+	f->rows.used = 0;
+	f->to_skip = f->skip;
+	telemetry_each(f->query.conv_id, f->query.from_ms, f->query.to_ms, f->skip + want, page_row, f);
+}
+
+// Sends the page just read and moves the query past it. Returns 0 once done.
+static int send_page(QueryFrame *f)
+{
+	uint32_t count = f->rows.used / sizeof(TelemetryRecord);
+	uint32_t want = f->remaining < QUERY_PAGE ? f->remaining : QUERY_PAGE;
+	if (count == 0)
+		return 0;
+
+	const TelemetryRecord *rows = (const TelemetryRecord *)f->rows.data;
+	for (uint32_t i = 0; i < count; i++)
+		stream_write(&f->stream, &rows[i], sizeof(TelemetryRecord));
+
+	// Resume after the last timestamp sent; rows sharing it are skipped next time
+	int64_t last = rows[count - 1].timestamp_ms;
+	uint32_t same = 0;
+	while (same < count && rows[count - 1 - same].timestamp_ms == last)
+		same++;
+	f->skip = (same == count && last == f->query.from_ms) ? f->skip + same : same;
+	f->query.from_ms = last;
+	f->remaining -= count;
+	return count == want && f->remaining > 0 && !f->stream.failed;
+}
+
+static CoStatus query_co(Coroutine *co, Client *cli)
+{
+	QueryFrame *f = co->frame;
+	CO_BEGIN(co);
+
+	// Denied requests get an empty stream
+	stream_begin(&f->stream, cli, MSG_RESP_TELEMETRY);
+	if (telemetry_can_access(f->query.conv_id, cli->uid))
+	{
+		do
+		{
+			CO_AWAIT(co, f->query.conv_id, run_query);
+		} while (send_page(f));
+	}
+	stream_end(&f->stream);
+	CO_END(co);
+}
+
+static void free_query(void *arg)
+{
+	QueryFrame *f = arg;
+	row_buffer_free(&f->rows);
+	free(f);
+}
+
+void handle_req_telemetry(Client *cli, const TelemetryQueryPayload *p)
+{
+	QueryFrame *f = calloc(1, sizeof(QueryFrame));
+	if (!f)
+		return;
+	f->query = *p;
+	f->remaining = (p->max_count == 0 || p->max_count > QUERY_MAX_ROWS) ? QUERY_MAX_ROWS : p->max_count;
+	f->rows.row_size = sizeof(TelemetryRecord);
+	coroutine_start(cli, query_co, f, free_query);
+}
@@ -0,0 +1,31 @@
+#include "handlers/topic_handler.h"
+#include "infrastructure/topics.h"
+#include "system/logger.h"
+#include <stddef.h>
+#include <string.h>
+
+#define PUBLISH_HEADER_LEN offsetof(PublishPayload, data)
+
+void handle_subscribe(Client *cli, const TopicFilterPayload *p)
+{
+	if (!topics_subscribe(cli, p->filter))
+		log_print(LOG_WARN, "User %s: subscription refused", cli->username);
+}
+
+void handle_unsubscribe(Client *cli, const TopicFilterPayload *p)
+{
+	topics_unsubscribe(cli, p->filter);
+}
+
+void handle_publish(Client *cli, const void *payload, uint32_t len)
+{
+	const PublishPayload *p = payload;
+	uint16_t data_len;
+	memcpy(&data_len, &p->len, sizeof(data_len));
+	if (data_len > TOPIC_PAYLOAD_MAX || PUBLISH_HEADER_LEN + data_len > len)
+		return;
+
+	// Hot path: no per-message log line unless the topic is invalid
+	if (topics_publish(cli, p->topic, p->data, data_len, p->retain) < 0)
+		log_print(LOG_WARN, "User %s published to an invalid or forbidden topic", cli->username);
+}
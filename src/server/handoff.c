@@ -0,0 +1,238 @@
+#define _GNU_SOURCE // struct ucred
+#include "infrastructure/handoff.h"
+#include "system/logger.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define HANDOFF_MAX 8
+#define HANDOFF_READY 'R'
+
+// Successor side
+static int upstream_fd = -1;
+
+// Previous server side
+static int listen_fd = -1;
+static int conn_fd = -1;
+static pid_t successor = -1;
+static char socket_path[108];
+
+static int make_address(const char *path, struct sockaddr_un *address)
+{
+	memset(address, 0, sizeof(*address));
+	address->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address->sun_path))
+		return 0;
+	strcpy(address->sun_path, path);
+	return 1;
+}
+
+int handoff_receive(const char *path, Listener *listeners, int max)
+{
+	struct sockaddr_un address;
+	if (!make_address(path, &address))
+		return 0;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return 0;
+	// Nobody listening (ENOENT, ECONNREFUSED): a normal start
+	if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+	{
+		close(fd);
+		return 0;
+	}
+	struct timeval tv = {5, 0};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	// Data: a count, then (tls, tcp) per listener; the descriptors ride along
+	uint8_t data[1 + 2 * HANDOFF_MAX];
+	char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX)];
+	struct iovec iov = {data, sizeof(data)};
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (n < 1 || !cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+	{
+		log_print(LOG_ERROR, "Handoff on %s failed, starting without it", path);
+		close(fd);
+		return 0;
+	}
+
+	int fds[HANDOFF_MAX];
+	int received = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+	memcpy(fds, CMSG_DATA(cmsg), received * sizeof(int));
+
+	int count = 0;
+	for (int i = 0; i < received; i++)
+	{
+		if (i < data[0] && 1 + 2 * i + 1 < n && count < max)
+			listeners[count++] = (Listener){fds[i], data[1 + 2 * i], data[2 + 2 * i]};
+		else
+			close(fds[i]);
+	}
+	upstream_fd = fd;
+	return count;
+}
+
+void handoff_ready(void)
+{
+	if (upstream_fd < 0)
+		return;
+	char ready = HANDOFF_READY;
+	if (write(upstream_fd, &ready, 1) != 1)
+		log_print(LOG_WARN, "Could not confirm the handoff to the previous process");
+	close(upstream_fd);
+	upstream_fd = -1;
+}
+
+// The binary this process runs. If a deploy replaced it, the kernel reports
+// the old inode as "<path> (deleted)": the path itself is the new binary
+static int executable_path(char *path, size_t size)
+{
+	ssize_t n = readlink("/proc/self/exe", path, size - 1);
+	if (n <= 0)
+		return 0;
+	path[n] = '\0';
+	const char *suffix = " (deleted)";
+	size_t len = strlen(path), suffix_len = strlen(suffix);
+	if (len > suffix_len && strcmp(path + len - suffix_len, suffix) == 0)
+		path[len - suffix_len] = '\0';
+	return 1;
+}
+
+int handoff_begin(const char *path)
+{
+	struct sockaddr_un address;
+	char exe[512];
+	if (listen_fd >= 0 || !make_address(path, &address) || !executable_path(exe, sizeof(exe)))
+		return -1;
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listen_fd < 0)
+		return -1;
+	unlink(path); // Left over by a crashed handoff
+	if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listen_fd, 1) < 0)
+	{
+		log_print(LOG_ERROR, "Handoff socket %s: %s", path, strerror(errno));
+		close(listen_fd);
+		listen_fd = -1;
+		return -1;
+	}
+	chmod(path, 0600);
+	strcpy(socket_path, path);
+
+	successor = fork();
+	if (successor == 0)
+	{
+		// Signals blocked for our signalfd would stay blocked across exec
+		sigset_t none;
+		sigemptyset(&none);
+		sigprocmask(SIG_SETMASK, &none, NULL);
+		execl(exe, exe, (char *)NULL);
+		_exit(127);
+	}
+	if (successor < 0)
+	{
+		log_print(LOG_ERROR, "Cannot start the new server: %s", strerror(errno));
+		handoff_end();
+		return -1;
+	}
+	log_print(LOG_INFO, "Started new server %s (pid %d), handing off on %s", exe, (int)successor, path);
+	return listen_fd;
+}
+
+int handoff_send(const Listener *listeners, int count)
+{
+	int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	// Only a process of the same user gets the sockets (the file is 0600 too)
+	struct ucred peer;
+	socklen_t peer_len = sizeof(peer);
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &peer_len) < 0 || peer.uid != getuid())
+	{
+		log_print(LOG_WARN, "Refused handoff to pid %d: not our user", (int)peer.pid);
+		close(fd);
+		return -1;
+	}
+
+	if (count > HANDOFF_MAX)
+		count = HANDOFF_MAX;
+	uint8_t data[1 + 2 * HANDOFF_MAX];
+	int fds[HANDOFF_MAX];
+	data[0] = (uint8_t)count;
+	for (int i = 0; i < count; i++)
+	{
+		fds[i] = listeners[i].fd;
+		data[1 + 2 * i] = (uint8_t)listeners[i].tls;
+		data[2 + 2 * i] = (uint8_t)listeners[i].tcp;
+	}
+
+	char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX)];
+	memset(control, 0, sizeof(control));
+	struct iovec iov = {data, 1 + 2 * count};
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0)
+	{
+		log_print(LOG_ERROR, "Handoff failed: %s", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	conn_fd = fd;
+	return conn_fd;
+}
+
+int handoff_poll(void)
+{
+	char answer;
+	ssize_t n = read(conn_fd, &answer, 1);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	return n == 1 && answer == HANDOFF_READY ? 1 : -1;
+}
+
+void handoff_end(void)
+{
+	if (conn_fd >= 0)
+		close(conn_fd);
+	if (listen_fd >= 0)
+	{
+		close(listen_fd);
+		unlink(socket_path);
+	}
+	conn_fd = -1;
+	listen_fd = -1;
+
+	// Reaps a successor that gave up; a running one is simply left alone
+	if (successor > 0)
+		waitpid(successor, NULL, WNOHANG);
+	successor = -1;
+}
@@ -1,13 +1,21 @@
+#define _GNU_SOURCE // accept4
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <sys/epoll.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <sys/signalfd.h>
 #include <sys/time.h>
+#include <time.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <errno.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
@@ -21,21 +29,765 @@
 // Infrastructure
 #include "infrastructure/server_types.h"
 #include "infrastructure/client_manager.h"
-
-// Handlers
-#include "handlers/auth_handler.h"
-#include "handlers/chat_handler.h"
-#include "handlers/group_handler.h"
-#include "handlers/contact_handler.h"
+#include "infrastructure/dispatcher.h"
+#include "infrastructure/presence.h"
+#include "infrastructure/bootstrap.h"
+#include "infrastructure/session.h"
+#include "infrastructure/early_data.h"
+#include "infrastructure/telemetry.h"
+#include "infrastructure/topics.h"
+#include "infrastructure/fanout.h"
+#include "infrastructure/executor.h"
+#include "infrastructure/admission.h"
+#include "infrastructure/timers.h"
+#include "infrastructure/conn_limits.h"
+#include "infrastructure/handoff.h"
+#include "infrastructure/outqueue.h"
+#include "handlers/gateway_handler.h"
 
 #define MAX_EVENTS 64
+#define READ_CHUNK 16384          // Receive buffer growth step
+#define READ_BUDGET (256 * 1024) // Per wakeup and connection, so one sender can't hog the loop
+
+#define MAX_LISTENERS 3
 
 // Global SSL Context
 SSL_CTX *ctx;
 
+static int epoll_fd = -1;
+
+// Connection liveness (see handshake_start and heartbeat_due)
+static uint32_t handshake_ms = 0;
+static uint32_t heartbeat_ms = 0;
+static uint32_t idle_ms = 0;
+static uint32_t check_ms = 0; // Heartbeat timer period
+
+// A TLS handshake in progress. The socket stays nonblocking until it is
+// done, so a slow or silent peer never holds up the event loop
+typedef struct
+{
+	int fd;
+	SSL *ssl;
+	int early_done;
+	uint8_t *early;
+	uint32_t early_len;
+	Timer deadline;
+} Handshake;
+
+// Indexed by fd
+static Handshake **handshakes = NULL;
+static int handshake_slots = 0;
+
+// Idle seconds before TCP keepalive probes (0 = off)
+static int keepalive_idle = 0;
+
+// Graceful restart (see handoff.h): set once the successor has taken over
+static int draining = 0;
+static int drain_expired = 0;
+static Timer drain_deadline;
+
+// Held open so that, out of descriptors, a pending connection can still be
+// accepted and closed instead of waking the loop forever
+static int spare_fd = -1;
+
+// Listeners are nonblocking: accept_all() drains them until EAGAIN
+static int listen_tcp(in_addr_t addr, int port, int backlog)
+{
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		log_print(LOG_ERROR, "socket: %s", strerror(errno));
+		return -1;
+	}
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(addr);
+	address.sin_port = htons(port);
+
+	int opt = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+	if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+	{
+		log_print(LOG_ERROR, "bind to port %d: %s", port, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if (listen(fd, backlog) < 0)
+	{
+		log_print(LOG_ERROR, "listen on port %d: %s", port, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int listen_unix(const char *path, int backlog)
+{
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path))
+		return -1;
+	strcpy(address.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		log_print(LOG_ERROR, "socket: %s", strerror(errno));
+		return -1;
+	}
+
+	unlink(path); // Stale socket from a previous run
+	if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+	{
+		log_print(LOG_ERROR, "bind to %s: %s", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if (listen(fd, backlog) < 0)
+	{
+		log_print(LOG_ERROR, "listen on %s: %s", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	chmod(path, 0660); // Owner and group (the co-located proxy) only
+	return fd;
+}
+
+// Binds the listeners of `config`
+// @return The number opened, -1 if the main port is unavailable
+static int open_listeners(const AppConfig *config, int backlog, Listener *listeners)
+{
+	int count = 0;
+	int server_fd = listen_tcp(INADDR_ANY, config->port, backlog);
+	if (server_fd < 0)
+	{
+		log_print(LOG_ERROR, "Cannot listen on port %d", config->port);
+		return -1;
+	}
+	listeners[count++] = (Listener){server_fd, 1, 1};
+
+	// Plaintext listeners for co-located TLS terminators and bridges
+	if (config->plain_port > 0)
+	{
+		int fd = listen_tcp(INADDR_LOOPBACK, config->plain_port, backlog);
+		if (fd >= 0)
+		{
+			listeners[count++] = (Listener){fd, 0, 1};
+			log_print(LOG_INFO, "Plaintext listener on 127.0.0.1:%d", config->plain_port);
+		}
+		else
+			log_print(LOG_ERROR, "Cannot listen on 127.0.0.1:%d", config->plain_port);
+	}
+	if (strlen(config->unix_socket) > 0)
+	{
+		int fd = listen_unix(config->unix_socket, backlog);
+		if (fd >= 0)
+		{
+			listeners[count++] = (Listener){fd, 0, 0};
+			log_print(LOG_INFO, "Plaintext listener on %s", config->unix_socket);
+		}
+		else
+			log_print(LOG_ERROR, "Cannot listen on %s", config->unix_socket);
+	}
+	return count;
+}
+
+static const Listener *find_listener(const Listener *listeners, int count, int fd)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (listeners[i].fd == fd)
+			return &listeners[i];
+	}
+	return NULL;
+}
+
+static void drop_client(Client *cli)
+{
+	uint32_t uid = cli->uid;
+	int fd = cli->fd;
+	if (uid > 0)
+		log_print(LOG_INFO, "User %s disconnected", cli->username);
+
+	// Devices multiplexed over this connection go with it
+	gateway_release(cli);
+	topics_release(cli);
+
+	// The socket closes with its outbound queue (see remove_client)
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	conn_release(fd);
+	remove_client(fd);
+	presence_on_disconnect(uid);
+	if (uid > 0 && client_count_by_uid(uid) == 0)
+		bootstrap_release(uid);
+}
+
+// io_lock held: appends what the socket has to the receive buffer
+// @return 1 if the budget ran out (more may be waiting), 0 if drained, -1 on EOF or error
+static int fill_rx(Client *cli)
+{
+	uint32_t total = 0;
+	while (1)
+	{
+		// OpenSSL buffers decrypted bytes that epoll does not report: read them
+		// even past the budget, the next wakeup may never come
+		if (total >= READ_BUDGET && !(cli->transport.ssl && SSL_pending(cli->transport.ssl) > 0))
+			return 1;
+
+		if (cli->rx_cap - cli->rx_len < READ_CHUNK)
+		{
+			uint8_t *grown = realloc(cli->rx, cli->rx_cap + READ_CHUNK);
+			if (!grown)
+				return -1;
+			cli->rx = grown;
+			cli->rx_cap += READ_CHUNK;
+		}
+
+		int n = transport_read_some(&cli->transport, cli->rx + cli->rx_len, cli->rx_cap - cli->rx_len);
+		if (n <= 0)
+			return n;
+		cli->rx_len += (uint32_t)n;
+		total += (uint32_t)n;
+	}
+}
+
+static void read_client(Client *cli)
+{
+	// 4. Read (and decrypt, on TLS) whatever arrived
+	outqueue_lock_io(cli->out);
+	int status = fill_rx(cli);
+	outqueue_unlock_io(cli->out);
+
+	// Several packets can share one read: dispatch every complete one
+	uint32_t off = 0;
+	while (cli->rx_len - off >= sizeof(MessageHeader))
+	{
+		MessageHeader header;
+		memcpy(&header, cli->rx + off, sizeof(header));
+		uint32_t len = ntohl(header.payload_len);
+		if (len > MAX_FRAME_LEN)
+		{
+			// Would pin that much of the receive buffer before the dispatcher saw it
+			log_print(LOG_WARN, "FD %d announced a %u byte packet, closing", cli->fd, len);
+			status = -1;
+			break;
+		}
+		if (cli->rx_len - off - sizeof(header) < len)
+			break;
+
+		// Handlers get a NUL-terminated private copy, like recv_packet() gives them
+		void *payload = NULL;
+		if (len > 0)
+		{
+			if (!(payload = malloc(len + 1)))
+			{
+				status = -1;
+				break;
+			}
+			memcpy(payload, cli->rx + off + sizeof(header), len);
+			((char *)payload)[len] = '\0';
+		}
+		off += sizeof(header) + len;
+
+		cli->last_rx = timers_now();
+		dispatch_packet(cli, ntohl(header.type), payload, len);
+		free(payload);
+	}
+
+	if (off > 0)
+	{
+		cli->rx_len -= off;
+		memmove(cli->rx, cli->rx + off, cli->rx_len);
+	}
+	// Don't keep a big packet's buffer around for an idle connection
+	if (cli->rx_len == 0 && cli->rx_cap > READ_CHUNK)
+	{
+		free(cli->rx);
+		cli->rx = NULL;
+		cli->rx_cap = 0;
+	}
+
+	if (status < 0)
+		drop_client(cli);
+}
+
+// Runs every check_ms per connection. Activity only stamps last_rx, so busy
+// connections cost nothing more than this one timer
+static void heartbeat_due(void *arg)
+{
+	Client *cli = arg;
+	uint64_t silent_ms = (timers_now() - cli->last_rx) * TIMER_TICK_MS;
+	if (idle_ms > 0 && silent_ms >= idle_ms)
+	{
+		log_print(LOG_INFO, "Dropping FD %d: silent for %llus", cli->fd, (unsigned long long)(silent_ms / 1000));
+		drop_client(cli);
+		return;
+	}
+
+	if (heartbeat_ms > 0 && silent_ms >= heartbeat_ms)
+	{
+		PingPayload ping = {timers_now()};
+		client_send(cli, MSG_PING, &ping, sizeof(ping));
+	}
+	timer_arm(&cli->heartbeat, check_ms);
+}
+
+static void set_liveness(const AppConfig *config)
+{
+	handshake_ms = config->handshake_timeout > 0 ? (uint32_t)config->handshake_timeout * 1000 : DEFAULT_HANDSHAKE_TIMEOUT * 1000;
+	heartbeat_ms = config->heartbeat_interval > 0 ? (uint32_t)config->heartbeat_interval * 1000 : 0;
+	idle_ms = config->idle_timeout > 0 ? (uint32_t)config->idle_timeout * 1000 : 0;
+	check_ms = heartbeat_ms > 0 && (idle_ms == 0 || heartbeat_ms < idle_ms) ? heartbeat_ms : idle_ms;
+	if (check_ms > 0)
+		log_print(LOG_INFO, "Heartbeat: ping after %ds of silence, drop after %ds", config->heartbeat_interval, config->idle_timeout);
+}
+
+// Puts an open connection on the current check period (or takes it off)
+static void rearm_heartbeat(Client *cli, void *arg)
+{
+	(void)arg;
+	if (cli->fd < 0) // Gateway sessions ride on their link's heartbeat
+		return;
+	if (check_ms == 0)
+	{
+		timer_cancel(&cli->heartbeat);
+		return;
+	}
+	if (!cli->heartbeat.fn)
+		timer_init(&cli->heartbeat, heartbeat_due, cli);
+	timer_arm(&cli->heartbeat, check_ms);
+}
+
+static void open_connection(int fd, SSL *ssl, uint8_t *early, uint32_t early_len, int registered)
+{
+	// Connection ready, add to EPoll and Client Manager. The socket stays
+	// nonblocking: partial packets wait in the client's receive buffer and
+	// full send buffers in its outbound queue (see outqueue.h)
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	Client *c = add_client(fd, ssl);
+	if (!c)
+	{
+		conn_release(fd); // add_client closed it
+		free(early);
+		return;
+	}
+
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	epoll_ctl(epoll_fd, registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+
+	if (ssl)
+	{
+		int ktls = ssl_ktls_status(ssl);
+		log_print(LOG_INFO, "New secure connection (FD: %d, kTLS %s%s)", fd,
+							(ktls & KTLS_SEND) ? "tx" : "-", (ktls & KTLS_RECV) ? "+rx" : "");
+	}
+	else
+	{
+		log_print(LOG_INFO, "New local plaintext connection (FD: %d)", fd);
+	}
+
+	c->last_rx = timers_now();
+	if (check_ms > 0)
+	{
+		timer_init(&c->heartbeat, heartbeat_due, c);
+		timer_arm(&c->heartbeat, check_ms);
+	}
+
+	if (early)
+		early_data_dispatch(c, early, early_len);
+	free(early);
+}
+
+static void handshake_free(Handshake *h)
+{
+	timer_cancel(&h->deadline);
+	handshakes[h->fd] = NULL;
+	free(h);
+}
+
+static void handshake_fail(Handshake *h)
+{
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, h->fd, NULL);
+	conn_release(h->fd);
+	SSL_free(h->ssl);
+	close(h->fd);
+	free(h->early);
+	handshake_free(h);
+}
+
+static void handshake_expired(void *arg)
+{
+	Handshake *h = arg;
+	log_print(LOG_WARN, "SSL Handshake timed out for FD %d", h->fd);
+	handshake_fail(h);
+}
+
+static void handshake_continue(Handshake *h)
+{
+	// Early data (if enabled) arrives with the ClientHello
+	int rc = 1;
+	if (!h->early_done && (rc = early_data_read(h->ssl, &h->early, &h->early_len)) == 1)
+		h->early_done = 1;
+	if (rc == 1 && (rc = SSL_accept(h->ssl)) <= 0)
+	{
+		int err = SSL_get_error(h->ssl, rc);
+		rc = err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE ? 0 : -1;
+	}
+
+	if (rc < 0)
+	{
+		ERR_print_errors_fp(stderr);
+		log_print(LOG_ERROR, "SSL Handshake failed for FD %d", h->fd);
+		handshake_fail(h);
+		return;
+	}
+	if (rc == 0)
+	{
+		struct epoll_event ev;
+		ev.events = SSL_want_write(h->ssl) ? EPOLLOUT : EPOLLIN;
+		ev.data.fd = h->fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_MOD, h->fd, &ev);
+		return;
+	}
+
+	int fd = h->fd;
+	SSL *ssl = h->ssl;
+	uint8_t *early = h->early;
+	uint32_t early_len = h->early_len;
+	handshake_free(h);
+	open_connection(fd, ssl, early, early_len, 1);
+}
+
+static void handshake_start(int fd)
+{
+	if (fd >= handshake_slots)
+	{
+		int slots = handshake_slots ? handshake_slots : 1024;
+		while (slots <= fd)
+			slots *= 2;
+		Handshake **grown = realloc(handshakes, slots * sizeof(Handshake *));
+		if (!grown)
+		{
+			conn_release(fd);
+			close(fd);
+			return;
+		}
+		memset(grown + handshake_slots, 0, (slots - handshake_slots) * sizeof(Handshake *));
+		handshakes = grown;
+		handshake_slots = slots;
+	}
+
+	Handshake *h = calloc(1, sizeof(Handshake));
+	SSL *ssl = h ? SSL_new(ctx) : NULL;
+	if (!ssl)
+	{
+		free(h);
+		conn_release(fd);
+		close(fd);
+		return;
+	}
+	SSL_set_fd(ssl, fd); // Accepted nonblocking
+
+	h->fd = fd;
+	h->ssl = ssl;
+	handshakes[fd] = h;
+	timer_init(&h->deadline, handshake_expired, h);
+	timer_arm(&h->deadline, handshake_ms);
+
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+
+	// The ClientHello may already be there
+	handshake_continue(h);
+}
+
+static void drain_expired_cb(void *arg)
+{
+	(void)arg;
+	drain_expired = 1;
+}
+
+typedef struct
+{
+	int index;
+	int count;
+	uint32_t spread_ms;
+} ReconnectPlan;
+
+static void send_reconnect(Client *cli, void *arg)
+{
+	ReconnectPlan *plan = arg;
+	if (cli->fd < 0)
+		return; // Gateway session: its gateway reconnects for it
+
+	// One slot per connection across the spread, jittered within the slot,
+	// so that the new server sees a ramp instead of a wall
+	uint32_t slot = plan->spread_ms / plan->count;
+	int index = plan->index < plan->count ? plan->index : plan->count - 1;
+	ReconnectPayload r;
+	r.delay_ms = (uint32_t)((uint64_t)plan->spread_ms * index / plan->count) + (slot > 0 ? (uint32_t)rand() % slot : 0);
+	plan->index++;
+	client_send(cli, MSG_RECONNECT, &r, sizeof(r));
+}
+
+// The successor accepts from now on: stop, ask every client to come back
+// over there, and keep serving them meanwhile
+static void drain_start(Listener *listeners, int *listener_count, const AppConfig *config)
+{
+	for (int l = 0; l < *listener_count; l++)
+	{
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listeners[l].fd, NULL);
+		close(listeners[l].fd);
+	}
+	*listener_count = 0;
+	handoff_end();
+
+	// Handshakes in progress are cheaper to start over on the successor
+	for (int fd = 0; fd < handshake_slots; fd++)
+	{
+		if (handshakes[fd])
+			handshake_fail(handshakes[fd]);
+	}
+
+	uint32_t spread_ms = config->reconnect_spread > 0 ? (uint32_t)config->reconnect_spread * 1000 : 0;
+	ReconnectPlan plan = {0, conn_count(), spread_ms};
+	srand((unsigned)time(NULL) ^ (unsigned)getpid());
+	if (plan.count > 0)
+		client_foreach(send_reconnect, &plan);
+
+	int drain_s = config->drain_timeout > 0 ? config->drain_timeout : DEFAULT_DRAIN_TIMEOUT;
+	draining = 1;
+	timer_init(&drain_deadline, drain_expired_cb, NULL);
+	timer_arm(&drain_deadline, (uint32_t)drain_s * 1000);
+	log_print(LOG_INFO, "Handed over to the new server: draining %d connection(s), at most %ds", plan.count, drain_s);
+}
+
+// Everything a new connection's SSL is created from. Connections keep the
+// context they were accepted with (each SSL holds a reference on it).
+// `previous` is the context being replaced on reload, NULL at startup
+static SSL_CTX *tls_context(const AppConfig *config, SSL_CTX *previous)
+{
+	SSL_CTX *c = create_context(1); // 1 = Server
+	if (!load_certificate(c, config->server_cert_path, config->server_key_path))
+	{
+		log_print(LOG_ERROR, "Cannot load the certificate %s / %s", config->server_cert_path, config->server_key_path);
+		SSL_CTX_free(c);
+		return NULL;
+	}
+	int tickets = configure_session_tickets(c, config->ticket_key, config->ticket_rotation, previous);
+	if (tickets == 1)
+		log_print(LOG_INFO, "TLS session tickets: configured keys, rotating every %ds", config->ticket_rotation);
+	else if (tickets == 2)
+		log_print(LOG_INFO, "TLS session tickets: no ticket_key, keeping this process's keys");
+	else
+		log_print(LOG_WARN, "TLS session tickets: no ticket_key, tickets will not survive a restart");
+	if (config->ktls)
+	{
+		if (configure_ktls(c))
+			log_print(LOG_INFO, "kTLS requested (used per connection when the kernel supports it)");
+		else
+			log_print(LOG_WARN, "kTLS requested but not supported by this OpenSSL build");
+	}
+	if (config->early_data)
+	{
+		early_data_init(c, config->early_data_max > 0 ? (uint32_t)config->early_data_max : 0);
+		log_print(LOG_INFO, "TLS early data (0-RTT) enabled for replay-safe requests");
+	}
+	return c;
+}
+
+static int restart_only(const char *name, int changed)
+{
+	if (changed)
+		log_print(LOG_WARN, "Reload: %s only changes on restart", name);
+	return changed;
+}
+
+// Bound to sockets, threads, the database or context callbacks: the running
+// values are kept
+static void keep_restart_only(AppConfig *next, const AppConfig *config)
+{
+	if (restart_only("port", next->port != config->port))
+		next->port = config->port;
+	if (restart_only("plain_port", next->plain_port != config->plain_port))
+		next->plain_port = config->plain_port;
+	if (restart_only("unix_socket", strcmp(next->unix_socket, config->unix_socket) != 0))
+		strcpy(next->unix_socket, config->unix_socket);
+	if (restart_only("listen_backlog", next->listen_backlog != config->listen_backlog))
+		next->listen_backlog = config->listen_backlog;
+	if (restart_only("db_path", strcmp(next->db_path, config->db_path) != 0))
+		strcpy(next->db_path, config->db_path);
+	if (restart_only("db_key", strcmp(next->db_encryption_key, config->db_encryption_key) != 0))
+		strcpy(next->db_encryption_key, config->db_encryption_key);
+	if (restart_only("db_wal", next->db_wal != config->db_wal))
+		next->db_wal = config->db_wal;
+	if (restart_only("db_synchronous", strcmp(next->db_synchronous, config->db_synchronous) != 0))
+		strcpy(next->db_synchronous, config->db_synchronous);
+	if (restart_only("db_cache_kb", next->db_cache_kb != config->db_cache_kb))
+		next->db_cache_kb = config->db_cache_kb;
+	if (restart_only("db_mmap_mb", next->db_mmap_mb != config->db_mmap_mb))
+		next->db_mmap_mb = config->db_mmap_mb;
+	if (restart_only("db_maintenance", next->db_maintenance != config->db_maintenance))
+		next->db_maintenance = config->db_maintenance;
+	if (restart_only("executor_threads", next->executor_threads != config->executor_threads))
+		next->executor_threads = config->executor_threads;
+	if (restart_only("fanout_workers", next->fanout_workers != config->fanout_workers))
+		next->fanout_workers = config->fanout_workers;
+	if (restart_only("gateway", next->gateway != config->gateway))
+		next->gateway = config->gateway;
+	if (restart_only("early_data", next->early_data != config->early_data))
+		next->early_data = config->early_data;
+	// Subscriptions and retained values were authorized under these roots
+	if (restart_only("topic_user_root", strcmp(next->topic_user_root, config->topic_user_root) != 0))
+		strcpy(next->topic_user_root, config->topic_user_root);
+	if (restart_only("topic_conv_root", strcmp(next->topic_conv_root, config->topic_conv_root) != 0))
+		strcpy(next->topic_conv_root, config->topic_conv_root);
+	if (restart_only("topic_public_root", strcmp(next->topic_public_root, config->topic_public_root) != 0))
+		strcpy(next->topic_public_root, config->topic_public_root);
+}
+
+// SIGHUP: re-reads server.conf and the certificate. Runs on the loop between
+// two events, so no request sees half of the new settings; if anything in the
+// new configuration is unusable, nothing of it is applied
+static void reload_config(AppConfig *config)
+{
+	AppConfig next;
+	if (!config_load("server.conf", &next))
+	{
+		log_print(LOG_ERROR, "Reload failed: cannot read server.conf, keeping the running configuration");
+		return;
+	}
+	LogLevel level;
+	if (!log_level_from_name(next.log_level, &level))
+	{
+		log_print(LOG_ERROR, "Reload failed: unknown log_level '%s', keeping the running configuration", next.log_level);
+		return;
+	}
+	keep_restart_only(&next, config);
+
+	SSL_CTX *fresh = tls_context(&next, ctx);
+	if (!fresh)
+	{
+		log_print(LOG_ERROR, "Reload failed: keeping the running configuration");
+		return;
+	}
+
+	// Handshakes in progress and open connections keep the old context
+	SSL_CTX_free(ctx);
+	ctx = fresh;
+
+	admission_init(&next);
+	topics_init(&next);
+	conn_limits_init(&next);
+	// A new key voids every token out there (an ephemeral one would be
+	// redrawn at random): derive it only when its inputs changed
+	if (strcmp(next.session_key, config->session_key) != 0 ||
+			strcmp(next.db_encryption_key, config->db_encryption_key) != 0)
+	{
+		session_init(next.session_key, next.db_encryption_key, next.session_ttl);
+		log_print(LOG_WARN, "Reload: session key changed, outstanding resume tokens are void");
+	}
+	else
+		session_set_ttl(next.session_ttl);
+	if (next.gateway && next.gateway_max_sessions > 0)
+		gateway_init(next.gateway_max_sessions);
+	fanout_set_shard(next.fanout_shard);
+	telemetry_set_defaults(next.telemetry_rate > 0 ? (uint32_t)next.telemetry_rate : 0,
+												 next.telemetry_retention > 0 ? (uint32_t)next.telemetry_retention : DEFAULT_TELEMETRY_RETENTION);
+	keepalive_idle = next.tcp_keepalive > 0 ? next.tcp_keepalive : 0;
+
+	uint32_t previous_check = check_ms;
+	set_liveness(&next);
+	if (check_ms != previous_check)
+		client_foreach(rearm_heartbeat, NULL);
+
+	*config = next;
+	log_print(LOG_INFO, "Configuration reloaded from server.conf");
+	log_set_level(level);
+}
+
+static void tune_socket(int fd)
+{
+	// Packets are small and latency-bound: do not wait to coalesce them
+	int on = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	// Finds peers that vanished without a FIN (NAT timeouts, power loss),
+	// including the ones no heartbeat is configured for
+	if (keepalive_idle > 0)
+	{
+		int interval = 10, probes = 3;
+		setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+		setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &keepalive_idle, sizeof(keepalive_idle));
+		setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+		setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+	}
+}
+
+// Takes every pending connection: after a restart thousands of clients
+// reconnect at once, and one accept per wake would leave them in the queue
+static void accept_all(const Listener *listener)
+{
+	while (1)
+	{
+		struct sockaddr_storage peer;
+		socklen_t peer_len = sizeof(peer);
+		int fd = accept4(listener->fd, (struct sockaddr *)&peer, &peer_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if ((errno == EMFILE || errno == ENFILE) && spare_fd >= 0)
+			{
+				// Out of descriptors: refuse one connection with the spare
+				log_print(LOG_WARN, "Out of file descriptors, refusing connections");
+				close(spare_fd);
+				fd = accept(listener->fd, NULL, NULL);
+				if (fd >= 0)
+					close(fd);
+				spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				log_print(LOG_WARN, "accept: %s", strerror(errno));
+			return;
+		}
+
+		if (!conn_admit(fd, (struct sockaddr *)&peer))
+		{
+			close(fd);
+			continue;
+		}
+		if (listener->tcp)
+			tune_socket(fd);
+
+		if (listener->tls)
+			handshake_start(fd);
+		else
+			open_connection(fd, NULL, NULL, 0, 0);
+	}
+}
+
 int main()
 {
 	signal(SIGPIPE, SIG_IGN);
+
+	// Blocked before any thread starts, so only the signalfd below sees them
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGUSR1);
+	sigaddset(&signals, SIGUSR2);
+	sigaddset(&signals, SIGHUP);
+	sigprocmask(SIG_BLOCK, &signals, NULL);
+
 	log_init("server");
 	// 1. Load Config
 	AppConfig config;
@@ -47,6 +799,11 @@ int main()
 	{
 		log_print(LOG_INFO, "No server.conf found, using defaults (Port: %d)", config.port);
 	}
+	LogLevel level;
+	if (log_level_from_name(config.log_level, &level))
+		log_set_level(level);
+	else
+		log_print(LOG_WARN, "Unknown log_level '%s', logging everything", config.log_level);
 
 	if (strlen(config.db_encryption_key) > 0) {
         crypto_init(config.db_encryption_key);
@@ -60,189 +817,218 @@ int main()
 
 	// 2. Initialize OpenSSL
 	init_openssl();
-	ctx = create_context(1); // 1 = Server
-
-	configure_context(ctx, config.server_cert_path, config.server_key_path);
+	ctx = tls_context(&config, NULL);
+	if (!ctx)
+		return 1;
 	log_print(LOG_INFO, "SSL Context initialized. loaded certs.");
 
+	if (config.gateway && config.gateway_max_sessions > 0)
+	{
+		gateway_init(config.gateway_max_sessions);
+		log_print(LOG_INFO, "Gateway mode enabled (%d sessions per connection)", config.gateway_max_sessions);
+	}
+
 	// 3. DB Init
 	init_clients();
-	storage_backup(config.db_path);
+	fanout_init(config.fanout_workers, config.fanout_shard);
+	if (config.fanout_workers > 0)
+		log_print(LOG_INFO, "Fan-out: %d workers, %d connections per shard", config.fanout_workers, config.fanout_shard);
+	admission_init(&config);
+	topics_init(&config);
+	conn_limits_init(&config);
+	session_init(config.session_key, config.db_encryption_key, config.session_ttl);
+
+	// A server handing off (SIGUSR2) passes its listeners to us
+	Listener listeners[MAX_LISTENERS];
+	int listener_count = 0;
+	if (strlen(config.handoff_socket) > 0)
+		listener_count = handoff_receive(config.handoff_socket, listeners, MAX_LISTENERS);
+	int inherited = listener_count > 0;
+	if (inherited)
+		log_print(LOG_INFO, "Took over %d listener(s) from the previous server", listener_count);
+	else
+		storage_backup(config.db_path); // Not while the previous server still writes to it
 
 	if (!storage_init(config.db_path))
 	{
 		log_print(LOG_ERROR, config.db_path);
 		return 1;
 	}
+	storage_tune(&config);
 
-	// 4. Socket Bind
-	int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-	struct sockaddr_in address;
-	address.sin_family = AF_INET;
-	address.sin_addr.s_addr = INADDR_ANY;
-	address.sin_port = htons(config.port);
+	// Telemetry rings live next to the database
+	char telemetry_dir[600];
+	const char *slash = strrchr(config.db_path, '/');
+	if (slash)
+		snprintf(telemetry_dir, sizeof(telemetry_dir), "%.*s/telemetry", (int)(slash - config.db_path), config.db_path);
+	else
+		snprintf(telemetry_dir, sizeof(telemetry_dir), "telemetry");
+	telemetry_init(telemetry_dir, config.telemetry_rate > 0 ? (uint32_t)config.telemetry_rate : 0,
+								 config.telemetry_retention > 0 ? (uint32_t)config.telemetry_retention : DEFAULT_TELEMETRY_RETENTION);
 
-	int opt = 1;
-	setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-	bind(server_fd, (struct sockaddr *)&address, sizeof(address));
-	listen(server_fd, 10);
+	// 4. Socket Bind
+	keepalive_idle = config.tcp_keepalive > 0 ? config.tcp_keepalive : 0;
+	spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	int backlog = config.listen_backlog > 0 ? config.listen_backlog : DEFAULT_LISTEN_BACKLOG;
+	if (!inherited && (listener_count = open_listeners(&config, backlog, listeners)) < 0)
+		return 1;
 
-	int epoll_fd = epoll_create1(0);
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	outqueue_init(epoll_fd);
 	struct epoll_event ev, events[MAX_EVENTS];
+	for (int l = 0; l < listener_count; l++)
+	{
+		ev.events = EPOLLIN;
+		ev.data.fd = listeners[l].fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listeners[l].fd, &ev);
+	}
+
+	// Handshake deadlines, heartbeats and presence grace periods
+	int timer_fd = timers_init();
+	if (timer_fd < 0)
+	{
+		log_print(LOG_ERROR, "Cannot create the timer wheel clock");
+		return 1;
+	}
 	ev.events = EPOLLIN;
-	ev.data.fd = server_fd;
-	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev);
+	ev.data.fd = timer_fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+	set_liveness(&config);
+
+	// Executors hand finished work back through this eventfd
+	int executor_fd = executor_init(config.executor_threads);
+	if (executor_fd >= 0)
+	{
+		ev.events = EPOLLIN;
+		ev.data.fd = executor_fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, executor_fd, &ev);
+		log_print(LOG_INFO, "Executors: %d threads", config.executor_threads);
+	}
 
+	// SIGUSR1 logs the per-opcode counters, SIGHUP reloads the configuration,
+	// SIGUSR2 hands over to a new server: read on the loop like any event
+	int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (signal_fd >= 0)
+	{
+		ev.events = EPOLLIN;
+		ev.data.fd = signal_fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev);
+	}
+
+	log_print(LOG_INFO, "Accepting: backlog %d, at most %d connections (%d per address, 0 = unlimited)",
+						backlog, config.max_connections, config.max_connections_per_ip);
 	printf("Secure Server Running on %d...\n", config.port);
+	handoff_ready();
 
-	while (1)
+	// Graceful restart: the handoff socket, then the connection to the successor
+	int handoff_fd = -1, handoff_conn = -1;
+
+	// Once drained, the loop ends and the process exits
+	while (!draining || (!drain_expired && (conn_count() > 0 || executor_backlog() > 0)))
 	{
+		admission_loop_sleep();
 		int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+		admission_loop_wake();
 		for (int i = 0; i < nfds; i++)
 		{
-			if (events[i].data.fd == server_fd)
+			int fd = events[i].data.fd;
+			const Listener *listener = find_listener(listeners, listener_count, fd);
+			if (fd == timer_fd)
 			{
-				struct sockaddr_in cli_addr;
-				socklen_t len = sizeof(cli_addr);
-				int new_sock = accept(server_fd, (struct sockaddr *)&cli_addr, &len);
-
-				if (new_sock >= 0)
+				timers_run();
+			}
+			else if (executor_fd >= 0 && fd == executor_fd)
+			{
+				executor_complete();
+			}
+			else if (signal_fd >= 0 && fd == signal_fd)
+			{
+				struct signalfd_siginfo info;
+				while (read(signal_fd, &info, sizeof(info)) == sizeof(info))
 				{
-					// 2. Wrap new socket in SSL
-					SSL *ssl = SSL_new(ctx);
-					SSL_set_fd(ssl, new_sock);
-
-					// 3. Perform Handshake (Simple blocking for now)
-					if (SSL_accept(ssl) <= 0)
+					if (info.ssi_signo == SIGUSR1)
+						dispatch_log_stats();
+					else if (info.ssi_signo == SIGHUP)
+						reload_config(&config);
+					else if (info.ssi_signo == SIGUSR2 && !draining)
 					{
-						ERR_print_errors_fp(stderr);
-						log_print(LOG_ERROR, "SSL Handshake failed for FD %d", new_sock);
-						SSL_free(ssl);
-						close(new_sock);
+						if (strlen(config.handoff_socket) == 0)
+						{
+							log_print(LOG_WARN, "SIGUSR2 ignored: no handoff_socket configured");
+							continue;
+						}
+						if (handoff_fd >= 0)
+						{
+							log_print(LOG_WARN, "Abandoning the pending handoff, starting over");
+							handoff_end();
+							handoff_conn = -1;
+						}
+						if ((handoff_fd = handoff_begin(config.handoff_socket)) >= 0)
+						{
+							ev.events = EPOLLIN;
+							ev.data.fd = handoff_fd;
+							epoll_ctl(epoll_fd, EPOLL_CTL_ADD, handoff_fd, &ev);
+						}
 					}
+				}
+			}
+			else if (handoff_fd >= 0 && fd == handoff_fd)
+			{
+				if ((handoff_conn = handoff_send(listeners, listener_count)) >= 0)
+				{
+					ev.events = EPOLLIN;
+					ev.data.fd = handoff_conn;
+					epoll_ctl(epoll_fd, EPOLL_CTL_ADD, handoff_conn, &ev);
+				}
+			}
+			else if (handoff_conn >= 0 && fd == handoff_conn)
+			{
+				int state = handoff_poll();
+				if (state != 0)
+				{
+					handoff_fd = handoff_conn = -1;
+					if (state > 0)
+						drain_start(listeners, &listener_count, &config);
 					else
 					{
-						// Handshake success, add to EPoll and Client Manager
-						struct timeval tv = {2, 0};
-						setsockopt(new_sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof tv);
-
-						ev.events = EPOLLIN;
-						ev.data.fd = new_sock;
-						epoll_ctl(epoll_fd, EPOLL_CTL_ADD, new_sock, &ev);
-
-						add_client(new_sock, ssl);
-
-						// IMPORTANT: Store the SSL pointer in the client struct
-						Client *c = get_client_by_fd(new_sock);
-						if (c)
-							c->ssl = ssl;
-
-						log_print(LOG_INFO, "New secure connection (FD: %d)", new_sock);
+						log_print(LOG_ERROR, "The new server did not start, this one keeps serving");
+						handoff_end();
 					}
 				}
 			}
+			else if (listener)
+			{
+				accept_all(listener);
+			}
+			else if (fd < handshake_slots && handshakes[fd])
+			{
+				handshake_continue(handshakes[fd]);
+			}
 			else
 			{
-				int fd = events[i].data.fd;
+				// Gone earlier in this batch (timed out, say): a stale event
 				Client *cli = get_client_by_fd(fd);
-
-				// Safety check
-				if (!cli || !cli->ssl)
-				{
-					// Should not happen if logic is correct
-					close(fd);
-					remove_client(fd);
+				if (!cli)
 					continue;
-				}
-
-				MessageType type;
-				void *payload = NULL;
-				uint32_t len;
-
-				// 4. Decrypt Packet using SSL pointer
-				if (recv_packet(cli->ssl, &type, &payload, &len) <= 0)
-				{
-					if (cli->uid > 0)
-						log_print(LOG_INFO, "User %s disconnected", cli->username);
 
-					// Cleanup handled by remove_client (SSL_free, SSL_shutdown)
-					close(fd);
-					remove_client(fd);
-					continue;
-				}
-
-				// --- DISPATCHER ---
-				switch (type)
-				{
-				// Auth
-				case MSG_REGISTER:
-					handle_register(cli, (RegisterPayload *)payload);
-					break;
-				case MSG_LOGIN:
-					handle_login(cli, (LoginPayload *)payload);
-					break;
-				case MSG_UPDATE_USER:
-					handle_update_user(cli, (UpdateUserPayload *)payload);
-					break;
-
-				// Chat
-				case MSG_SEND_TEXT:
-					handle_send_text(cli, (SendMessagePayload *)payload);
-					break;
-				case MSG_REQ_HISTORY:
-					handle_req_history(cli, (RequestHistoryPayload *)payload);
-					break;
-
-				// Groups / Conversations
-				case MSG_CREATE_CONV:
-					handle_create_conv(cli, (CreateConvPayload *)payload);
-					break;
-				case MSG_REQ_CONVERSATIONS:
-					handle_req_conversations(cli);
-					break;
-				case MSG_UPDATE_GROUP:
-					handle_update_group(cli, (UpdateGroupPayload *)payload);
-					break;
-				case MSG_ADD_MEMBER:
-					handle_add_member(cli, (AddMemberPayload *)payload);
-					break;
-				case MSG_REQ_MEMBERS:
-					handle_req_members(cli, (ReqMembersPayload *)payload);
-					break;
-				case MSG_KICK_MEMBER:
-					handle_kick_member(cli, (KickMemberPayload *)payload);
-					break;
-				case MSG_DELETE_GROUP:
-					handle_delete_group(cli, (DeleteGroupPayload *)payload);
-					break;
-
-				// Contacts
-				case MSG_REQ_CONTACTS:
-					handle_req_contacts(cli);
-					break;
-				case MSG_ADD_BY_CODE:
-					handle_add_by_code(cli, (AddContactPayload *)payload);
-					break;
-				case MSG_GET_REQUESTS:
-					handle_get_requests(cli);
-					break;
-				case MSG_DECIDE_REQUEST:
-					handle_decide_request(cli, (DecideRequestPayload *)payload);
-					break;
-
-				default:
-					log_print(LOG_WARN, "Unknown packet type %d from FD %d", type, fd);
-					break;
-				}
-
-				if (payload)
-					free(payload);
+				// The socket had room again: resume the writes it held back
+				if (events[i].events & EPOLLOUT)
+					outqueue_writable(cli->out);
+				if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+					read_client(cli);
 			}
 		}
 	}
 
+	if (drain_expired && conn_count() > 0)
+		log_print(LOG_WARN, "Drain period over, closing %d remaining connection(s)", conn_count());
+	log_print(LOG_INFO, "Handoff complete, exiting");
+
 	// Cleanup
+	executor_shutdown();
+	fanout_shutdown();
 	free_clients();
+	telemetry_close_all();
 	cleanup_openssl();
 	storage_close();
 	log_close();
@@ -0,0 +1,143 @@
+#include "infrastructure/membership.h"
+#include "system/storage.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MEMBERSHIP_BUCKETS 4096
+
+typedef struct Membership
+{
+	uint32_t conv_id;
+	MemberList list;
+	uint32_t cap;
+	struct Membership *next;
+} Membership;
+
+static Membership *buckets[MEMBERSHIP_BUCKETS];
+
+static Membership *find(uint32_t conv_id)
+{
+	Membership *m = buckets[conv_id % MEMBERSHIP_BUCKETS];
+	while (m && m->conv_id != conv_id)
+		m = m->next;
+	return m;
+}
+
+static int reserve(Membership *m, uint32_t count)
+{
+	if (count <= m->cap)
+		return 1;
+	uint32_t cap = m->cap ? m->cap * 2 : 16;
+	while (cap < count)
+		cap *= 2;
+	uint32_t *grown = realloc(m->list.uids, cap * sizeof(uint32_t));
+	if (!grown)
+		return 0;
+	m->list.uids = grown;
+	m->cap = cap;
+	return 1;
+}
+
+// Rows arrive in uid order, so appending keeps the vector sorted
+static int append_uid(const void *row, void *ctx)
+{
+	Membership *m = ctx;
+	if (!reserve(m, m->list.count + 1))
+		return 0;
+	m->list.uids[m->list.count++] = *(const uint32_t *)row;
+	return 1;
+}
+
+// Index of the first uid >= `uid`
+static uint32_t lower_bound(const MemberList *l, uint32_t uid)
+{
+	uint32_t lo = 0, hi = l->count;
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (l->uids[mid] < uid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+const MemberList *membership_get(uint32_t conv_id)
+{
+	Membership *m = find(conv_id);
+	if (!m)
+	{
+		m = calloc(1, sizeof(Membership));
+		if (!m)
+			return NULL;
+		m->conv_id = conv_id;
+		storage_each_conv_participant(conv_id, append_uid, m);
+		if (m->list.count == 0)
+		{
+			// Unknown or not yet created: don't cache
+			free(m->list.uids);
+			free(m);
+			return NULL;
+		}
+		m->list.type = storage_get_conv_type(conv_id);
+		m->next = buckets[conv_id % MEMBERSHIP_BUCKETS];
+		buckets[conv_id % MEMBERSHIP_BUCKETS] = m;
+	}
+	return &m->list;
+}
+
+int membership_contains(uint32_t conv_id, uint32_t uid)
+{
+	const MemberList *l = membership_get(conv_id);
+	if (!l)
+		return 0;
+	uint32_t i = lower_bound(l, uid);
+	return i < l->count && l->uids[i] == uid;
+}
+
+void membership_add(uint32_t conv_id, uint32_t uid)
+{
+	Membership *m = find(conv_id);
+	if (!m)
+		return;
+
+	uint32_t i = lower_bound(&m->list, uid);
+	if (i < m->list.count && m->list.uids[i] == uid)
+		return;
+	if (!reserve(m, m->list.count + 1))
+	{
+		membership_drop(conv_id); // Reloaded on next use
+		return;
+	}
+	memmove(&m->list.uids[i + 1], &m->list.uids[i], (m->list.count - i) * sizeof(uint32_t));
+	m->list.uids[i] = uid;
+	m->list.count++;
+}
+
+void membership_remove(uint32_t conv_id, uint32_t uid)
+{
+	Membership *m = find(conv_id);
+	if (!m)
+		return;
+
+	uint32_t i = lower_bound(&m->list, uid);
+	if (i == m->list.count || m->list.uids[i] != uid)
+		return;
+	memmove(&m->list.uids[i], &m->list.uids[i + 1], (m->list.count - i - 1) * sizeof(uint32_t));
+	m->list.count--;
+}
+
+void membership_drop(uint32_t conv_id)
+{
+	Membership **link = &buckets[conv_id % MEMBERSHIP_BUCKETS];
+	while (*link && (*link)->conv_id != conv_id)
+		link = &(*link)->next;
+	if (!*link)
+		return;
+
+	Membership *m = *link;
+	*link = m->next;
+	free(m->list.uids);
+	free(m);
+}
@@ -0,0 +1,309 @@
+#include "infrastructure/outqueue.h"
+#include "system/logger.h"
+#include <arpa/inet.h>
+#include <openssl/ssl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+struct OutFrame
+{
+	atomic_int refs;
+	uint32_t len; // Header included
+	uint8_t data[];
+};
+
+typedef struct QueuedFrame
+{
+	OutFrame *frame;
+	struct QueuedFrame *next;
+} QueuedFrame;
+
+struct OutQueue
+{
+	Transport transport;
+	pthread_mutex_t io_lock;   // Held by whoever reads or writes the connection
+	pthread_mutex_t list_lock; // Guards the fields below
+	QueuedFrame *head;
+	QueuedFrame *tail;
+	uint32_t bytes;
+	int closed;
+	OutFrame *current;    // Frame being written, taken off the list (io_lock)
+	uint32_t current_off; // Bytes of it already written (io_lock)
+	int want_out;         // EPOLLOUT armed for this connection (io_lock)
+	atomic_int refs;
+};
+
+// The event loop's epoll set, where full sockets ask for EPOLLOUT
+static int poll_fd = -1;
+
+void outqueue_init(int epoll_fd)
+{
+	poll_fd = epoll_fd;
+}
+
+OutFrame *outframe_new(MessageType type, const void *payload, uint32_t payload_len)
+{
+	OutFrame *f = malloc(sizeof(OutFrame) + sizeof(MessageHeader) + payload_len);
+	if (!f)
+		return NULL;
+
+	atomic_init(&f->refs, 1);
+	f->len = sizeof(MessageHeader) + payload_len;
+
+	MessageHeader header;
+	header.type = htonl(type);
+	header.payload_len = htonl(payload_len);
+	memcpy(f->data, &header, sizeof(header));
+	if (payload_len > 0)
+		memcpy(f->data + sizeof(header), payload, payload_len);
+	return f;
+}
+
+MessageType outframe_type(const OutFrame *frame)
+{
+	MessageHeader header;
+	memcpy(&header, frame->data, sizeof(header));
+	return ntohl(header.type);
+}
+
+const void *outframe_payload(const OutFrame *frame, uint32_t *len_out)
+{
+	*len_out = frame->len - sizeof(MessageHeader);
+	return frame->data + sizeof(MessageHeader);
+}
+
+void outframe_retain(OutFrame *frame)
+{
+	atomic_fetch_add(&frame->refs, 1);
+}
+
+void outframe_release(OutFrame *frame)
+{
+	if (frame && atomic_fetch_sub(&frame->refs, 1) == 1)
+		free(frame);
+}
+
+OutQueue *outqueue_new(Transport t)
+{
+	OutQueue *q = calloc(1, sizeof(OutQueue));
+	if (!q)
+		return NULL;
+
+	q->transport = t;
+	pthread_mutex_init(&q->io_lock, NULL);
+	pthread_mutex_init(&q->list_lock, NULL);
+	atomic_init(&q->refs, 1);
+	return q;
+}
+
+void outqueue_retain(OutQueue *q)
+{
+	atomic_fetch_add(&q->refs, 1);
+}
+
+// list_lock held
+static void drop_pending(OutQueue *q)
+{
+	QueuedFrame *n = q->head;
+	while (n)
+	{
+		QueuedFrame *next = n->next;
+		outframe_release(n->frame);
+		free(n);
+		n = next;
+	}
+	q->head = q->tail = NULL;
+	q->bytes = 0;
+}
+
+void outqueue_release(OutQueue *q)
+{
+	if (!q || atomic_fetch_sub(&q->refs, 1) != 1)
+		return;
+
+	drop_pending(q);
+	outframe_release(q->current);
+	if (q->transport.ssl)
+	{
+		SSL_shutdown(q->transport.ssl);
+		SSL_free(q->transport.ssl);
+	}
+	if (q->transport.fd >= 0)
+		close(q->transport.fd);
+	pthread_mutex_destroy(&q->io_lock);
+	pthread_mutex_destroy(&q->list_lock);
+	free(q);
+}
+
+void outqueue_close(OutQueue *q)
+{
+	pthread_mutex_lock(&q->list_lock);
+	q->closed = 1;
+	drop_pending(q);
+	pthread_mutex_unlock(&q->list_lock);
+}
+
+// list_lock held: stops all writes and makes the event loop drop the
+// connection (its next read sees the shutdown)
+static void fail(OutQueue *q)
+{
+	q->closed = 1;
+	drop_pending(q);
+	if (q->transport.fd >= 0)
+		shutdown(q->transport.fd, SHUT_RDWR);
+}
+
+int outqueue_push(OutQueue *q, OutFrame *frame)
+{
+	QueuedFrame *n = malloc(sizeof(QueuedFrame));
+	if (!n)
+		return -1;
+	n->frame = frame;
+	n->next = NULL;
+
+	pthread_mutex_lock(&q->list_lock);
+	if (!q->closed && q->bytes + frame->len > OUTQUEUE_MAX_BYTES)
+	{
+		// The reader stopped reading; don't let it pin unbounded memory
+		log_print(LOG_WARN, "FD %d: over %u bytes queued, closing", q->transport.fd, OUTQUEUE_MAX_BYTES);
+		fail(q);
+	}
+	if (q->closed)
+	{
+		pthread_mutex_unlock(&q->list_lock);
+		free(n);
+		return -1;
+	}
+	outframe_retain(frame);
+	if (q->tail)
+		q->tail->next = n;
+	else
+		q->head = n;
+	q->tail = n;
+	q->bytes += frame->len;
+	pthread_mutex_unlock(&q->list_lock);
+	return 1;
+}
+
+static int has_pending(OutQueue *q)
+{
+	pthread_mutex_lock(&q->list_lock);
+	int pending = q->head != NULL;
+	pthread_mutex_unlock(&q->list_lock);
+	return pending;
+}
+
+// io_lock held: asks the event loop to wake us when the socket has room again
+static void want_writable(OutQueue *q, int on)
+{
+	if (q->want_out == on || poll_fd < 0 || q->transport.fd < 0)
+		return;
+
+	struct epoll_event ev;
+	ev.events = on ? EPOLLIN | EPOLLOUT : EPOLLIN;
+	ev.data.fd = q->transport.fd;
+	epoll_ctl(poll_fd, EPOLL_CTL_MOD, q->transport.fd, &ev); // ENOENT once the client is dropped
+	q->want_out = on;
+}
+
+// io_lock held: writes frames until the queue is empty or the socket is full
+// @return 1 if all was written, 0 if the socket is full, -1 on error
+static int drain(OutQueue *q)
+{
+	while (1)
+	{
+		if (!q->current)
+		{
+			pthread_mutex_lock(&q->list_lock);
+			QueuedFrame *n = q->head;
+			if (n)
+			{
+				q->head = n->next;
+				if (!q->head)
+					q->tail = NULL;
+				q->bytes -= n->frame->len;
+			}
+			pthread_mutex_unlock(&q->list_lock);
+			if (!n)
+			{
+				want_writable(q, 0);
+				return 1;
+			}
+			q->current = n->frame;
+			q->current_off = 0;
+			free(n);
+		}
+
+		// One write per frame: a single TLS record for small packets
+		int sent = transport_write_some(&q->transport, q->current->data + q->current_off,
+												q->current->len - q->current_off);
+		if (sent == 0)
+		{
+			want_writable(q, 1);
+			return 0;
+		}
+		if (sent < 0)
+		{
+			pthread_mutex_lock(&q->list_lock);
+			fail(q);
+			pthread_mutex_unlock(&q->list_lock);
+			outframe_release(q->current);
+			q->current = NULL;
+			return -1;
+		}
+
+		q->current_off += (uint32_t)sent;
+		if (q->current_off == q->current->len)
+		{
+			outframe_release(q->current);
+			q->current = NULL;
+		}
+	}
+}
+
+int outqueue_flush(OutQueue *q)
+{
+	// Re-check after unlocking: frames pushed while we were writing belong to us,
+	// their pusher saw the lock taken and left. A full socket ends the loop:
+	// EPOLLOUT resumes the writing (see outqueue_writable)
+	while (has_pending(q))
+	{
+		if (pthread_mutex_trylock(&q->io_lock) != 0)
+			break;
+		int rc = drain(q);
+		pthread_mutex_unlock(&q->io_lock);
+		if (rc <= 0)
+			break;
+	}
+
+	pthread_mutex_lock(&q->list_lock);
+	int closed = q->closed;
+	pthread_mutex_unlock(&q->list_lock);
+	return closed ? -1 : 1;
+}
+
+void outqueue_writable(OutQueue *q)
+{
+	pthread_mutex_lock(&q->io_lock);
+	int rc = drain(q);
+	pthread_mutex_unlock(&q->io_lock);
+	if (rc > 0)
+		outqueue_flush(q);
+}
+
+void outqueue_lock_io(OutQueue *q)
+{
+	// Writers never block on the socket, so this wait is short
+	pthread_mutex_lock(&q->io_lock);
+}
+
+void outqueue_unlock_io(OutQueue *q)
+{
+	pthread_mutex_unlock(&q->io_lock);
+	outqueue_flush(q);
+}
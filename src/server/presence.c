@@ -0,0 +1,119 @@
+#include "infrastructure/presence.h"
+#include "infrastructure/client_manager.h"
+#include "system/storage.h"
+#include "system/logger.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+// Pending offline announcements, by uid, each with its grace timer
+#define PENDING_BUCKETS 1024
+
+typedef struct PendingOffline
+{
+	uint32_t uid;
+	Timer timer;
+	struct PendingOffline *next;
+} PendingOffline;
+
+static PendingOffline *pending[PENDING_BUCKETS];
+
+// Unlinks the pending offline event for uid, NULL if there is none
+static PendingOffline *take_pending(uint32_t uid)
+{
+	PendingOffline **link = &pending[uid % PENDING_BUCKETS];
+	while (*link && (*link)->uid != uid)
+		link = &(*link)->next;
+
+	PendingOffline *p = *link;
+	if (p)
+		*link = p->next;
+	return p;
+}
+
+// Removes a pending offline event for uid. Returns 1 if one was found.
+static int cancel_pending(uint32_t uid)
+{
+	PendingOffline *p = take_pending(uid);
+	if (!p)
+		return 0;
+	timer_cancel(&p->timer);
+	free(p);
+	return 1;
+}
+
+typedef struct
+{
+	PresencePayload update;
+	int delivered;
+} Announcement;
+
+static int announce_to_contact(const void *row, void *ctx)
+{
+	const ContactSummary *contact = row;
+	Announcement *a = ctx;
+
+	Client *c = get_client_by_uid(contact->uid);
+	if (c && c->presence_subscribed)
+	{
+		client_send(c, MSG_PRESENCE_UPDATE, &a->update, sizeof(a->update));
+		a->delivered++;
+	}
+	return 1;
+}
+
+// One indexed contacts query plus an O(1) registry lookup per contact
+static void announce(uint32_t uid, int is_online)
+{
+	Announcement a;
+	a.update.uid = uid;
+	a.update.is_online = (uint8_t)is_online;
+	a.delivered = 0;
+
+	storage_each_contact(uid, announce_to_contact, &a);
+	log_print(LOG_DEBUG, "Presence: UID %d %s, notified %d contacts", uid, is_online ? "online" : "offline", a.delivered);
+}
+
+void presence_on_login(Client *cli)
+{
+	if (cancel_pending(cli->uid))
+		return; // Reconnected within the grace window: nobody saw it leave
+
+	// Another live connection already announced this user
+	if (client_count_by_uid(cli->uid) > 1)
+		return;
+
+	announce(cli->uid, 1);
+}
+
+static void grace_expired(void *arg)
+{
+	PendingOffline *p = take_pending((uint32_t)(uintptr_t)arg);
+	if (!p)
+		return;
+	announce(p->uid, 0);
+	free(p);
+}
+
+void presence_on_disconnect(uint32_t uid)
+{
+	if (uid == 0 || get_client_by_uid(uid))
+		return;
+
+	PendingOffline *p = malloc(sizeof(PendingOffline));
+	if (!p)
+	{
+		announce(uid, 0);
+		return;
+	}
+	p->uid = uid;
+	p->next = pending[uid % PENDING_BUCKETS];
+	pending[uid % PENDING_BUCKETS] = p;
+	timer_init(&p->timer, grace_expired, (void *)(uintptr_t)uid);
+	timer_arm(&p->timer, PRESENCE_GRACE_MS);
+}
+
+void presence_fill(ContactSummary *contacts, int count)
+{
+	for (int i = 0; i < count; i++)
+		contacts[i].is_online = get_client_by_uid(contacts[i].uid) != NULL;
+}
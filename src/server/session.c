@@ -0,0 +1,89 @@
+#include "infrastructure/session.h"
+#include "system/logger.h"
+#include "system/storage.h"
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static unsigned char session_key[32];
+static int session_ttl = 0;
+
+static int64_t wall_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void sign(const SessionToken *t, uint8_t mac[SESSION_MAC_LEN])
+{
+	unsigned int mac_len = SESSION_MAC_LEN;
+	HMAC(EVP_sha256(), session_key, sizeof(session_key),
+			 (const unsigned char *)t, offsetof(SessionToken, mac), mac, &mac_len);
+}
+
+void session_set_ttl(int ttl_seconds)
+{
+	session_ttl = ttl_seconds > 0 ? ttl_seconds : 0;
+}
+
+void session_init(const char *secret, const char *fallback, int ttl_seconds)
+{
+	session_set_ttl(ttl_seconds);
+
+	const char *label = "mot-session-token";
+	unsigned int len = sizeof(session_key);
+	if (secret && strlen(secret) > 0)
+	{
+		HMAC(EVP_sha256(), secret, strlen(secret), (const unsigned char *)label, strlen(label), session_key, &len);
+	}
+	else if (fallback && strlen(fallback) > 0)
+	{
+		HMAC(EVP_sha256(), fallback, strlen(fallback), (const unsigned char *)label, strlen(label), session_key, &len);
+	}
+	else
+	{
+		// Nothing to derive from: tokens only live until the next restart
+		RAND_bytes(session_key, sizeof(session_key));
+		log_print(LOG_WARN, "Session: no session_key or db_key, using an ephemeral key");
+	}
+}
+
+void session_issue(const MyInfoPayload *me, SessionToken *out)
+{
+	memset(out, 0, sizeof(*out));
+	out->me = *me;
+	out->issued_at_ms = wall_ms();
+	out->expires_at = out->issued_at_ms / 1000 + session_ttl;
+	sign(out, out->mac);
+}
+
+int session_verify(const SessionToken *token, MyInfoPayload *me_out)
+{
+	uint8_t expected[SESSION_MAC_LEN];
+	sign(token, expected);
+	if (CRYPTO_memcmp(expected, token->mac, SESSION_MAC_LEN) != 0)
+		return 0;
+
+	if (token->expires_at <= time(NULL))
+		return 0;
+
+	if (token->issued_at_ms < storage_sessions_not_before(token->me.uid))
+		return 0;
+
+	*me_out = token->me;
+	me_out->username[MAX_NAME_LEN - 1] = '\0';
+	me_out->email[MAX_EMAIL_LEN - 1] = '\0';
+	return 1;
+}
+
+void session_revoke_user(uint32_t uid)
+{
+	if (!storage_revoke_sessions(uid, wall_ms()))
+		log_print(LOG_ERROR, "Session: cannot record the revocation for UID %u", uid);
+}
@@ -4,29 +4,60 @@
 #include <string.h>
 #include <sqlite3.h>
 #include <crypt.h>
+#include <openssl/rand.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 // System
 #include "system/crypto.h"
 #include "system/storage.h"
+#include "system/logger.h"
+
+// How long a request waits for a lock held by maintenance or another process
+#define BUSY_TIMEOUT_MS 2000
+
+// The maintenance thread checkpoints this often; commits only do it past
+// AUTOCHECKPOINT_PAGES, in case the thread falls behind
+#define CHECKPOINT_INTERVAL_S 1
+#define AUTOCHECKPOINT_PAGES 10000
+
+// Per maintenance run: rows sampled per index, free pages given back
+#define ANALYSIS_LIMIT 1000
+#define VACUUM_PAGES 1024
+
+// Messages returned by a history request
+#define HISTORY_LINES 50
 
 static sqlite3 *db = NULL;
+static char db_file[512];
+static int wal_mode = 0;
+
+static pthread_t maintenance_thread;
+static pthread_mutex_t maintenance_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t maintenance_wake = PTHREAD_COND_INITIALIZER;
+static int maintenance_period = 0; // Seconds, 0 when the thread is not running
+static int maintenance_stop = 0;
 
-void generate_random_salt(char *buffer)
+static int generate_random_salt(char *buffer)
 {
 	const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789./";
 	// Format: $6$rounds=5000$ + 16 chars of salt
 	strcpy(buffer, "$6$rounds=5000$");
 	int base_len = strlen(buffer);
 
+	// RAND_bytes, unlike rand(), is safe on executor threads
+	unsigned char bytes[16];
+	if (RAND_bytes(bytes, sizeof(bytes)) != 1)
+		return 0;
 	for (int i = 0; i < 16; i++)
 	{
-		buffer[base_len + i] = charset[rand() % 64];
+		buffer[base_len + i] = charset[bytes[i] % 64];
 	}
 	buffer[base_len + 16] = '\0';
+	return 1;
 }
 
 static void ensure_directory(const char *path)
@@ -50,11 +81,18 @@ int storage_init(const char *db_path)
 {
 	ensure_directory("data");
 
-	if (sqlite3_open(db_path, &db) != SQLITE_OK)
+	// Serialized mode: executors (telemetry channels) read from their own threads
+	if (sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, NULL) != SQLITE_OK)
 	{
 		fprintf(stderr, "Cannot open database: %s\n", sqlite3_errmsg(db));
 		return 0;
 	}
+	snprintf(db_file, sizeof(db_file), "%s", db_path);
+	sqlite3_busy_timeout(db, BUSY_TIMEOUT_MS);
+
+	// Only takes effect when the file is created: free pages can then be
+	// handed back a few at a time instead of by rewriting the whole file
+	sqlite3_exec(db, "PRAGMA auto_vacuum = INCREMENTAL", 0, 0, 0);
 
 	const char *schema =
 			"CREATE TABLE IF NOT EXISTS users ("
@@ -82,10 +120,24 @@ int storage_init(const char *db_path)
 			"conv_id INTEGER, user_id INTEGER,"
 			"role INTEGER DEFAULT 0,"
 			"PRIMARY KEY(conv_id, user_id));"
+			"CREATE INDEX IF NOT EXISTS idx_participants_user ON participants(user_id);"
 
 			"CREATE TABLE IF NOT EXISTS messages ("
 			"id INTEGER PRIMARY KEY AUTOINCREMENT,"
-			"conv_id INTEGER, sender_id INTEGER, text TEXT, timestamp INTEGER);";
+			"conv_id INTEGER, sender_id INTEGER, text TEXT, timestamp INTEGER);"
+			"CREATE INDEX IF NOT EXISTS idx_messages_conv ON messages(conv_id);"
+
+			"CREATE TABLE IF NOT EXISTS pending_deliveries ("
+			"user_id INTEGER, message_id INTEGER,"
+			"PRIMARY KEY(user_id, message_id)) WITHOUT ROWID;"
+
+			"CREATE TABLE IF NOT EXISTS telemetry_channels ("
+			"conv_id INTEGER PRIMARY KEY,"
+			"max_rate INTEGER, retention INTEGER);"
+
+			"CREATE TABLE IF NOT EXISTS session_revocations ("
+			"user_id INTEGER PRIMARY KEY,"
+			"not_before_ms INTEGER NOT NULL);";
 
 	char *err_msg = 0;
 	if (sqlite3_exec(db, schema, 0, 0, &err_msg) != SQLITE_OK)
@@ -98,6 +150,140 @@ int storage_init(const char *db_path)
 	return 1;
 }
 
+// First column of the first row, as text
+static int pragma_text(sqlite3 *conn, const char *sql, char *out, size_t size)
+{
+	sqlite3_stmt *stmt;
+	int found = 0;
+	if (sqlite3_prepare_v2(conn, sql, -1, &stmt, NULL) != SQLITE_OK)
+		return 0;
+	if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_text(stmt, 0))
+	{
+		snprintf(out, size, "%s", (const char *)sqlite3_column_text(stmt, 0));
+		found = 1;
+	}
+	sqlite3_finalize(stmt);
+	return found;
+}
+
+static int pragma_int(sqlite3 *conn, const char *sql)
+{
+	char value[32];
+	return pragma_text(conn, sql, value, sizeof(value)) ? atoi(value) : -1;
+}
+
+// Statistics and free pages. The connection never waits for a lock: a busy
+// step is simply retried on the next run
+static void maintain(sqlite3 *conn, int incremental)
+{
+	// PRAGMA optimize only revisits the tables its own connection queried, and
+	// this one queries none: refresh the statistics directly, sampled
+	if (sqlite3_exec(conn, "ANALYZE", 0, 0, 0) != SQLITE_OK)
+		log_print(LOG_DEBUG, "Storage maintenance: ANALYZE skipped (%s)", sqlite3_errmsg(conn));
+
+	int free_pages = incremental ? pragma_int(conn, "PRAGMA freelist_count") : 0;
+	if (free_pages > 0)
+	{
+		char sql[64];
+		snprintf(sql, sizeof(sql), "PRAGMA incremental_vacuum(%d)", VACUUM_PAGES);
+		if (sqlite3_exec(conn, sql, 0, 0, 0) == SQLITE_OK)
+			log_print(LOG_DEBUG, "Storage maintenance: %d free page(s), released up to %d", free_pages, VACUUM_PAGES);
+	}
+}
+
+static void *maintenance_main(void *arg)
+{
+	(void)arg;
+	sqlite3 *conn = NULL;
+	if (sqlite3_open_v2(db_file, &conn, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK)
+	{
+		log_print(LOG_ERROR, "Storage maintenance: cannot open %s: %s", db_file, sqlite3_errmsg(conn));
+		sqlite3_close(conn);
+		return NULL;
+	}
+	char sql[64];
+	snprintf(sql, sizeof(sql), "PRAGMA analysis_limit = %d", ANALYSIS_LIMIT);
+	sqlite3_exec(conn, sql, 0, 0, 0);
+	int incremental = pragma_int(conn, "PRAGMA auto_vacuum") == 2;
+
+	int elapsed = 0;
+	pthread_mutex_lock(&maintenance_lock);
+	while (!maintenance_stop)
+	{
+		struct timespec until;
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_sec += CHECKPOINT_INTERVAL_S;
+		pthread_cond_timedwait(&maintenance_wake, &maintenance_lock, &until);
+		if (maintenance_stop)
+			break;
+		pthread_mutex_unlock(&maintenance_lock);
+
+		// Passive: copies what no reader still needs, never blocks anyone
+		if (wal_mode)
+			sqlite3_wal_checkpoint_v2(conn, NULL, SQLITE_CHECKPOINT_PASSIVE, NULL, NULL);
+		if ((elapsed += CHECKPOINT_INTERVAL_S) >= maintenance_period)
+		{
+			elapsed = 0;
+			maintain(conn, incremental);
+		}
+
+		pthread_mutex_lock(&maintenance_lock);
+	}
+	pthread_mutex_unlock(&maintenance_lock);
+	sqlite3_close(conn);
+	return NULL;
+}
+
+void storage_tune(const AppConfig *config)
+{
+	char sql[128], mode[16] = "";
+
+	// Switching needs the file to itself: a server taking over from one still
+	// on the rollback journal keeps it until its next restart
+	snprintf(sql, sizeof(sql), "PRAGMA journal_mode = %s", config->db_wal ? "WAL" : "DELETE");
+	pragma_text(db, sql, mode, sizeof(mode));
+	wal_mode = strcmp(mode, "wal") == 0;
+	if (config->db_wal && !wal_mode)
+		log_print(LOG_WARN, "Storage: cannot switch to WAL (database busy), staying in %s mode", mode);
+
+	const char *sync = "FULL";
+	if (strcmp(config->db_synchronous, "normal") == 0)
+		sync = "NORMAL";
+	else if (strcmp(config->db_synchronous, "full") != 0)
+		log_print(LOG_WARN, "Storage: unknown db_synchronous '%s', using full", config->db_synchronous);
+	snprintf(sql, sizeof(sql), "PRAGMA synchronous = %s", sync);
+	sqlite3_exec(db, sql, 0, 0, 0);
+
+	// Negative: a size in KiB rather than in pages
+	if (config->db_cache_kb > 0)
+	{
+		snprintf(sql, sizeof(sql), "PRAGMA cache_size = -%d", config->db_cache_kb);
+		sqlite3_exec(db, sql, 0, 0, 0);
+	}
+	snprintf(sql, sizeof(sql), "PRAGMA mmap_size = %lld", (long long)(config->db_mmap_mb > 0 ? config->db_mmap_mb : 0) * 1024 * 1024);
+	sqlite3_exec(db, sql, 0, 0, 0);
+
+	log_print(LOG_INFO, "Storage: %s journal, synchronous %s, %d KiB cache, %d MiB mmap", mode, sync,
+						config->db_cache_kb, config->db_mmap_mb > 0 ? config->db_mmap_mb : 0);
+	if (pragma_int(db, "PRAGMA auto_vacuum") != 2)
+		log_print(LOG_INFO, "Storage: database created without incremental vacuum, run VACUUM once (offline) to enable it");
+
+	if (config->db_maintenance <= 0)
+		return;
+	maintenance_period = config->db_maintenance;
+	maintenance_stop = 0;
+	if (pthread_create(&maintenance_thread, NULL, maintenance_main, NULL) != 0)
+	{
+		log_print(LOG_ERROR, "Cannot start the storage maintenance thread");
+		maintenance_period = 0;
+		return;
+	}
+	if (wal_mode)
+		sqlite3_wal_autocheckpoint(db, AUTOCHECKPOINT_PAGES);
+	log_print(LOG_INFO, "Storage maintenance: checkpoints every %ds, statistics and vacuum every %ds",
+						CHECKPOINT_INTERVAL_S, maintenance_period);
+}
+
 void storage_backup(const char *db_path)
 {
 	// 1. Create backups directory
@@ -105,9 +291,12 @@ void storage_backup(const char *db_path)
 	ensure_directory("data/backups");
 
 	// 2. Open Source
-	FILE *src = fopen(db_path, "rb");
-	if (!src)
+	sqlite3 *src = NULL;
+	if (sqlite3_open_v2(db_path, &src, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK)
+	{
+		sqlite3_close(src);
 		return; // No DB to backup yet (first run)
+	}
 
 	// 3. Generate Destination Filename with Date
 	time_t now = time(NULL);
@@ -117,42 +306,123 @@ void storage_backup(const char *db_path)
 	snprintf(dest_path, sizeof(dest_path), "data/backups/messagerie_%04d-%02d-%02d.db",
 					 t->tm_year + 1900, t->tm_mon + 1, t->tm_mday);
 
-	// 4. Copy File
-	FILE *dst = fopen(dest_path, "wb");
-	if (dst)
+	// 4. Copy through SQLite: a plain file copy would miss the commits still
+	// in the write-ahead log
+	unlink(dest_path); // VACUUM INTO does not overwrite
+	char *sql = sqlite3_mprintf("VACUUM INTO %Q", dest_path);
+	if (sqlite3_exec(src, sql, 0, 0, 0) == SQLITE_OK)
 	{
-		char buffer[8192];
-		size_t n;
-		while ((n = fread(buffer, 1, sizeof(buffer), src)) > 0)
-		{
-			fwrite(buffer, 1, n, dst);
-		}
-		fclose(dst);
 		printf("[Storage] Database backed up to %s\n", dest_path);
 	}
 	else
 	{
-		fprintf(stderr, "[Storage] Failed to create backup file %s\n", dest_path);
+		fprintf(stderr, "[Storage] Failed to create backup file %s: %s\n", dest_path, sqlite3_errmsg(src));
 	}
+	sqlite3_free(sql);
 
-	fclose(src);
+	sqlite3_close(src);
 }
 
 void storage_close(void)
 {
+	if (maintenance_period > 0)
+	{
+		pthread_mutex_lock(&maintenance_lock);
+		maintenance_stop = 1;
+		pthread_cond_signal(&maintenance_wake);
+		pthread_mutex_unlock(&maintenance_lock);
+		pthread_join(maintenance_thread, NULL);
+		maintenance_period = 0;
+	}
 	if (db)
 		sqlite3_close(db);
 }
 
+// --- TRANSACTIONS ---
+
+// Nesting depth: the outermost level is the transaction, the inner ones
+// are savepoints, so a nested rollback only undoes its own writes
+static int txn_depth = 0;
+
+static int exec_level(const char *verb, int level)
+{
+	char sql[48];
+	snprintf(sql, sizeof(sql), "%s level_%d", verb, level);
+	return sqlite3_exec(db, sql, 0, 0, 0) == SQLITE_OK;
+}
+
+int storage_begin(void)
+{
+	int ok = txn_depth == 0 ? sqlite3_exec(db, "BEGIN IMMEDIATE", 0, 0, 0) == SQLITE_OK
+													: exec_level("SAVEPOINT", txn_depth);
+	if (!ok)
+		return 0;
+	txn_depth++;
+	return 1;
+}
+
+int storage_commit(void)
+{
+	if (txn_depth == 0)
+		return 0;
+	int ok = txn_depth == 1 ? sqlite3_exec(db, "COMMIT", 0, 0, 0) == SQLITE_OK
+													: exec_level("RELEASE", txn_depth - 1);
+	// On failure the level stays open, for storage_rollback()
+	if (ok)
+		txn_depth--;
+	return ok;
+}
+
+void storage_rollback(void)
+{
+	if (txn_depth == 0)
+		return;
+	if (txn_depth == 1)
+	{
+		sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+	}
+	else
+	{
+		exec_level("ROLLBACK TO", txn_depth - 1);
+		exec_level("RELEASE", txn_depth - 1);
+	}
+	txn_depth--;
+}
+
 // --- USER AUTH ---
 
-int storage_register_user(const char *email, const char *username, const char *password, char *friend_code_out)
+int storage_hash_password(const char *password, const char *setting, char *hash_out, size_t size)
+{
+	char salt[64];
+	if (!setting)
+	{
+		if (!generate_random_salt(salt))
+			return 0;
+		setting = salt;
+	}
+
+	// crypt() returns a static buffer; crypt_r() keeps its state in ours
+	struct crypt_data *data = calloc(1, sizeof(struct crypt_data));
+	if (!data)
+		return 0;
+	char *hash = crypt_r(password, setting, data);
+	int ok = hash && hash[0] != '*' && strlen(hash) < size;
+	if (ok)
+		strcpy(hash_out, hash);
+	free(data);
+	return ok;
+}
+
+int storage_verify_password(const char *password, const char *stored_hash)
+{
+	char hash[128];
+	return storage_hash_password(password, stored_hash, hash, sizeof(hash)) && strcmp(hash, stored_hash) == 0;
+}
+
+int storage_register_user(const char *email, const char *username, const char *password_hash, char *friend_code_out)
 {
 	char code[8];
 	generate_friend_code(code);
-	char salt[64];
-	generate_random_salt(salt);
-	char *hash = crypt(password, salt);
 
 	const char *sql = "INSERT INTO users (username, email, password_hash, friend_code) VALUES (?, ?, ?, ?)";
 	sqlite3_stmt *stmt;
@@ -162,7 +432,7 @@ int storage_register_user(const char *email, const char *username, const char *p
 
 	sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
 	sqlite3_bind_text(stmt, 2, email, -1, SQLITE_STATIC);
-	sqlite3_bind_text(stmt, 3, hash, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 3, password_hash, -1, SQLITE_STATIC);
 	sqlite3_bind_text(stmt, 4, code, -1, SQLITE_STATIC);
 
 	int rc = sqlite3_step(stmt);
@@ -176,7 +446,7 @@ int storage_register_user(const char *email, const char *username, const char *p
 	return 0;
 }
 
-int storage_check_credentials(const char *email, const char *password, User *user_out)
+int storage_get_user_by_email(const char *email, User *user_out)
 {
 	const char *sql = "SELECT uid, username, email, password_hash, friend_code FROM users WHERE email = ?";
 	sqlite3_stmt *stmt;
@@ -188,24 +458,18 @@ int storage_check_credentials(const char *email, const char *password, User *use
 	int result = 0;
 	if (sqlite3_step(stmt) == SQLITE_ROW)
 	{
-		const char *stored_hash = (const char *)sqlite3_column_text(stmt, 3);
-		char *hash = crypt(password, stored_hash);
-
-		if (strcmp(hash, stored_hash) == 0)
-		{
-			user_out->uid = sqlite3_column_int(stmt, 0);
-			strncpy(user_out->username, (char *)sqlite3_column_text(stmt, 1), MAX_NAME_LEN);
-			strncpy(user_out->email, (char *)sqlite3_column_text(stmt, 2), MAX_EMAIL_LEN);
-			strncpy(user_out->password_hash, stored_hash, 128);
-			strncpy(user_out->friend_code, (char *)sqlite3_column_text(stmt, 4), FRIEND_CODE_LEN);
-			result = 1;
-		}
+		user_out->uid = sqlite3_column_int(stmt, 0);
+		strncpy(user_out->username, (char *)sqlite3_column_text(stmt, 1), MAX_NAME_LEN);
+		strncpy(user_out->email, (char *)sqlite3_column_text(stmt, 2), MAX_EMAIL_LEN);
+		strncpy(user_out->password_hash, (char *)sqlite3_column_text(stmt, 3), 128);
+		strncpy(user_out->friend_code, (char *)sqlite3_column_text(stmt, 4), FRIEND_CODE_LEN);
+		result = 1;
 	}
 	sqlite3_finalize(stmt);
 	return result;
 }
 
-int storage_update_user(uint32_t uid, const char *new_username, const char *new_password)
+int storage_update_user(uint32_t uid, const char *new_username, const char *new_password_hash)
 {
 	if (strlen(new_username) > 0)
 	{
@@ -219,16 +483,13 @@ int storage_update_user(uint32_t uid, const char *new_username, const char *new_
 			sqlite3_finalize(stmt);
 		}
 	}
-	if (strlen(new_password) > 0)
+	if (new_password_hash && strlen(new_password_hash) > 0)
 	{
-		char salt[64];
-		generate_random_salt(salt);
-		char *hash = crypt(new_password, salt);
 		const char *sql = "UPDATE users SET password_hash = ? WHERE uid = ?";
 		sqlite3_stmt *stmt;
 		if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) == SQLITE_OK)
 		{
-			sqlite3_bind_text(stmt, 1, hash, -1, SQLITE_STATIC);
+			sqlite3_bind_text(stmt, 1, new_password_hash, -1, SQLITE_STATIC);
 			sqlite3_bind_int(stmt, 2, uid);
 			sqlite3_step(stmt);
 			sqlite3_finalize(stmt);
@@ -239,6 +500,31 @@ int storage_update_user(uint32_t uid, const char *new_username, const char *new_
 
 // --- LOOKUPS ---
 
+int storage_revoke_sessions(uint32_t uid, int64_t not_before_ms)
+{
+	const char *sql = "INSERT OR REPLACE INTO session_revocations (user_id, not_before_ms) VALUES (?, ?)";
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+		return 0;
+	sqlite3_bind_int(stmt, 1, uid);
+	sqlite3_bind_int64(stmt, 2, not_before_ms);
+	int rc = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+	return (rc == SQLITE_DONE);
+}
+
+int64_t storage_sessions_not_before(uint32_t uid)
+{
+	const char *sql = "SELECT not_before_ms FROM session_revocations WHERE user_id = ?";
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+		return INT64_MAX; // Cannot tell: refuse rather than accept a revoked token
+	sqlite3_bind_int(stmt, 1, uid);
+	int64_t not_before = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+	sqlite3_finalize(stmt);
+	return not_before;
+}
+
 int storage_get_uid_by_code(const char *code, uint32_t *uid_out)
 {
 	const char *sql = "SELECT uid FROM users WHERE friend_code = ?";
@@ -322,9 +608,9 @@ int storage_add_friendship(uint32_t uid_a, uint32_t uid_b)
 	return 1;
 }
 
-int storage_get_contacts_data(uint32_t uid, ContactSummary *out_array, int max_count)
+// Shared by the contacts and requests iterators (same row shape)
+static int each_contact_row(const char *sql, uint32_t uid, StorageRowCallback cb, void *ctx)
 {
-	const char *sql = "SELECT u.uid, u.username FROM contacts c JOIN users u ON c.contact_id = u.uid WHERE c.user_id = ?";
 	sqlite3_stmt *stmt;
 	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
 		return 0;
@@ -332,36 +618,30 @@ int storage_get_contacts_data(uint32_t uid, ContactSummary *out_array, int max_c
 	sqlite3_bind_int(stmt, 1, uid);
 
 	int count = 0;
-	while (sqlite3_step(stmt) == SQLITE_ROW && count < max_count)
+	while (sqlite3_step(stmt) == SQLITE_ROW)
 	{
-		out_array[count].uid = sqlite3_column_int(stmt, 0);
-		strncpy(out_array[count].username, (char *)sqlite3_column_text(stmt, 1), MAX_NAME_LEN);
-		out_array[count].is_online = 0; // Can be linked to Client list later
+		ContactSummary row = {0};
+		row.uid = sqlite3_column_int(stmt, 0);
+		strncpy(row.username, (char *)sqlite3_column_text(stmt, 1), MAX_NAME_LEN);
+		row.is_online = 0; // Can be linked to Client list later
 		count++;
+		if (!cb(&row, ctx))
+			break;
 	}
 	sqlite3_finalize(stmt);
 	return count;
 }
 
-int storage_get_requests_data(uint32_t uid, ContactSummary *out_array, int max_count)
+int storage_each_contact(uint32_t uid, StorageRowCallback cb, void *ctx)
 {
-	const char *sql = "SELECT u.uid, u.username FROM requests r JOIN users u ON r.sender_id = u.uid WHERE r.receiver_id = ?";
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
-		return 0;
-
-	sqlite3_bind_int(stmt, 1, uid);
+	return each_contact_row("SELECT u.uid, u.username FROM contacts c JOIN users u ON c.contact_id = u.uid WHERE c.user_id = ?",
+													uid, cb, ctx);
+}
 
-	int count = 0;
-	while (sqlite3_step(stmt) == SQLITE_ROW && count < max_count)
-	{
-		out_array[count].uid = sqlite3_column_int(stmt, 0);
-		strncpy(out_array[count].username, (char *)sqlite3_column_text(stmt, 1), MAX_NAME_LEN);
-		out_array[count].is_online = 0;
-		count++;
-	}
-	sqlite3_finalize(stmt);
-	return count;
+int storage_each_request(uint32_t uid, StorageRowCallback cb, void *ctx)
+{
+	return each_contact_row("SELECT u.uid, u.username FROM requests r JOIN users u ON r.sender_id = u.uid WHERE r.receiver_id = ?",
+													uid, cb, ctx);
 }
 
 // --- CONVERSATIONS ---
@@ -418,7 +698,7 @@ uint32_t storage_create_conversation(uint8_t type, const char *name, const char
 	{
 		sqlite3_bind_int(stmt, 1, conv_id);
 		sqlite3_bind_int(stmt, 2, uids[i]);
-		int role = (i == 0 && type == 1) ? 1 : 0;
+		int role = (i == 0 && type != CONV_TYPE_PRIVATE) ? 1 : 0;
 
 		sqlite3_bind_int(stmt, 3, role);
 		sqlite3_step(stmt);
@@ -428,7 +708,51 @@ uint32_t storage_create_conversation(uint8_t type, const char *name, const char
 	return conv_id;
 }
 
-int storage_get_user_conversations(uint32_t uid, ConversationSummary *out_array, int max_count)
+// Builds a summary from (conv_id, type, name, description, role), as `uid` sees it
+static void fill_conversation(sqlite3_stmt *stmt, uint32_t uid, ConversationSummary *row)
+{
+	memset(row, 0, sizeof(*row));
+	row->conv_id = sqlite3_column_int(stmt, 0);
+	int type = sqlite3_column_int(stmt, 1);
+	row->type = (uint8_t)type;
+	row->my_role = (uint8_t)sqlite3_column_int(stmt, 4);
+	row->unread_count = 0;
+
+	// DYNAMIC NAMING
+	if (type == 0)
+	{ // Private
+		// Find the 'other' participant
+		const char *sql_other = "SELECT u.username FROM participants p JOIN users u ON p.user_id = u.uid WHERE p.conv_id = ? AND p.user_id != ?";
+		sqlite3_stmt *stmt2;
+		sqlite3_prepare_v2(db, sql_other, -1, &stmt2, 0);
+		sqlite3_bind_int(stmt2, 1, row->conv_id);
+		sqlite3_bind_int(stmt2, 2, uid);
+
+		if (sqlite3_step(stmt2) == SQLITE_ROW)
+		{
+			const char *other_name = (const char *)sqlite3_column_text(stmt2, 0);
+			snprintf(row->name, 32, "Private with %s", other_name);
+		}
+		else
+		{
+			strcpy(row->name, "Private Chat");
+		}
+		sqlite3_finalize(stmt2);
+		row->description[0] = '\0'; // No desc for private
+	}
+	else
+	{
+		// Group: Use stored name
+		strncpy(row->name, (char *)sqlite3_column_text(stmt, 2), 32);
+		const char *desc = (char *)sqlite3_column_text(stmt, 3);
+		if (desc)
+			strncpy(row->description, desc, MAX_DESC_LEN);
+		else
+			row->description[0] = '\0';
+	}
+}
+
+int storage_each_user_conversation(uint32_t uid, StorageRowCallback cb, void *ctx)
 {
 	const char *sql = "SELECT c.conv_id, c.type, c.name, c.description, p.role FROM conversations c "
 										"JOIN participants p ON c.conv_id = p.conv_id "
@@ -440,77 +764,66 @@ int storage_get_user_conversations(uint32_t uid, ConversationSummary *out_array,
 	sqlite3_bind_int(stmt, 1, uid);
 
 	int count = 0;
-	while (sqlite3_step(stmt) == SQLITE_ROW && count < max_count)
-	{
-		out_array[count].conv_id = sqlite3_column_int(stmt, 0);
-		int type = sqlite3_column_int(stmt, 1);
-		out_array[count].type = (uint8_t)type;
-		out_array[count].my_role = (uint8_t)sqlite3_column_int(stmt, 4);
-		out_array[count].unread_count = 0;
-
-		// DYNAMIC NAMING
-		if (type == 0)
-		{ // Private
-			// Find the 'other' participant
-			const char *sql_other = "SELECT u.username FROM participants p JOIN users u ON p.user_id = u.uid WHERE p.conv_id = ? AND p.user_id != ?";
-			sqlite3_stmt *stmt2;
-			sqlite3_prepare_v2(db, sql_other, -1, &stmt2, 0);
-			sqlite3_bind_int(stmt2, 1, out_array[count].conv_id);
-			sqlite3_bind_int(stmt2, 2, uid);
-
-			if (sqlite3_step(stmt2) == SQLITE_ROW)
-			{
-				const char *other_name = (const char *)sqlite3_column_text(stmt2, 0);
-				snprintf(out_array[count].name, 32, "Private with %s", other_name);
-			}
-			else
-			{
-				strcpy(out_array[count].name, "Private Chat");
-			}
-			sqlite3_finalize(stmt2);
-			out_array[count].description[0] = '\0'; // No desc for private
-		}
-		else
-		{
-			// Group: Use stored name
-			strncpy(out_array[count].name, (char *)sqlite3_column_text(stmt, 2), 32);
-			const char *desc = (char *)sqlite3_column_text(stmt, 3);
-			if (desc)
-				strncpy(out_array[count].description, desc, MAX_DESC_LEN);
-			else
-				out_array[count].description[0] = '\0';
-		}
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		ConversationSummary row;
+		fill_conversation(stmt, uid, &row);
 
 		count++;
+		if (!cb(&row, ctx))
+			break;
 	}
 	sqlite3_finalize(stmt);
 	return count;
 }
 
-int storage_get_conv_participants(uint32_t conv_id, uint32_t *out_uids, int max_count)
+int storage_get_conversation(uint32_t conv_id, uint32_t uid, ConversationSummary *out)
+{
+	const char *sql = "SELECT c.conv_id, c.type, c.name, c.description, COALESCE(p.role, 0) FROM conversations c "
+										"LEFT JOIN participants p ON c.conv_id = p.conv_id AND p.user_id = ? "
+										"WHERE c.conv_id = ?";
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+		return 0;
+
+	sqlite3_bind_int(stmt, 1, uid);
+	sqlite3_bind_int(stmt, 2, conv_id);
+
+	int found = sqlite3_step(stmt) == SQLITE_ROW;
+	if (found)
+		fill_conversation(stmt, uid, out);
+	sqlite3_finalize(stmt);
+	return found;
+}
+
+int storage_each_conv_participant(uint32_t conv_id, StorageRowCallback cb, void *ctx)
 {
-	const char *sql = "SELECT user_id FROM participants WHERE conv_id = ?";
+	const char *sql = "SELECT user_id FROM participants WHERE conv_id = ? ORDER BY user_id";
 	sqlite3_stmt *stmt;
 	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
 		return 0;
 	sqlite3_bind_int(stmt, 1, conv_id);
 
 	int count = 0;
-	while (sqlite3_step(stmt) == SQLITE_ROW && count < max_count)
+	while (sqlite3_step(stmt) == SQLITE_ROW)
 	{
-		out_uids[count++] = sqlite3_column_int(stmt, 0);
+		uint32_t uid = (uint32_t)sqlite3_column_int64(stmt, 0);
+		count++;
+		if (!cb(&uid, ctx))
+			break;
 	}
 	sqlite3_finalize(stmt);
 	return count;
 }
 
-void storage_log_message(uint32_t conv_id, uint32_t sender_uid, const char *text)
+uint32_t storage_log_message(uint32_t conv_id, uint32_t sender_uid, const char *text)
 {
 
 	char *encrypted_text = crypto_encrypt(text);
 	if (!encrypted_text)
-		return;
+		return 0;
 
+	uint32_t msg_id = 0;
 	const char *sql = "INSERT INTO messages (conv_id, sender_id, text, timestamp) VALUES (?, ?, ?, ?)";
 	sqlite3_stmt *stmt;
 	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) == SQLITE_OK)
@@ -519,61 +832,174 @@ void storage_log_message(uint32_t conv_id, uint32_t sender_uid, const char *text
 		sqlite3_bind_int(stmt, 2, sender_uid);
 		sqlite3_bind_text(stmt, 3, encrypted_text, -1, SQLITE_STATIC);
 		sqlite3_bind_int64(stmt, 4, time(NULL));
-		sqlite3_step(stmt);
+		if (sqlite3_step(stmt) == SQLITE_DONE)
+			msg_id = (uint32_t)sqlite3_last_insert_rowid(db);
 		sqlite3_finalize(stmt);
 	}
 	free(encrypted_text);
+	return msg_id;
 }
 
-char *storage_get_history(uint32_t conv_id)
+// --- OFFLINE DELIVERY ---
+
+int storage_add_pending_delivery(uint32_t uid, uint32_t msg_id)
 {
-	char *buf = NULL;
-	size_t len = 0;
+	const char *sql = "INSERT OR IGNORE INTO pending_deliveries (user_id, message_id) VALUES (?, ?)";
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+		return 0;
+	sqlite3_bind_int(stmt, 1, uid);
+	sqlite3_bind_int(stmt, 2, msg_id);
+	int rc = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+	return (rc == SQLITE_DONE);
+}
 
-	const char *sql = "SELECT u.username, m.text, m.timestamp FROM messages m "
+int storage_has_pending_deliveries(uint32_t uid)
+{
+	// Same rows as storage_each_pending_message(), so an entry that will never
+	// be sent does not trigger an empty push at every login
+	const char *sql = "SELECT 1 FROM pending_deliveries d "
+										"JOIN messages m ON m.id = d.message_id "
+										"JOIN participants p ON p.conv_id = m.conv_id AND p.user_id = d.user_id "
+										"WHERE d.user_id = ? LIMIT 1";
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+		return 0;
+	sqlite3_bind_int(stmt, 1, uid);
+	int found = (sqlite3_step(stmt) == SQLITE_ROW);
+	sqlite3_finalize(stmt);
+	return found;
+}
+
+int storage_each_pending_message(uint32_t uid, uint32_t limit, StorageRowCallback cb, void *ctx)
+{
+	// Messages of conversations the user has since left are skipped
+	const char *sql = "SELECT m.id, m.conv_id, m.sender_id, u.username, m.text, m.timestamp "
+										"FROM pending_deliveries d "
+										"JOIN messages m ON m.id = d.message_id "
+										"JOIN participants p ON p.conv_id = m.conv_id AND p.user_id = d.user_id "
+										"JOIN users u ON u.uid = m.sender_id "
+										"WHERE d.user_id = ? ORDER BY m.id ASC LIMIT ?";
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+		return 0;
+	sqlite3_bind_int(stmt, 1, uid);
+	sqlite3_bind_int64(stmt, 2, limit > 0 ? (sqlite3_int64)limit : -1);
+
+	int count = 0;
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		OfflineMessage row = {0};
+		row.message_id = sqlite3_column_int(stmt, 0);
+		row.conv_id = sqlite3_column_int(stmt, 1);
+		row.sender_uid = sqlite3_column_int(stmt, 2);
+		strncpy(row.sender_username, (char *)sqlite3_column_text(stmt, 3), MAX_NAME_LEN - 1);
+		row.timestamp = sqlite3_column_int64(stmt, 5);
+
+		char *text = crypto_decrypt((const char *)sqlite3_column_text(stmt, 4));
+		if (text)
+		{
+			strncpy(row.text, text, MAX_TEXT_LEN - 1);
+			free(text);
+		}
+
+		count++;
+		if (!cb(&row, ctx))
+			break;
+	}
+	sqlite3_finalize(stmt);
+	return count;
+}
+
+int storage_clear_pending_deliveries(uint32_t uid, uint32_t up_to_msg_id)
+{
+	const char *sql = "DELETE FROM pending_deliveries WHERE user_id = ? AND message_id <= ?";
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+		return 0;
+	sqlite3_bind_int(stmt, 1, uid);
+	sqlite3_bind_int(stmt, 2, up_to_msg_id);
+	sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+	return sqlite3_changes(db);
+}
+
+int storage_each_history_line(uint32_t conv_id, StorageRowCallback cb, void *ctx)
+{
+	// The newest HISTORY_LINES, oldest first: members back from offline
+	// (broadcast ones have no pending deliveries) see what they missed
+	const char *sql = "SELECT username, text, timestamp FROM ("
+										"SELECT m.id, u.username, m.text, m.timestamp FROM messages m "
 										"JOIN users u ON m.sender_id = u.uid "
-										"WHERE m.conv_id = ? ORDER BY m.timestamp ASC LIMIT 50";
+										"WHERE m.conv_id = ? ORDER BY m.id DESC LIMIT ?) "
+										"ORDER BY id ASC";
 
 	sqlite3_stmt *stmt;
 	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
-		return strdup("");
+		return 0;
 
 	sqlite3_bind_int(stmt, 1, conv_id);
+	sqlite3_bind_int(stmt, 2, HISTORY_LINES);
 
+	int count = 0;
 	while (sqlite3_step(stmt) == SQLITE_ROW)
 	{
 		const char *user = (const char *)sqlite3_column_text(stmt, 0);
 		const char *enc_text = (const char *)sqlite3_column_text(stmt, 1);
 
 		char *decrypted_text = crypto_decrypt(enc_text);
+		if (!decrypted_text)
+			continue;
 
 		time_t rawtime = (time_t)sqlite3_column_int64(stmt, 2);
 		struct tm *t = localtime(&rawtime);
 
-		char line_header[64];
-		snprintf(line_header, sizeof(line_header), "[%02d:%02d] %s: ", t->tm_hour, t->tm_min, user);
-
-		size_t line_len = strlen(line_header) + strlen(decrypted_text) + 2; // +1 for \n, +1 for null (temp)
+		// Header (64) + text (MAX_TEXT_LEN) + '\n' + NUL
+		char line[64 + MAX_TEXT_LEN + 2];
+		snprintf(line, sizeof(line), "[%02d:%02d] %s: %s\n", t->tm_hour, t->tm_min, user, decrypted_text);
+		free(decrypted_text);
 
-		char *new_buf = realloc(buf, len + line_len + 1);
-		if (!new_buf)
-		{
-			// Allocation failed, stop here and return what we have
+		count++;
+		if (!cb(line, ctx))
 			break;
-		}
+	}
+	sqlite3_finalize(stmt);
+	return count;
+}
 
-		buf = new_buf;
+typedef struct
+{
+	char *buf;
+	size_t len;
+} HistoryBuffer;
 
-		// Append
-		sprintf(buf + len, "%s%s\n", line_header, decrypted_text);
-		len += line_len;
+static int append_history_line(const void *row, void *ctx)
+{
+	HistoryBuffer *hb = ctx;
+	const char *line = row;
+	size_t line_len = strlen(line);
 
-		free(decrypted_text);
+	char *new_buf = realloc(hb->buf, hb->len + line_len + 1);
+	if (!new_buf)
+	{
+		// Allocation failed, stop here and return what we have
+		return 0;
 	}
-	sqlite3_finalize(stmt);
-	if (!buf)
+
+	hb->buf = new_buf;
+	memcpy(hb->buf + hb->len, line, line_len + 1);
+	hb->len += line_len;
+	return 1;
+}
+
+char *storage_get_history(uint32_t conv_id)
+{
+	HistoryBuffer hb = {NULL, 0};
+	storage_each_history_line(conv_id, append_history_line, &hb);
+	if (!hb.buf)
 		return strdup("");
-	return buf;
+	return hb.buf;
 }
 
 int storage_is_admin(uint32_t conv_id, uint32_t uid)
@@ -622,23 +1048,29 @@ int storage_add_participant(uint32_t conv_id, uint32_t uid, int role)
 	return (rc == SQLITE_DONE);
 }
 
-int storage_get_group_members(uint32_t conv_id, GroupMemberSummary *out_array, int max_count)
+int storage_each_group_member(uint32_t conv_id, uint32_t after_uid, uint32_t limit, StorageRowCallback cb, void *ctx)
 {
 	const char *sql = "SELECT u.uid, u.username, p.role FROM participants p "
-										"JOIN users u ON p.user_id = u.uid WHERE p.conv_id = ?";
+										"JOIN users u ON p.user_id = u.uid WHERE p.conv_id = ? AND p.user_id > ? "
+										"ORDER BY p.user_id LIMIT ?";
 	sqlite3_stmt *stmt;
 	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
 		return 0;
 
 	sqlite3_bind_int(stmt, 1, conv_id);
+	sqlite3_bind_int64(stmt, 2, after_uid);
+	sqlite3_bind_int64(stmt, 3, limit > 0 ? (sqlite3_int64)limit : -1);
 
 	int count = 0;
-	while (sqlite3_step(stmt) == SQLITE_ROW && count < max_count)
+	while (sqlite3_step(stmt) == SQLITE_ROW)
 	{
-		out_array[count].uid = sqlite3_column_int(stmt, 0);
-		strncpy(out_array[count].username, (char *)sqlite3_column_text(stmt, 1), MAX_NAME_LEN);
-		out_array[count].role = sqlite3_column_int(stmt, 2);
+		GroupMemberSummary row = {0};
+		row.uid = sqlite3_column_int(stmt, 0);
+		strncpy(row.username, (char *)sqlite3_column_text(stmt, 1), MAX_NAME_LEN);
+		row.role = sqlite3_column_int(stmt, 2);
 		count++;
+		if (!cb(&row, ctx))
+			break;
 	}
 	sqlite3_finalize(stmt);
 	return count;
@@ -646,34 +1078,100 @@ int storage_get_group_members(uint32_t conv_id, GroupMemberSummary *out_array, i
 
 int storage_remove_participant(uint32_t conv_id, uint32_t uid)
 {
-	const char *sql = "DELETE FROM participants WHERE conv_id = ? AND user_id = ?";
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
-		return 0;
-	sqlite3_bind_int(stmt, 1, conv_id);
-	sqlite3_bind_int(stmt, 2, uid);
-	int rc = sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	// Messages still queued for the member would never be delivered
+	const char *sql[] = {
+			"DELETE FROM pending_deliveries WHERE user_id = ? AND message_id IN (SELECT id FROM messages WHERE conv_id = ?)",
+			"DELETE FROM participants WHERE user_id = ? AND conv_id = ?"};
+
+	int rc = SQLITE_DONE;
+	for (int i = 0; i < 2 && rc == SQLITE_DONE; i++)
+	{
+		sqlite3_stmt *stmt;
+		if (sqlite3_prepare_v2(db, sql[i], -1, &stmt, 0) != SQLITE_OK)
+			return 0;
+		sqlite3_bind_int(stmt, 1, uid);
+		sqlite3_bind_int(stmt, 2, conv_id);
+		rc = sqlite3_step(stmt);
+		sqlite3_finalize(stmt);
+	}
 	return (rc == SQLITE_DONE);
 }
 
 int storage_delete_conversation(uint32_t conv_id)
 {
-	// Transactional delete recommended, but simple sequential for now
+	// All or nothing: a half-deleted conversation must not survive a failure
 	char *sql[] = {
+			"DELETE FROM pending_deliveries WHERE message_id IN (SELECT id FROM messages WHERE conv_id = ?)",
 			"DELETE FROM messages WHERE conv_id = ?",
 			"DELETE FROM participants WHERE conv_id = ?",
+			"DELETE FROM telemetry_channels WHERE conv_id = ?",
 			"DELETE FROM conversations WHERE conv_id = ?"};
 
-	for (int i = 0; i < 3; i++)
+	int in_txn = storage_begin();
+	int ok = 1;
+	for (int i = 0; i < 5 && ok; i++)
 	{
 		sqlite3_stmt *stmt;
-		if (sqlite3_prepare_v2(db, sql[i], -1, &stmt, 0) == SQLITE_OK)
+		if (sqlite3_prepare_v2(db, sql[i], -1, &stmt, 0) != SQLITE_OK)
 		{
-			sqlite3_bind_int(stmt, 1, conv_id);
-			sqlite3_step(stmt);
-			sqlite3_finalize(stmt);
+			ok = 0;
+			break;
 		}
+		sqlite3_bind_int(stmt, 1, conv_id);
+		ok = sqlite3_step(stmt) == SQLITE_DONE;
+		sqlite3_finalize(stmt);
 	}
-	return 1;
+
+	if (!in_txn)
+		return ok;
+	if (ok && storage_commit())
+		return 1;
+	storage_rollback();
+	return 0;
+}
+
+int storage_get_conv_type(uint32_t conv_id)
+{
+	const char *sql = "SELECT type FROM conversations WHERE conv_id = ?";
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+		return -1;
+	sqlite3_bind_int(stmt, 1, conv_id);
+	int type = -1;
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+		type = sqlite3_column_int(stmt, 0);
+	sqlite3_finalize(stmt);
+	return type;
+}
+
+int storage_get_telemetry_limits(uint32_t conv_id, uint32_t *max_rate, uint32_t *retention)
+{
+	const char *sql = "SELECT max_rate, retention FROM telemetry_channels WHERE conv_id = ?";
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+		return 0;
+	sqlite3_bind_int(stmt, 1, conv_id);
+	int found = 0;
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		*max_rate = (uint32_t)sqlite3_column_int64(stmt, 0);
+		*retention = (uint32_t)sqlite3_column_int64(stmt, 1);
+		found = 1;
+	}
+	sqlite3_finalize(stmt);
+	return found;
+}
+
+int storage_set_telemetry_limits(uint32_t conv_id, uint32_t max_rate, uint32_t retention)
+{
+	const char *sql = "INSERT OR REPLACE INTO telemetry_channels (conv_id, max_rate, retention) VALUES (?, ?, ?)";
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+		return 0;
+	sqlite3_bind_int(stmt, 1, conv_id);
+	sqlite3_bind_int64(stmt, 2, max_rate);
+	sqlite3_bind_int64(stmt, 3, retention);
+	int ok = sqlite3_step(stmt) == SQLITE_DONE;
+	sqlite3_finalize(stmt);
+	return ok;
 }
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "infrastructure/stream.h"
+#include "infrastructure/client_manager.h"
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t next_stream_id = 1;
+
+static void send_frame(ResponseStream *s, MessageType type, uint32_t data_len)
+{
+	if (s->failed)
+		return;
+
+	// Header and data are contiguous so each chunk leaves as a single frame
+	uint8_t frame[sizeof(StreamHeader) + STREAM_CHUNK_SIZE];
+	StreamHeader *h = (StreamHeader *)frame;
+	h->stream_id = s->header.stream_id;
+	h->seq = s->header.seq;
+	h->inner_type = s->header.inner_type;
+	if (data_len > 0)
+		memcpy(frame + sizeof(StreamHeader), s->data, data_len);
+
+	if (client_send(s->cli, type, frame, sizeof(StreamHeader) + data_len) < 0)
+		s->failed = 1;
+}
+
+static void flush_chunk(ResponseStream *s)
+{
+	if (s->used == 0)
+		return;
+	send_frame(s, MSG_STREAM_CHUNK, s->used);
+	s->header.seq++;
+	s->used = 0;
+}
+
+void stream_begin(ResponseStream *s, Client *cli, MessageType inner_type)
+{
+	s->cli = cli;
+	s->header.stream_id = next_stream_id++;
+	s->header.seq = 0;
+	s->header.inner_type = inner_type;
+	s->used = 0;
+	s->failed = 0;
+	send_frame(s, MSG_STREAM_BEGIN, 0);
+}
+
+int stream_write(ResponseStream *s, const void *data, uint32_t len)
+{
+	const uint8_t *src = data;
+
+	if (s->used + len > STREAM_CHUNK_SIZE)
+		flush_chunk(s);
+
+	// Oversized records are split across consecutive chunks
+	while (len > 0 && !s->failed)
+	{
+		uint32_t n = STREAM_CHUNK_SIZE - s->used;
+		if (n > len)
+			n = len;
+		memcpy(s->data + s->used, src, n);
+		s->used += n;
+		src += n;
+		len -= n;
+		if (s->used == STREAM_CHUNK_SIZE)
+			flush_chunk(s);
+	}
+	return !s->failed;
+}
+
+void stream_end(ResponseStream *s)
+{
+	flush_chunk(s);
+	// END carries the total number of chunks in seq
+	send_frame(s, MSG_STREAM_END, 0);
+}
+
+int stream_row(const void *row, void *ctx)
+{
+	StreamRowSink *sink = ctx;
+	uint32_t len = sink->row_size ? sink->row_size : strlen((const char *)row);
+	return stream_write(sink->stream, row, len);
+}
+
+int row_buffer_add(const void *row, void *ctx)
+{
+	RowBuffer *b = ctx;
+	if (b->used + b->row_size > b->cap)
+	{
+		uint32_t cap = b->cap ? b->cap * 2 : 16 * b->row_size;
+		uint8_t *grown = realloc(b->data, cap);
+		if (!grown)
+			return 0;
+		b->data = grown;
+		b->cap = cap;
+	}
+	memcpy(b->data + b->used, row, b->row_size);
+	b->used += b->row_size;
+	return 1;
+}
+
+void row_buffer_free(RowBuffer *b)
+{
+	free(b->data);
+	b->data = NULL;
+	b->used = b->cap = 0;
+}
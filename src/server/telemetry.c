@@ -0,0 +1,362 @@
+#include "infrastructure/telemetry.h"
+#include "infrastructure/membership.h"
+#include "system/logger.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define RING_MAGIC "MOTRING1"
+#define CHANNEL_BUCKETS 1024
+#define MAX_RETENTION (1u << 22) // 1 GiB of records per channel
+
+// On-disk layout: this header, then `slots` TelemetryRecord
+typedef struct __attribute__((packed))
+{
+	char magic[8];
+	uint32_t record_size;
+	uint32_t slots;
+	uint64_t written; // Samples appended since the ring was created
+	int64_t last_ts;
+} RingHeader;
+
+typedef struct Channel
+{
+	uint32_t conv_id;
+	RingHeader *ring;
+	size_t map_len;
+	uint32_t max_rate;
+	double tokens;
+	int64_t refill_ms;
+	struct Channel *next;
+} Channel;
+
+// Channel contents belong to their executor; the table itself is shared
+static Channel *channels[CHANNEL_BUCKETS];
+static pthread_mutex_t channels_lock = PTHREAD_MUTEX_INITIALIZER;
+static char ring_dir[512] = "telemetry";
+static uint32_t default_rate = 0;
+static uint32_t default_retention = 1;
+
+static int64_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static TelemetryRecord *slot_at(RingHeader *ring, uint64_t index)
+{
+	TelemetryRecord *slots = (TelemetryRecord *)(ring + 1);
+	return &slots[index % ring->slots];
+}
+
+static size_t ring_size(uint32_t slots)
+{
+	return sizeof(RingHeader) + (size_t)slots * sizeof(TelemetryRecord);
+}
+
+static void ring_path(uint32_t conv_id, const char *suffix, char *out, size_t size)
+{
+	snprintf(out, size, "%s/%u.ring%s", ring_dir, conv_id, suffix);
+}
+
+static uint32_t clamp_retention(uint32_t retention)
+{
+	if (retention == 0)
+		return default_retention;
+	return retention > MAX_RETENTION ? MAX_RETENTION : retention;
+}
+
+// Creates an empty ring (sparse: disk is only used as slots get written)
+static RingHeader *ring_create(const char *path, uint32_t slots)
+{
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return NULL;
+
+	size_t len = ring_size(slots);
+	RingHeader *ring = NULL;
+	if (ftruncate(fd, (off_t)len) == 0)
+	{
+		void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (map != MAP_FAILED)
+		{
+			ring = map;
+			memcpy(ring->magic, RING_MAGIC, sizeof(ring->magic));
+			ring->record_size = sizeof(TelemetryRecord);
+			ring->slots = slots;
+			ring->written = 0;
+			ring->last_ts = 0;
+		}
+	}
+	close(fd);
+	return ring;
+}
+
+// Maps an existing ring, NULL if missing or not a valid ring
+static RingHeader *ring_open(const char *path)
+{
+	int fd = open(path, O_RDWR);
+	if (fd < 0)
+		return NULL;
+
+	RingHeader hdr;
+	struct stat st;
+	RingHeader *ring = NULL;
+	if (fstat(fd, &st) == 0 && pread(fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr) &&
+			memcmp(hdr.magic, RING_MAGIC, sizeof(hdr.magic)) == 0 &&
+			hdr.record_size == sizeof(TelemetryRecord) && hdr.slots > 0 &&
+			(size_t)st.st_size == ring_size(hdr.slots))
+	{
+		void *map = mmap(NULL, ring_size(hdr.slots), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (map != MAP_FAILED)
+			ring = map;
+	}
+	close(fd);
+	return ring;
+}
+
+// Rebuilds the ring with a new slot count, keeping the newest samples
+static int ring_resize(Channel *ch, uint32_t slots)
+{
+	char path[600], tmp[600];
+	ring_path(ch->conv_id, "", path, sizeof(path));
+	ring_path(ch->conv_id, ".tmp", tmp, sizeof(tmp));
+
+	RingHeader *fresh = ring_create(tmp, slots);
+	if (!fresh)
+		return 0;
+
+	RingHeader *old = ch->ring;
+	uint64_t kept = old->written < old->slots ? old->written : old->slots;
+	if (kept > slots)
+		kept = slots;
+	for (uint64_t i = old->written - kept; i < old->written; i++)
+		*slot_at(fresh, fresh->written++) = *slot_at(old, i);
+	fresh->last_ts = old->last_ts;
+
+	if (rename(tmp, path) != 0)
+	{
+		munmap(fresh, ring_size(slots));
+		unlink(tmp);
+		return 0;
+	}
+	munmap(old, ch->map_len);
+	ch->ring = fresh;
+	ch->map_len = ring_size(slots);
+	return 1;
+}
+
+static Channel *find_channel(uint32_t conv_id)
+{
+	pthread_mutex_lock(&channels_lock);
+	Channel *ch = channels[conv_id % CHANNEL_BUCKETS];
+	while (ch && ch->conv_id != conv_id)
+		ch = ch->next;
+	pthread_mutex_unlock(&channels_lock);
+	return ch;
+}
+
+// Returns the open channel, opening it on first use. NULL if not a telemetry conversation.
+static Channel *get_channel(uint32_t conv_id)
+{
+	Channel *ch = find_channel(conv_id);
+	if (ch)
+		return ch;
+
+	if (storage_get_conv_type(conv_id) != CONV_TYPE_TELEMETRY)
+		return NULL;
+
+	uint32_t max_rate = default_rate;
+	uint32_t retention = default_retention;
+	storage_get_telemetry_limits(conv_id, &max_rate, &retention);
+	retention = clamp_retention(retention);
+
+	ch = calloc(1, sizeof(Channel));
+	if (!ch)
+		return NULL;
+	ch->conv_id = conv_id;
+	ch->max_rate = max_rate;
+	ch->tokens = max_rate;
+	ch->refill_ms = now_ms();
+
+	char path[600];
+	ring_path(conv_id, "", path, sizeof(path));
+	ch->ring = ring_open(path);
+	if (!ch->ring)
+		ch->ring = ring_create(path, retention);
+	if (!ch->ring)
+	{
+		log_print(LOG_ERROR, "Cannot map telemetry ring %s", path);
+		free(ch);
+		return NULL;
+	}
+	ch->map_len = ring_size(ch->ring->slots);
+	if (ch->ring->slots != retention)
+		ring_resize(ch, retention);
+
+	pthread_mutex_lock(&channels_lock);
+	ch->next = channels[conv_id % CHANNEL_BUCKETS];
+	channels[conv_id % CHANNEL_BUCKETS] = ch;
+	pthread_mutex_unlock(&channels_lock);
+	return ch;
+}
+
+void telemetry_init(const char *dir, uint32_t rate, uint32_t retention)
+{
+	strncpy(ring_dir, dir, sizeof(ring_dir) - 1);
+	ring_dir[sizeof(ring_dir) - 1] = '\0';
+	mkdir(ring_dir, 0700);
+
+	telemetry_set_defaults(rate, retention);
+	memset(channels, 0, sizeof(channels));
+}
+
+void telemetry_set_defaults(uint32_t rate, uint32_t retention)
+{
+	default_rate = rate;
+	default_retention = retention > MAX_RETENTION ? MAX_RETENTION : (retention > 0 ? retention : 1);
+}
+
+int telemetry_can_access(uint32_t conv_id, uint32_t uid)
+{
+	const MemberList *members = membership_get(conv_id);
+	return uid != 0 && members && members->type == CONV_TYPE_TELEMETRY && membership_contains(conv_id, uid);
+}
+
+int telemetry_append(uint32_t conv_id, uint32_t sender_uid, const void *data, uint16_t len)
+{
+	Channel *ch = get_channel(conv_id);
+	if (!ch || len > TELEMETRY_SAMPLE_MAX)
+		return -1;
+
+	int64_t now = now_ms();
+
+	// Token bucket, one second of burst
+	if (ch->max_rate > 0)
+	{
+		ch->tokens += (double)(now - ch->refill_ms) * ch->max_rate / 1000.0;
+		if (ch->tokens > ch->max_rate)
+			ch->tokens = ch->max_rate;
+		ch->refill_ms = now;
+		if (ch->tokens < 1.0)
+			return 0;
+		ch->tokens -= 1.0;
+	}
+
+	RingHeader *ring = ch->ring;
+	if (now < ring->last_ts)
+		now = ring->last_ts; // Keep timestamps ordered if the clock steps back
+
+	TelemetryRecord *rec = slot_at(ring, ring->written);
+	rec->timestamp_ms = now;
+	rec->sender_uid = sender_uid;
+	rec->len = len;
+	memcpy(rec->data, data, len);
+	memset(rec->data + len, 0, TELEMETRY_SAMPLE_MAX - len);
+
+	// Publish only once the slot is complete
+	ring->last_ts = now;
+	ring->written++;
+	return 1;
+}
+
+int telemetry_each(uint32_t conv_id, int64_t from_ms, int64_t to_ms, uint32_t max_count,
+									 StorageRowCallback cb, void *ctx)
+{
+	Channel *ch = get_channel(conv_id);
+	if (!ch)
+		return 0;
+
+	RingHeader *ring = ch->ring;
+	uint64_t end = ring->written;
+	uint64_t begin = end > ring->slots ? end - ring->slots : 0;
+	if (to_ms == 0)
+		to_ms = INT64_MAX;
+
+	// First sample at or after from_ms
+	uint64_t lo = begin, hi = end;
+	while (lo < hi)
+	{
+		uint64_t mid = lo + (hi - lo) / 2;
+		if (slot_at(ring, mid)->timestamp_ms < from_ms)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	int count = 0;
+	for (uint64_t i = lo; i < end; i++)
+	{
+		const TelemetryRecord *rec = slot_at(ring, i);
+		if (rec->timestamp_ms > to_ms || (max_count > 0 && (uint32_t)count >= max_count))
+			break;
+		count++;
+		if (!cb(rec, ctx))
+			break;
+	}
+	return count;
+}
+
+int telemetry_configure(uint32_t conv_id, uint32_t max_rate, uint32_t retention)
+{
+	Channel *ch = get_channel(conv_id);
+	if (!ch)
+		return 0;
+
+	retention = clamp_retention(retention);
+	ch->max_rate = max_rate;
+	ch->tokens = max_rate;
+	ch->refill_ms = now_ms();
+	if (ch->ring->slots != retention && !ring_resize(ch, retention))
+	{
+		log_print(LOG_ERROR, "Cannot resize telemetry ring for conv %u", conv_id);
+		return 0;
+	}
+	return 1;
+}
+
+void telemetry_drop(uint32_t conv_id)
+{
+	pthread_mutex_lock(&channels_lock);
+	Channel **link = &channels[conv_id % CHANNEL_BUCKETS];
+	while (*link && (*link)->conv_id != conv_id)
+		link = &(*link)->next;
+
+	Channel *ch = *link;
+	if (ch)
+		*link = ch->next;
+	pthread_mutex_unlock(&channels_lock);
+
+	if (ch)
+	{
+		munmap(ch->ring, ch->map_len);
+		free(ch);
+	}
+
+	char path[600];
+	ring_path(conv_id, "", path, sizeof(path));
+	unlink(path);
+}
+
+void telemetry_close_all(void)
+{
+	for (int b = 0; b < CHANNEL_BUCKETS; b++)
+	{
+		Channel *ch = channels[b];
+		while (ch)
+		{
+			Channel *next = ch->next;
+			munmap(ch->ring, ch->map_len);
+			free(ch);
+			ch = next;
+		}
+		channels[b] = NULL;
+	}
+}
@@ -0,0 +1,146 @@
+#include "infrastructure/timers.h"
+#include "system/logger.h"
+#include <errno.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+// 4 levels of 64 slots: 6.4 s at tick resolution, then 7 min, 7 h and 19 days
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN (1ull << (WHEEL_BITS * WHEEL_LEVELS))
+
+static Timer *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static uint64_t now_tick = 0; // Next tick to run
+static int timer_fd = -1;
+
+static void unlink_timer(Timer *t)
+{
+	*t->pprev = t->next;
+	if (t->next)
+		t->next->pprev = t->pprev;
+	t->next = NULL;
+	t->pprev = NULL;
+}
+
+static void push(Timer **list, Timer *t)
+{
+	t->next = *list;
+	if (t->next)
+		t->next->pprev = &t->next;
+	*list = t;
+	t->pprev = list;
+}
+
+// Level chosen by distance; slot by the expiry bits of that level, so a
+// level's slot comes up (and is cascaded down) just before its timers are due
+static void link_timer(Timer *t)
+{
+	if (t->expires < now_tick)
+		t->expires = now_tick;
+	if (t->expires - now_tick >= WHEEL_SPAN)
+		t->expires = now_tick + WHEEL_SPAN - 1;
+
+	uint64_t delta = t->expires - now_tick;
+	int level = 0;
+	while (level < WHEEL_LEVELS - 1 && delta >= (1ull << (WHEEL_BITS * (level + 1))))
+		level++;
+	push(&wheel[level][(t->expires >> (WHEEL_BITS * level)) & WHEEL_MASK], t);
+}
+
+// Moves the timers of one slot to the levels below
+static void cascade(int level, int index)
+{
+	Timer *list = wheel[level][index];
+	wheel[level][index] = NULL;
+	if (list)
+		list->pprev = &list;
+
+	Timer *t;
+	while ((t = list))
+	{
+		unlink_timer(t);
+		link_timer(t);
+	}
+}
+
+static void run_tick(void)
+{
+	int index = (int)(now_tick & WHEEL_MASK);
+	for (int level = 1; level < WHEEL_LEVELS && index == 0; level++)
+	{
+		index = (int)((now_tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+		cascade(level, index);
+	}
+
+	// Detached first: callbacks may arm timers (for later ticks) or cancel
+	// any timer, including ones still in this list
+	Timer *list = wheel[0][now_tick & WHEEL_MASK];
+	wheel[0][now_tick & WHEEL_MASK] = NULL;
+	if (list)
+		list->pprev = &list;
+	now_tick++;
+
+	Timer *t;
+	while ((t = list))
+	{
+		unlink_timer(t);
+		t->fn(t->arg);
+	}
+}
+
+int timers_init(void)
+{
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer_fd < 0)
+		return -1;
+
+	struct itimerspec period = {{0, TIMER_TICK_MS * 1000000L}, {0, TIMER_TICK_MS * 1000000L}};
+	if (timerfd_settime(timer_fd, 0, &period, NULL) < 0)
+	{
+		close(timer_fd);
+		timer_fd = -1;
+	}
+	return timer_fd;
+}
+
+void timers_run(void)
+{
+	uint64_t ticks = 0;
+	if (read(timer_fd, &ticks, sizeof(ticks)) < 0 && errno != EAGAIN)
+		log_print(LOG_WARN, "Timer read failed");
+
+	// Ticks missed while the loop was busy all run now, in order
+	while (ticks-- > 0)
+		run_tick();
+}
+
+uint64_t timers_now(void)
+{
+	return now_tick;
+}
+
+void timer_init(Timer *t, TimerFn fn, void *arg)
+{
+	t->next = NULL;
+	t->pprev = NULL;
+	t->expires = 0;
+	t->fn = fn;
+	t->arg = arg;
+}
+
+void timer_arm(Timer *t, uint32_t ms)
+{
+	if (t->pprev)
+		unlink_timer(t);
+	t->expires = now_tick + (ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+	link_timer(t);
+}
+
+void timer_cancel(Timer *t)
+{
+	if (t->pprev)
+		unlink_timer(t);
+}
@@ -0,0 +1,508 @@
+#include "infrastructure/topics.h"
+#include "infrastructure/client_manager.h"
+#include "infrastructure/membership.h"
+#include "system/logger.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHILD_BUCKETS 4096
+#define MESSAGE_HEADER_LEN offsetof(TopicMessage, data)
+
+typedef struct TopicSubscription TopicSubscription;
+
+typedef struct TopicNode
+{
+	char *name; // One level; "+" and "#" only appear in filters
+	struct TopicNode *parent;
+	struct TopicNode *children; // Enumeration (retained replay, pruning)
+	struct TopicNode *sibling;
+	struct TopicNode *hash_next; // Chain in the (parent, name) child index
+	TopicSubscription *subs;
+	TopicMessage *retained;
+} TopicNode;
+
+struct TopicSubscription
+{
+	Client *cli;
+	TopicNode *node;
+	TopicSubscription *node_prev;
+	TopicSubscription *node_next;
+	TopicSubscription *cli_next;
+};
+
+// Per-client state, hung on Client.topics
+struct TopicState
+{
+	TopicSubscription *subs;
+	int count;
+	uint64_t mark; // Last publish delivered, to reach each client once
+};
+
+typedef struct
+{
+	const char *s;
+	size_t len;
+} Level;
+
+// Who may use a topic, from its first two levels (see topics.h)
+typedef enum
+{
+	NS_NONE = 0,
+	NS_USER,
+	NS_CONV,
+	NS_PUBLIC
+} NamespaceKind;
+
+typedef struct
+{
+	NamespaceKind kind;
+	uint32_t id; // uid or conv_id
+} TopicNamespace;
+
+static TopicNode root;
+static TopicNode *child_index[CHILD_BUCKETS];
+static uint64_t publish_mark = 0;
+
+static char user_root[TOPIC_MAX_LEN];
+static char conv_root[TOPIC_MAX_LEN];
+static char public_root[TOPIC_MAX_LEN];
+static uint32_t retained_max = 0;
+static size_t retained_bytes_max = 0;
+static uint32_t retained_count = 0;
+static size_t retained_bytes = 0;
+
+static uint32_t child_hash(const TopicNode *parent, const char *name, size_t len)
+{
+	uint32_t h = 2166136261u ^ (uint32_t)((uintptr_t)parent >> 4);
+	for (size_t i = 0; i < len; i++)
+		h = (h ^ (uint8_t)name[i]) * 16777619u;
+	return h % CHILD_BUCKETS;
+}
+
+static TopicNode *find_child(TopicNode *parent, const char *name, size_t len)
+{
+	TopicNode *n = child_index[child_hash(parent, name, len)];
+	while (n && !(n->parent == parent && strlen(n->name) == len && memcmp(n->name, name, len) == 0))
+		n = n->hash_next;
+	return n;
+}
+
+static TopicNode *get_child(TopicNode *parent, const char *name, size_t len)
+{
+	TopicNode *n = find_child(parent, name, len);
+	if (n)
+		return n;
+
+	n = calloc(1, sizeof(TopicNode));
+	if (!n)
+		return NULL;
+	n->name = malloc(len + 1);
+	if (!n->name)
+	{
+		free(n);
+		return NULL;
+	}
+	memcpy(n->name, name, len);
+	n->name[len] = '\0';
+	n->parent = parent;
+
+	n->sibling = parent->children;
+	parent->children = n;
+	uint32_t h = child_hash(parent, name, len);
+	n->hash_next = child_index[h];
+	child_index[h] = n;
+	return n;
+}
+
+// Frees nodes that no longer hold anything, walking up from `n`
+static void prune(TopicNode *n)
+{
+	while (n != &root && !n->subs && !n->retained && !n->children)
+	{
+		TopicNode *parent = n->parent;
+
+		TopicNode **link = &parent->children;
+		while (*link != n)
+			link = &(*link)->sibling;
+		*link = n->sibling;
+
+		link = &child_index[child_hash(parent, n->name, strlen(n->name))];
+		while (*link != n)
+			link = &(*link)->hash_next;
+		*link = n->hash_next;
+
+		free(n->name);
+		free(n);
+		n = parent;
+	}
+}
+
+static int is_wildcard(const TopicNode *n)
+{
+	return strcmp(n->name, "+") == 0 || strcmp(n->name, "#") == 0;
+}
+
+// Splits on '/'. Filters may use '+' as a level and '#' as the last level.
+static int split_levels(const char *name, int is_filter, Level *levels)
+{
+	size_t total = strnlen(name, TOPIC_MAX_LEN);
+	if (total == 0 || total == TOPIC_MAX_LEN)
+		return -1;
+
+	int count = 0;
+	const char *start = name;
+	while (1)
+	{
+		const char *end = strchr(start, '/');
+		size_t len = end ? (size_t)(end - start) : strlen(start);
+		if (count == TOPIC_MAX_DEPTH)
+			return -1;
+
+		for (size_t i = 0; i < len; i++)
+		{
+			if (start[i] == '+' || start[i] == '#')
+			{
+				if (!is_filter || len != 1)
+					return -1;
+				if (start[i] == '#' && end)
+					return -1; // '#' must be last
+			}
+		}
+		levels[count].s = start;
+		levels[count].len = len;
+		count++;
+
+		if (!end)
+			break;
+		start = end + 1;
+	}
+	return count;
+}
+
+static int level_is(const Level *l, const char *name)
+{
+	size_t len = strlen(name);
+	return len > 0 && l->len == len && memcmp(l->s, name, len) == 0;
+}
+
+static int level_id(const Level *l, uint32_t *id)
+{
+	if (l->len == 0 || l->len > 10)
+		return 0;
+	uint64_t v = 0;
+	for (size_t i = 0; i < l->len; i++)
+	{
+		if (l->s[i] < '0' || l->s[i] > '9')
+			return 0;
+		v = v * 10 + (uint64_t)(l->s[i] - '0');
+	}
+	if (v == 0 || v > UINT32_MAX)
+		return 0;
+	*id = (uint32_t)v;
+	return 1;
+}
+
+// Wildcards never pick a namespace, so a filter stays inside the one it names
+static TopicNamespace classify(const Level *levels, int count)
+{
+	TopicNamespace ns = {NS_NONE, 0};
+	if (level_is(&levels[0], public_root))
+		ns.kind = NS_PUBLIC;
+	else if (count >= 2 && level_id(&levels[1], &ns.id))
+	{
+		if (level_is(&levels[0], user_root))
+			ns.kind = NS_USER;
+		else if (level_is(&levels[0], conv_root))
+			ns.kind = NS_CONV;
+	}
+	return ns;
+}
+
+static int may_access(const Client *cli, const TopicNamespace *ns)
+{
+	switch (ns->kind)
+	{
+	case NS_PUBLIC:
+		return 1;
+	case NS_USER:
+		return cli->uid == ns->id;
+	case NS_CONV:
+		return cli->uid != 0 && membership_contains(ns->id, cli->uid);
+	default:
+		return 0;
+	}
+}
+
+// Stores (len > 0) or clears the retained value of `n`, within the global caps
+static int retain_value(TopicNode *n, const TopicMessage *m)
+{
+	size_t old = n->retained ? MESSAGE_HEADER_LEN + n->retained->len : 0;
+	size_t size = m->len > 0 ? MESSAGE_HEADER_LEN + m->len : 0;
+	if (size > 0 && ((retained_max > 0 && !n->retained && retained_count >= retained_max) ||
+									 (retained_bytes_max > 0 && retained_bytes - old + size > retained_bytes_max)))
+		return 0;
+
+	TopicMessage *copy = NULL;
+	if (size > 0)
+	{
+		copy = malloc(size);
+		if (!copy)
+			return 0;
+		memcpy(copy, m, size);
+		copy->retained = 1;
+	}
+
+	if (n->retained)
+		retained_count--;
+	free(n->retained);
+	n->retained = copy;
+	if (copy)
+		retained_count++;
+	retained_bytes = retained_bytes - old + size;
+	return 1;
+}
+
+void topics_init(const AppConfig *config)
+{
+	snprintf(user_root, sizeof(user_root), "%s", config->topic_user_root);
+	snprintf(conv_root, sizeof(conv_root), "%s", config->topic_conv_root);
+	snprintf(public_root, sizeof(public_root), "%s", config->topic_public_root);
+	retained_max = config->topic_retained_max > 0 ? (uint32_t)config->topic_retained_max : 0;
+	retained_bytes_max = config->topic_retained_kb > 0 ? (size_t)config->topic_retained_kb * 1024 : 0;
+}
+
+static void send_retained(Client *cli, const TopicNode *n)
+{
+	const TopicMessage *m = n->retained;
+	client_send(cli, MSG_TOPIC_MESSAGE, m, MESSAGE_HEADER_LEN + m->len);
+}
+
+static void send_retained_subtree(Client *cli, const TopicNode *n)
+{
+	if (n->retained)
+		send_retained(cli, n);
+	for (const TopicNode *c = n->children; c; c = c->sibling)
+	{
+		if (!is_wildcard(c))
+			send_retained_subtree(cli, c);
+	}
+}
+
+// Replays the retained values a new filter matches
+static void replay_retained(Client *cli, TopicNode *n, const Level *levels, int count, int i)
+{
+	if (i == count)
+	{
+		if (n->retained)
+			send_retained(cli, n);
+		return;
+	}
+
+	const Level *l = &levels[i];
+	if (l->len == 1 && l->s[0] == '#')
+	{
+		if (n != &root && n->retained)
+			send_retained(cli, n); // "a/#" also matches "a"
+		for (TopicNode *c = n->children; c; c = c->sibling)
+		{
+			if (!is_wildcard(c))
+				send_retained_subtree(cli, c);
+		}
+	}
+	else if (l->len == 1 && l->s[0] == '+')
+	{
+		for (TopicNode *c = n->children; c; c = c->sibling)
+		{
+			if (!is_wildcard(c))
+				replay_retained(cli, c, levels, count, i + 1);
+		}
+	}
+	else
+	{
+		TopicNode *c = find_child(n, l->s, l->len);
+		if (c)
+			replay_retained(cli, c, levels, count, i + 1);
+	}
+}
+
+// Access is checked again here: members leave conversations and connections
+// log in as someone else while their filters stay in place
+static int deliver(const TopicNode *n, const TopicMessage *m, const TopicNamespace *ns)
+{
+	int reached = 0;
+	for (TopicSubscription *s = n->subs; s; s = s->node_next)
+	{
+		if (s->cli->topics->mark == publish_mark || !may_access(s->cli, ns))
+			continue;
+		s->cli->topics->mark = publish_mark;
+		client_send(s->cli, MSG_TOPIC_MESSAGE, m, MESSAGE_HEADER_LEN + m->len);
+		reached++;
+	}
+	return reached;
+}
+
+// Follows the three branches that can match level i: '#', '+' and the literal name
+static int match(TopicNode *n, const Level *levels, int count, int i, const TopicMessage *m,
+								 const TopicNamespace *ns)
+{
+	int reached = 0;
+	TopicNode *multi = find_child(n, "#", 1);
+	if (multi)
+		reached += deliver(multi, m, ns);
+
+	if (i == count)
+		return reached + deliver(n, m, ns);
+
+	TopicNode *single = find_child(n, "+", 1);
+	if (single)
+		reached += match(single, levels, count, i + 1, m, ns);
+
+	TopicNode *literal = find_child(n, levels[i].s, levels[i].len);
+	if (literal)
+		reached += match(literal, levels, count, i + 1, m, ns);
+	return reached;
+}
+
+static TopicNode *walk(const Level *levels, int count, int create)
+{
+	TopicNode *n = &root;
+	for (int i = 0; i < count && n; i++)
+		n = create ? get_child(n, levels[i].s, levels[i].len) : find_child(n, levels[i].s, levels[i].len);
+	return n;
+}
+
+int topics_subscribe(Client *cli, const char *filter)
+{
+	Level levels[TOPIC_MAX_DEPTH];
+	int count = split_levels(filter, 1, levels);
+	if (count < 0)
+		return 0;
+
+	TopicNamespace ns = classify(levels, count);
+	if (!may_access(cli, &ns))
+		return 0;
+
+	if (!cli->topics)
+	{
+		cli->topics = calloc(1, sizeof(struct TopicState));
+		if (!cli->topics)
+			return 0;
+	}
+
+	TopicNode *n = walk(levels, count, 1);
+	if (!n)
+		return 0;
+
+	TopicSubscription *s = cli->topics->subs;
+	while (s && s->node != n)
+		s = s->cli_next;
+
+	if (!s)
+	{
+		if (cli->topics->count >= TOPIC_MAX_SUBSCRIPTIONS || !(s = calloc(1, sizeof(TopicSubscription))))
+		{
+			prune(n);
+			return 0;
+		}
+		s->cli = cli;
+		s->node = n;
+		s->node_next = n->subs;
+		if (n->subs)
+			n->subs->node_prev = s;
+		n->subs = s;
+		s->cli_next = cli->topics->subs;
+		cli->topics->subs = s;
+		cli->topics->count++;
+	}
+
+	replay_retained(cli, &root, levels, count, 0);
+	return 1;
+}
+
+static void unlink_subscription(TopicSubscription *s)
+{
+	TopicNode *n = s->node;
+	if (s->node_prev)
+		s->node_prev->node_next = s->node_next;
+	else
+		n->subs = s->node_next;
+	if (s->node_next)
+		s->node_next->node_prev = s->node_prev;
+	free(s);
+	prune(n);
+}
+
+int topics_unsubscribe(Client *cli, const char *filter)
+{
+	Level levels[TOPIC_MAX_DEPTH];
+	int count = split_levels(filter, 1, levels);
+	if (count < 0 || !cli->topics)
+		return 0;
+
+	TopicNode *n = walk(levels, count, 0);
+	if (!n)
+		return 0;
+
+	TopicSubscription **link = &cli->topics->subs;
+	while (*link && (*link)->node != n)
+		link = &(*link)->cli_next;
+	if (!*link)
+		return 0;
+
+	TopicSubscription *s = *link;
+	*link = s->cli_next;
+	cli->topics->count--;
+	unlink_subscription(s);
+	return 1;
+}
+
+int topics_publish(Client *sender, const char *topic, const void *data, uint16_t len, int retain)
+{
+	Level levels[TOPIC_MAX_DEPTH];
+	int count = split_levels(topic, 0, levels);
+	if (count < 0 || len > TOPIC_PAYLOAD_MAX)
+		return -1;
+
+	TopicNamespace ns = classify(levels, count);
+	if (!may_access(sender, &ns))
+		return -1;
+
+	TopicMessage m;
+	memset(&m, 0, MESSAGE_HEADER_LEN);
+	strncpy(m.topic, topic, TOPIC_MAX_LEN - 1);
+	m.sender_uid = sender->uid;
+	m.len = len;
+	memcpy(m.data, data, len);
+
+	if (retain)
+	{
+		TopicNode *n = walk(levels, count, len > 0);
+		if (n)
+		{
+			if (!retain_value(n, &m))
+				log_print(LOG_WARN, "Retained topics are full, %s is not retained", m.topic);
+			prune(n);
+		}
+	}
+
+	publish_mark++;
+	return match(&root, levels, count, 0, &m, &ns);
+}
+
+void topics_release(Client *cli)
+{
+	if (!cli->topics)
+		return;
+
+	TopicSubscription *s = cli->topics->subs;
+	while (s)
+	{
+		TopicSubscription *next = s->cli_next;
+		unlink_subscription(s);
+		s = next;
+	}
+	free(cli->topics);
+	cli->topics = NULL;
+}